@@ -0,0 +1,150 @@
+#include "BranchPredictor.h"
+
+#include <stdexcept>
+
+// link registers by the RISC-V calling convention: ra and t0
+static bool isLink(uint8_t reg) {
+    return reg == 1 || reg == 5;
+}
+
+static bool powerOf2(uint64_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+void checkPredictorConfig(const PredictorConfig& config) {
+    if (!powerOf2(config.btbEntries)) {
+        throw std::invalid_argument("The BTB entries must be a power of 2");
+    }
+    if (!powerOf2(config.tableEntries)) {
+        throw std::invalid_argument("The predictor table entries must be a power of 2");
+    }
+    if (config.historyBits > 63) {
+        throw std::invalid_argument("The branch history is at most 63 bits");
+    }
+}
+
+BranchPredictor::BranchPredictor(const PredictorConfig& config)
+    : config(config),
+      btb(config.btbEntries, BTBEntry{0, 0, BTB_INVALID}),
+      counters(config.tableEntries, 1),  // weakly not taken
+      history(0),
+      ras(config.rasEntries, 0),
+      rasTop(0),
+      rasSize(0) {}
+
+uint64_t BranchPredictor::predict(uint64_t PC, bool& hit) {
+    const BTBEntry& entry = btbEntry(PC);
+    hit = entry.kind != BTB_INVALID && entry.PC == PC;
+    if (!hit) return PC + 4;
+
+    switch (entry.kind) {
+        case BTB_BRANCH:
+            return counters[counterIndex(PC)] >= 2 ? entry.target : PC + 4;
+        case BTB_RETURN:
+        case BTB_SWAP:
+            if (rasSize > 0) return ras[(rasTop + ras.size() - 1) % ras.size()];
+            return entry.target;
+        default:
+            return entry.target;
+    }
+}
+
+void BranchPredictor::resolve(uint64_t PC, uint8_t opcode, uint8_t rd, uint8_t rs1, bool taken,
+                              uint64_t target) {
+    TransferKind kind = BTB_JUMP;
+    bool pop = false, push = false;
+    if (opcode == OP_BRANCH) {
+        kind = BTB_BRANCH;
+        uint8_t& counter = counters[counterIndex(PC)];
+        if (taken && counter < 3) counter++;
+        if (!taken && counter > 0) counter--;
+        uint64_t mask = (1ULL << config.historyBits) - 1;
+        history = ((history << 1) | taken) & mask;
+    } else {
+        // the RAS hints of the ISA manual: a link rd pushes, a JALR through a link rs1
+        // pops unless rd is the same register, and with two different links it does both
+        push = isLink(rd);
+        pop = opcode == OP_JALR && isLink(rs1) && rd != rs1;
+        if (pop) {
+            kind = push ? BTB_SWAP : BTB_RETURN;
+        } else if (push) {
+            kind = BTB_CALL;
+        }
+    }
+
+    // pop before push, so a coroutine switch replaces the top (a full stack drops its
+    // oldest on a push)
+    if (pop && rasSize > 0) {
+        rasTop = (rasTop + ras.size() - 1) % ras.size();
+        rasSize--;
+    }
+    if (push && !ras.empty()) {
+        ras[rasTop] = PC + 4;
+        rasTop = (rasTop + 1) % ras.size();
+        if (rasSize < ras.size()) rasSize++;
+    }
+
+    // only transfers that were taken at least once are worth an entry
+    BTBEntry& entry = btbEntry(PC);
+    if (taken) {
+        entry = BTBEntry{PC, target, kind};
+    } else if (entry.PC == PC) {
+        entry.kind = kind;
+    }
+}
+
+void BranchPredictor::saveState(CheckpointWriter& out) const {
+    out.put(config.kind);
+    out.put(config.btbEntries);
+    out.put(config.tableEntries);
+    out.put(config.historyBits);
+    out.put(config.rasEntries);
+    for (const BTBEntry& entry : btb) {
+        out.put(entry.PC);
+        out.put(entry.target);
+        out.put(entry.kind);
+    }
+    out.putBytes(counters.data(), counters.size());
+    out.put(history);
+    for (uint64_t address : ras) out.put(address);
+    out.put(rasTop);
+    out.put(rasSize);
+}
+
+bool BranchPredictor::restoreState(CheckpointReader& in) {
+    PredictorConfig saved;
+    saved.kind = static_cast<PredictorKind>(in.get());
+    saved.btbEntries = in.get();
+    saved.tableEntries = in.get();
+    saved.historyBits = in.get();
+    saved.rasEntries = in.get();
+
+    // read the whole section even if it is not used, the next one follows it
+    std::vector<BTBEntry> savedBtb;
+    for (uint64_t i = 0; i < saved.btbEntries && !in.hasFailed(); i++) {
+        uint64_t PC = in.get();
+        uint64_t target = in.get();
+        savedBtb.push_back(BTBEntry{PC, target, static_cast<TransferKind>(in.get())});
+    }
+    const uint8_t* savedCounters = in.getBytes(saved.tableEntries);
+    uint64_t savedHistory = in.get();
+    std::vector<uint64_t> savedRas;
+    for (uint64_t i = 0; i < saved.rasEntries && !in.hasFailed(); i++) {
+        savedRas.push_back(in.get());
+    }
+    uint64_t savedTop = in.get();
+    uint64_t savedSize = in.get();
+
+    // predict and resolve index the stack with these, a stack of 0 entries stays at 0
+    bool rasFits = saved.rasEntries == 0
+                       ? savedTop == 0 && savedSize == 0
+                       : savedTop < saved.rasEntries && savedSize <= saved.rasEntries;
+    if (!(saved == config) || in.hasFailed() || !rasFits) return false;
+    btb.swap(savedBtb);
+    counters.assign(savedCounters, savedCounters + saved.tableEntries);
+    history = savedHistory;
+    ras.swap(savedRas);
+    rasTop = savedTop;
+    rasSize = savedSize;
+    return true;
+}
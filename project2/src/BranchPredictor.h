@@ -0,0 +1,90 @@
+#pragma once
+#include <inttypes.h>
+
+#include <vector>
+
+#include "Checkpoint.h"
+#include "Utilities.h"
+
+enum PredictorKind {
+    PREDICT_NONE = 0,  // fetch always continues at PC + 4, as the reference pipeline
+    PREDICT_BIMODAL,   // 2-bit counters indexed by PC
+    PREDICT_GSHARE,    // 2-bit counters indexed by PC xor the global branch history
+};
+
+struct PredictorConfig {
+    PredictorKind kind = PREDICT_NONE;
+    uint64_t btbEntries = 512;     // direct-mapped, a power of 2
+    uint64_t tableEntries = 4096;  // 2-bit counters, a power of 2
+    uint64_t historyBits = 12;     // gshare only
+    uint64_t rasEntries = 8;       // 0 predicts returns from the BTB
+
+    bool operator==(const PredictorConfig& other) const {
+        return kind == other.kind && btbEntries == other.btbEntries &&
+               tableEntries == other.tableEntries && historyBits == other.historyBits &&
+               rasEntries == other.rasEntries;
+    }
+};
+
+// throw std::invalid_argument if a size of config is not a power of 2
+void checkPredictorConfig(const PredictorConfig& config);
+
+// Next-PC prediction for the IF stage: a BTB recognizes control transfers by their
+// PC before they are decoded, conditional branches take their direction from the
+// counters, calls and returns use the return-address stack. Everything is trained
+// when ID resolves the instruction (see resolve), none of it speculatively.
+class BranchPredictor {
+   private:
+    // BTB_SWAP is a coroutine switch, a JALR that both returns and calls
+    enum TransferKind : uint8_t {
+        BTB_INVALID = 0,
+        BTB_BRANCH,
+        BTB_JUMP,
+        BTB_CALL,
+        BTB_RETURN,
+        BTB_SWAP
+    };
+
+    struct BTBEntry {
+        uint64_t PC;
+        uint64_t target;
+        TransferKind kind;
+    };
+
+    PredictorConfig config;
+    std::vector<BTBEntry> btb;
+    std::vector<uint8_t> counters;
+    uint64_t history;
+    std::vector<uint64_t> ras;  // circular, rasTop is the next free slot
+    uint64_t rasTop;
+    uint64_t rasSize;
+
+    uint64_t counterIndex(uint64_t PC) const {
+        uint64_t index = PC >> 2;
+        if (config.kind == PREDICT_GSHARE) index ^= history;
+        return index & (counters.size() - 1);
+    }
+    BTBEntry& btbEntry(uint64_t PC) { return btb[(PC >> 2) & (btb.size() - 1)]; }
+
+   public:
+    // config as checked by checkPredictorConfig
+    explicit BranchPredictor(const PredictorConfig& config);
+
+    // the PC to fetch after the instruction at PC; hit is set if the BTB knew it
+    uint64_t predict(uint64_t PC, bool& hit);
+
+    // Train with an instruction ID resolved: a branch (OP_BRANCH), JAL or JALR at PC,
+    // with its registers, whether it transferred control and where to.
+    void resolve(uint64_t PC, uint8_t opcode, uint8_t rd, uint8_t rs1, bool taken,
+                 uint64_t target);
+    // the BTB entry of PC no longer holds a control transfer (self-modifying code)
+    void forget(uint64_t PC) {
+        BTBEntry& entry = btbEntry(PC);
+        if (entry.PC == PC) entry.kind = BTB_INVALID;
+    }
+
+    // Checkpoint section, as Cache: a predictor of another configuration is left as
+    // it is and restoreState returns false
+    void saveState(CheckpointWriter& out) const;
+    bool restoreState(CheckpointReader& in);
+};
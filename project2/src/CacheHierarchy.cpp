@@ -0,0 +1,129 @@
+#include "CacheHierarchy.h"
+
+#include <algorithm>
+
+CacheHierarchy::CacheHierarchy(const HierarchyConfig& config)
+    : memoryLatency(config.memoryLatency),
+      memoryBandwidth(config.memoryBandwidth),
+      memoryFree(0),
+      memoryReads(0),
+      memoryWrites(0),
+      memoryWriteBytes(0),
+      memoryWaitCycles(0) {
+    for (const CacheConfig& level : config.levels) levels.push_back(Cache(level, D_CACHE));
+}
+
+uint64_t CacheHierarchy::transferCycles(uint64_t blockSize) const {
+    if (memoryBandwidth == 0) return 0;
+    return (blockSize + memoryBandwidth - 1) / memoryBandwidth;
+}
+
+// the memory transfers one block (or write) after the other at its bandwidth: the
+// cycles an access of bytes arriving at cycle waits for its turn plus the latency
+uint64_t CacheHierarchy::memoryAccess(uint64_t cycle, uint64_t bytes) {
+    uint64_t start = std::max(cycle, memoryFree);
+    memoryFree = start + transferCycles(bytes);
+    memoryWaitCycles += start - cycle;
+    return (start - cycle) + memoryLatency;
+}
+
+// read the block of blockSize at address, missed by the level in front of levels[level],
+// from levels[level] on (the memory past the last one) at cycle
+uint64_t CacheHierarchy::read(size_t level, uint64_t address, uint64_t cycle,
+                              uint64_t blockSize) {
+    uint64_t latency = 0;
+    for (size_t i = level; i < levels.size(); i++) {
+        Cache& cache = levels[i];
+        latency += cache.config.missLatency;
+        bool hit = cache.access(address, CACHE_READ);
+        if (cache.wroteBack()) {
+            write(i + 1, cache.getWriteBackAddress(), cache.config.blockSize, cycle + latency);
+        }
+        if (hit) return latency;
+        blockSize = cache.config.blockSize;
+    }
+
+    memoryReads++;
+    return latency + memoryAccess(cycle + latency, blockSize);
+}
+
+// write bytes at address into levels[level] (the memory past the last one) at cycle
+uint64_t CacheHierarchy::write(size_t level, uint64_t address, uint64_t bytes, uint64_t cycle) {
+    if (level == levels.size()) {
+        memoryWrites++;
+        memoryWriteBytes += bytes;
+        return memoryAccess(cycle, bytes);
+    }
+    Cache& cache = levels[level];
+    uint64_t latency = cache.config.missLatency;
+    bool hit = cache.access(address, CACHE_WRITE);
+    if (cache.wroteBack()) {
+        write(level + 1, cache.getWriteBackAddress(), cache.config.blockSize, cycle + latency);
+    }
+    if (cache.config.writePolicy == WRITE_THROUGH) {
+        return latency + write(level + 1, address, bytes, cycle + latency);
+    }
+    // write-allocate: the rest of a block written in part comes from behind
+    if (!hit && bytes < cache.config.blockSize) {
+        latency += read(level + 1, address, cycle + latency, cache.config.blockSize);
+    }
+    return latency;
+}
+
+void CacheHierarchy::warm(uint64_t address) {
+    for (Cache& level : levels) {
+        if (level.access(address, CACHE_READ)) return;
+    }
+}
+
+void CacheHierarchy::resetStats() {
+    for (Cache& level : levels) level.resetStats();
+    memoryReads = 0;
+    memoryWrites = 0;
+    memoryWriteBytes = 0;
+    memoryWaitCycles = 0;
+}
+
+void CacheHierarchy::saveState(CheckpointWriter& out) const {
+    out.put(levels.size());
+    for (const Cache& level : levels) level.saveState(out);
+    out.put(memoryLatency);
+    out.put(memoryBandwidth);
+    out.put(memoryFree);
+    out.put(memoryReads);
+    out.put(memoryWrites);
+    out.put(memoryWriteBytes);
+    out.put(memoryWaitCycles);
+}
+
+bool CacheHierarchy::restoreState(CheckpointReader& in) {
+    uint64_t numSaved = in.get();
+    bool same = numSaved == levels.size();
+    // the levels are restored into copies, swapped in once all of them and the memory
+    // matched; levels this hierarchy does not have are read into a throwaway cache
+    std::vector<Cache> restored(levels);
+    Cache unused(CacheConfig{16, 16, 1, 0}, D_CACHE);
+    for (uint64_t i = 0; i < numSaved && !in.hasFailed(); i++) {
+        Cache& level = i < restored.size() ? restored[i] : unused;
+        same = level.restoreState(in) && same;
+    }
+    uint64_t savedLatency = in.get();
+    uint64_t savedBandwidth = in.get();
+    uint64_t savedFree = in.get();
+    uint64_t savedReads = in.get();
+    uint64_t savedWrites = in.get();
+    uint64_t savedWriteBytes = in.get();
+    uint64_t savedWait = in.get();
+
+    if (!same || savedLatency != memoryLatency || savedBandwidth != memoryBandwidth ||
+        in.hasFailed()) {
+        return false;
+    }
+    levels.swap(restored);
+    memoryFree = savedFree;
+    memoryReads = savedReads;
+    memoryWrites = savedWrites;
+    memoryWriteBytes = savedWriteBytes;
+    memoryWaitCycles = savedWait;
+    return true;
+}
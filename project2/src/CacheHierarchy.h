@@ -0,0 +1,64 @@
+#pragma once
+#include <inttypes.h>
+
+#include <vector>
+
+#include "Checkpoint.h"
+#include "cache.h"
+
+// The unified levels behind the split L1 caches and the memory behind them. An L1
+// miss looks its block up level by level, filling each level that misses, and a
+// miss of the last level reads the block from memory; that is a read at every
+// level, whatever the L1 access was. The levels neither include nor exclude what the
+// L1s hold. Writes into the hierarchy (L1 write-backs and write-throughs) stop at
+// the first level that is not write-through, which first reads the rest of the block
+// from the levels behind it if the write misses it and covers only part of it. The
+// dirty blocks levels evict go on to the next one in the background: they take its
+// bandwidth, not the L1's time.
+class CacheHierarchy {
+   private:
+    std::vector<Cache> levels;
+    uint64_t memoryLatency;
+    uint64_t memoryBandwidth;
+    uint64_t memoryFree;  // first cycle the memory is done with the transfers so far
+    uint64_t memoryReads;
+    uint64_t memoryWrites;
+    uint64_t memoryWriteBytes;
+    uint64_t memoryWaitCycles;
+
+    uint64_t transferCycles(uint64_t blockSize) const;
+    uint64_t memoryAccess(uint64_t cycle, uint64_t bytes);
+    uint64_t read(size_t level, uint64_t address, uint64_t cycle, uint64_t blockSize);
+    uint64_t write(size_t level, uint64_t address, uint64_t bytes, uint64_t cycle);
+
+   public:
+    explicit CacheHierarchy(const HierarchyConfig& config);
+
+    // Cycles a miss of address in an L1 of l1BlockSize at cycle costs beyond the L1's
+    // own miss latency: the latencies of the levels looked up and, if all of them
+    // miss, the memory latency and the wait for the transfer of the block
+    uint64_t missLatency(uint64_t address, uint64_t cycle, uint64_t l1BlockSize) {
+        return read(0, address, cycle, l1BlockSize);
+    }
+    // the same for a write of bytes at address from an L1, arriving at cycle: the
+    // levels written through and the one (or the memory) that takes it
+    uint64_t writeLatency(uint64_t address, uint64_t bytes, uint64_t cycle) {
+        return write(0, address, bytes, cycle);
+    }
+    // the lookups of missLatency alone, to warm the levels up
+    void warm(uint64_t address);
+
+    size_t numLevels() const { return levels.size(); }
+    const Cache& level(size_t i) const { return levels[i]; }
+    uint64_t getMemoryReads() const { return memoryReads; }
+    uint64_t getMemoryWrites() const { return memoryWrites; }
+    uint64_t getMemoryWriteBytes() const { return memoryWriteBytes; }
+    uint64_t getMemoryWaitCycles() const { return memoryWaitCycles; }
+    // restart the statistics of all levels and the memory, the contents stay
+    void resetStats();
+
+    // Checkpoint section, as Cache: if any level or the memory is configured
+    // differently, no level is changed and restoreState returns false
+    void saveState(CheckpointWriter& out) const;
+    bool restoreState(CheckpointReader& in);
+};
@@ -0,0 +1,43 @@
+#include "Checkpoint.h"
+
+#include <cstring>
+#include <iostream>
+
+Status CheckpointWriter::open(const std::string& fileName) {
+    out.close();
+    out.clear();
+    out.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << LOG_ERROR << "Could not create " << fileName << std::endl;
+        return ERROR;
+    }
+    putBytes(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    return SUCCESS;
+}
+
+Status CheckpointWriter::close() {
+    out.flush();
+    bool good = out.good();
+    out.close();
+    return good ? SUCCESS : ERROR;
+}
+
+Status CheckpointReader::open(const std::string& fileName) {
+    std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    if (!in) {
+        std::cerr << LOG_ERROR << "Could not open " << fileName << std::endl;
+        return ERROR;
+    }
+    data.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(data.data()), data.size());
+    offset = 0;
+    failed = !in;
+
+    const uint8_t* magic = getBytes(CHECKPOINT_MAGIC_SIZE);
+    if (!magic || memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0) {
+        std::cerr << LOG_ERROR << fileName << " is not a checkpoint" << std::endl;
+        return ERROR;
+    }
+    return SUCCESS;
+}
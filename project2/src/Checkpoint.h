@@ -0,0 +1,82 @@
+#pragma once
+#include <inttypes.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+
+// Checkpoint layout: an 8 byte magic, then the sections of CycleSimulator::saveCheckpoint
+// (simulator, memory, I-cache, D-cache, pipeline), each a sequence of little-endian
+// 64-bit values and raw byte blocks. Memory only stores its non-zero pages.
+#define CHECKPOINT_MAGIC "RVCKPT01"
+#define CHECKPOINT_MAGIC_SIZE 8
+
+// Writes a checkpoint file front to back.
+class CheckpointWriter {
+   private:
+    std::ofstream out;
+
+   public:
+    // (re)create the checkpoint file and write the magic
+    Status open(const std::string& fileName);
+
+    // little-endian whatever the host byte order
+    void put(uint64_t value) {
+        char bytes[8];
+        for (int i = 0; i < 8; i++) bytes[i] = static_cast<char>(value >> (8 * i));
+        out.write(bytes, 8);
+    }
+    void putBytes(const void* data, uint64_t length) {
+        out.write(static_cast<const char*>(data), length);
+    }
+    // a length-prefixed string
+    void putString(const std::string& value) {
+        put(value.size());
+        putBytes(value.data(), value.size());
+    }
+
+    // ERROR if any of the writes failed
+    Status close();
+};
+
+// Reads a checkpoint file front to back. The whole file is read in one go; reading
+// past its end returns zeros (or nullptr) and marks the reader as failed.
+class CheckpointReader {
+   private:
+    std::vector<uint8_t> data;
+    uint64_t offset;
+    bool failed;
+
+   public:
+    CheckpointReader() : offset(0), failed(false) {}
+
+    // read the file and check the magic
+    Status open(const std::string& fileName);
+
+    uint64_t get() {
+        const uint8_t* bytes = getBytes(8);
+        uint64_t value = 0;
+        for (int i = 0; bytes && i < 8; i++) value |= (uint64_t)bytes[i] << (8 * i);
+        return value;
+    }
+    // the next length bytes of the file, valid as long as the reader
+    const uint8_t* getBytes(uint64_t length) {
+        if (failed || length > data.size() - offset) {
+            failed = true;
+            return nullptr;
+        }
+        const uint8_t* bytes = data.data() + offset;
+        offset += length;
+        return bytes;
+    }
+    std::string getString() {
+        uint64_t length = get();
+        const uint8_t* bytes = getBytes(length);
+        return bytes ? std::string(reinterpret_cast<const char*>(bytes), length) : "";
+    }
+
+    // true once a read went past the end of the file
+    bool hasFailed() const { return failed; }
+};
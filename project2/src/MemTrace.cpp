@@ -0,0 +1,91 @@
+#include "MemTrace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+MemTraceWriter::MemTraceWriter() : buffer(MEM_TRACE_BUFFER_RECORDS), used(0) {}
+
+MemTraceWriter::~MemTraceWriter() {
+    close();
+}
+
+Status MemTraceWriter::open(const std::string& traceFile) {
+    close();
+    out.open(traceFile, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!out) {
+        std::cerr << LOG_ERROR << "Could not open memory trace file " << traceFile << std::endl;
+        return ERROR;
+    }
+    out.write(MEM_TRACE_MAGIC, MEM_TRACE_MAGIC_SIZE);
+    used = 0;
+    return SUCCESS;
+}
+
+// the records are written in host byte order, the simulator hosts are little-endian
+void MemTraceWriter::flush() {
+    out.write(reinterpret_cast<const char*>(buffer.data()), used * sizeof(uint64_t));
+    used = 0;
+}
+
+void MemTraceWriter::close() {
+    if (!out.is_open()) return;
+    flush();
+    out.close();
+}
+
+MemTraceReader::MemTraceReader()
+    : mapping(nullptr), mappingSize(0), records(nullptr), numRecords(0) {}
+
+MemTraceReader::~MemTraceReader() {
+    close();
+}
+
+Status MemTraceReader::open(const std::string& traceFile) {
+    close();
+    int fd = ::open(traceFile.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << LOG_ERROR << "Could not open memory trace " << traceFile << std::endl;
+        return ERROR;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < MEM_TRACE_MAGIC_SIZE) {
+        std::cerr << LOG_ERROR << traceFile << " is not a memory trace" << std::endl;
+        ::close(fd);
+        return ERROR;
+    }
+
+    mappingSize = info.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << LOG_ERROR << "Could not map memory trace " << traceFile << std::endl;
+        mapping = nullptr;
+        return ERROR;
+    }
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+    const char* data = static_cast<const char*>(mapping);
+    if (memcmp(data, MEM_TRACE_MAGIC, MEM_TRACE_MAGIC_SIZE) != 0 ||
+        (mappingSize - MEM_TRACE_MAGIC_SIZE) % sizeof(uint64_t) != 0) {
+        std::cerr << LOG_ERROR << traceFile << " is not a memory trace" << std::endl;
+        close();
+        return ERROR;
+    }
+    // the mapping is page aligned, so the records after the magic are 8-byte aligned
+    records = reinterpret_cast<const uint64_t*>(data + MEM_TRACE_MAGIC_SIZE);
+    numRecords = (mappingSize - MEM_TRACE_MAGIC_SIZE) / sizeof(uint64_t);
+    return SUCCESS;
+}
+
+void MemTraceReader::close() {
+    if (mapping) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+    records = nullptr;
+    numRecords = 0;
+}
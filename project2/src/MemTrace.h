@@ -0,0 +1,71 @@
+#pragma once
+#include <inttypes.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+
+// Memory access trace layout: an 8 byte magic, then one little-endian 64-bit
+// record per access holding (address << 2) | MemTraceType.
+#define MEM_TRACE_MAGIC "RVMEM001"
+#define MEM_TRACE_MAGIC_SIZE 8
+// Records buffered before they are written out.
+#define MEM_TRACE_BUFFER_RECORDS (1 << 17)
+
+enum MemTraceType {
+    MEM_IFETCH = 0,  // instruction fetch (I-cache)
+    MEM_READ = 1,    // load (D-cache)
+    MEM_WRITE = 2,   // store (D-cache)
+};
+
+inline uint64_t memTraceAddress(uint64_t record) { return record >> 2; }
+inline MemTraceType memTraceType(uint64_t record) {
+    return static_cast<MemTraceType>(record & 3);
+}
+
+// Records the address stream of a simulation into a binary trace file.
+class MemTraceWriter {
+   private:
+    std::ofstream out;
+    std::vector<uint64_t> buffer;
+    size_t used;
+
+    void flush();
+
+   public:
+    MemTraceWriter();
+    ~MemTraceWriter();
+
+    // (re)create the trace file
+    Status open(const std::string& traceFile);
+    bool isOpen() const { return out.is_open(); }
+
+    void write(uint64_t address, MemTraceType type) {
+        buffer[used++] = (address << 2) | type;
+        if (used == buffer.size()) flush();
+    }
+
+    void close();
+};
+
+// A trace file mapped read-only into memory.
+class MemTraceReader {
+   private:
+    void* mapping;
+    size_t mappingSize;
+    const uint64_t* records;
+    size_t numRecords;
+
+   public:
+    MemTraceReader();
+    ~MemTraceReader();
+
+    Status open(const std::string& traceFile);
+    void close();
+
+    size_t size() const { return numRecords; }
+    const uint64_t* begin() const { return records; }
+    const uint64_t* end() const { return records + numRecords; }
+};
@@ -1,17 +1,70 @@
 #include "MemoryStore.h"
 
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
+#include "Checkpoint.h"
 #include "Utilities.h"
 
+// Pages handed out to all memory stores of the process. They are carved out of large
+// chunks and recycled through a free list. The pool itself is never destroyed, so
+// stores that outlive other static objects can still return their pages.
+class PagePool {
+   private:
+    static const size_t CHUNK_PAGES = 64;
+    std::mutex lock;
+    std::vector<MemoryPage *> freePages;
+
+   public:
+    MemoryPage *take() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (freePages.empty()) {
+            MemoryPage *chunk = new MemoryPage[CHUNK_PAGES];
+            for (size_t i = 0; i < CHUNK_PAGES; i++) freePages.push_back(&chunk[i]);
+        }
+        MemoryPage *page = freePages.back();
+        freePages.pop_back();
+        return page;
+    }
+
+    void give(MemoryPage *page) {
+        std::lock_guard<std::mutex> guard(lock);
+        freePages.push_back(page);
+    }
+};
+
+static PagePool &pagePool() {
+    static PagePool *pool = new PagePool();
+    return *pool;
+}
+
+// a pool page holding a copy of bytes
+static std::shared_ptr<MemoryPage> newPage(const uint8_t *bytes) {
+    MemoryPage *page = pagePool().take();
+    memcpy(page->bytes, bytes, MEMORY_PAGE_SIZE);
+    return std::shared_ptr<MemoryPage>(page, [](MemoryPage *p) { pagePool().give(p); });
+}
+
+// what missing pages read as
+static const MemoryPage zeroPage = {};
+
 MemoryStore::MemoryStore(uint64_t startAddr, uint64_t numEntries)
-    : startAddr(startAddr) {
-    // fill memory array with 0s
-    memArr.resize(numEntries);
-    std::fill(memArr.begin(), memArr.end(), 0);
+    : startAddr(startAddr), memSize(numEntries), entryPoint(0) {
+    // all pages start out missing, i.e. zero
+    forgetLastPage();
 
     // If we can't initialise memory appropriately, don't return a
     // MemoryStore at all.
@@ -19,10 +72,9 @@ MemoryStore::MemoryStore(uint64_t startAddr, uint64_t numEntries)
 }
 
 MemoryStore::MemoryStore(uint64_t startAddr, uint64_t numEntries, const char *fileName)
-    : startAddr(startAddr) {
-    // fill memory array with 0s
-    memArr.resize(numEntries);
-    std::fill(memArr.begin(), memArr.end(), 0);
+    : startAddr(startAddr), memSize(numEntries), entryPoint(0) {
+    // all pages start out missing, i.e. zero
+    forgetLastPage();
 
     // If we can't initialise memory appropriately, don't return a
     // MemoryStore at all.
@@ -31,7 +83,111 @@ MemoryStore::MemoryStore(uint64_t startAddr, uint64_t numEntries, const char *fi
     loadFromFile(fileName);
 }
 
+MemoryStore::MemoryStore(const MemoryStore &other)
+    : startAddr(other.startAddr),
+      memSize(other.memSize),
+      pages(other.pages),
+      entryPoint(other.entryPoint) {
+    // the pages are shared now, neither store may write them through its last page
+    forgetLastPage();
+    if (other.lastPageWritable) other.forgetLastPage();
+}
+
+MemoryStore &MemoryStore::operator=(const MemoryStore &other) {
+    if (this == &other) return *this;
+    startAddr = other.startAddr;
+    memSize = other.memSize;
+    pages = other.pages;
+    entryPoint = other.entryPoint;
+    forgetLastPage();
+    if (other.lastPageWritable) other.forgetLastPage();
+    return *this;
+}
+
+uint8_t *MemoryStore::readPage(uint64_t pageNumber) {
+    auto it = pages.find(pageNumber);
+    if (it == pages.end()) {
+        uint8_t *bytes = const_cast<uint8_t *>(zeroPage.bytes);
+        rememberPage(pageNumber, bytes, false);
+        return bytes;
+    }
+    bool exclusive = it->second.use_count() == 1;
+    // pairs with the release of the last other owner, its reads happen before our writes
+    if (exclusive) std::atomic_thread_fence(std::memory_order_acquire);
+    rememberPage(pageNumber, it->second->bytes, exclusive);
+    return it->second->bytes;
+}
+
+uint8_t *MemoryStore::writePage(uint64_t pageNumber) {
+    std::shared_ptr<MemoryPage> &page = pages[pageNumber];
+    if (!page) {
+        page = newPage(zeroPage.bytes);
+    } else if (page.use_count() > 1) {
+        page = newPage(page->bytes);  // copy on write
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    rememberPage(pageNumber, page->bytes, true);
+    return page->bytes;
+}
+
+// A whole file mapped read-only, unmapped when it goes out of scope.
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    uint64_t length = 0;
+    bool isOpen = false;
+
+    explicit MappedFile(const char* fileName) {
+        int fd = open(fileName, O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0) {
+            length = info.st_size;
+            isOpen = true;
+            if (length > 0) {
+                void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    isOpen = false;
+                    length = 0;
+                } else {
+                    data = static_cast<const uint8_t*>(mapping);
+                }
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<uint8_t*>(data), length);
+    }
+};
+
+// binary init_mem_image: segments after the magic, see MEM_IMAGE_MAGIC
+static int loadBinaryImage(MemoryStore *mem, const MappedFile &image) {
+    uint64_t offset = MEM_IMAGE_MAGIC_SIZE;
+    while (offset < image.length) {
+        uint64_t addr, length;
+        if (image.length - offset < 16) return -EINVAL;
+        memcpy(&addr, image.data + offset, 8);
+        memcpy(&length, image.data + offset + 8, 8);
+        offset += 16;
+        if (length > image.length - offset) return -EINVAL;
+        if (mem->loadImage(addr, image.data + offset, length)) return -EINVAL;
+        offset += length;
+    }
+    return 0;
+}
+
 int prepareMemory(MemoryStore *mem) {
+    MappedFile image("init_mem_image");
+    if (image.length >= MEM_IMAGE_MAGIC_SIZE &&
+        memcmp(image.data, MEM_IMAGE_MAGIC, MEM_IMAGE_MAGIC_SIZE) == 0) {
+        if (mem && loadBinaryImage(mem, image)) {
+            std::cout << LOG_ERROR << "Could not set initial memory value!" << std::endl;
+            return -EINVAL;
+        }
+        return 0;
+    }
+
     std::ifstream initMem;
     initMem.open("init_mem_image", std::ios::in);
 
@@ -54,68 +210,145 @@ int prepareMemory(MemoryStore *mem) {
     return 0;
 }
 
-int MemoryStore::getOrSetValue(bool get, uint64_t address, uint64_t &value, MemEntrySize size) {
-    uint64_t byteSize = static_cast<uint64_t>(size);
+int MemoryStore::invalidSize() {
+    std::cerr << LOG_ERROR << "Invalid size passed, cannot read/write memory" << std::endl;
+    return -EINVAL;
+}
 
-    switch (size) {
-        case BYTE_SIZE:
-        case HALF_SIZE:
-        case WORD_SIZE:
-        case DOUBLE_SIZE:
-            break;
-        default:
-            std::cerr << LOG_ERROR << "Invalid size passed, cannot read/write memory" << std::endl;
-            return -EINVAL;
+uint8_t MemoryStore::byteAt(uint64_t relativeAddr) {
+    if (!inBounds(relativeAddr, 1)) throw std::out_of_range("MemoryStore::byteAt");
+    return readPage(relativeAddr >> MEMORY_PAGE_BITS)[relativeAddr & (MEMORY_PAGE_SIZE - 1)];
+}
+
+int MemoryStore::getSlow(uint64_t address, uint64_t &value, uint64_t byteSize) {
+    uint64_t relativeAddr = address - startAddr;
+    if (!inBounds(relativeAddr, byteSize)) return partialAccess(true, address, value, byteSize);
+
+    uint64_t offset = relativeAddr & (MEMORY_PAGE_SIZE - 1);
+    value = 0;
+    if (offset + byteSize <= MEMORY_PAGE_SIZE) {
+        memcpy(&value, readPage(relativeAddr >> MEMORY_PAGE_BITS) + offset, byteSize);
+    } else {
+        // crosses into the next page
+        for (uint64_t i = 0; i < byteSize; ++i) {
+            uint64_t addr = relativeAddr + i;
+            uint8_t byte = readPage(addr >> MEMORY_PAGE_BITS)[addr & (MEMORY_PAGE_SIZE - 1)];
+            value |= (uint64_t)byte << (i * 8);
+        }
     }
+    return 0;
+}
 
+int MemoryStore::setSlow(uint64_t address, uint64_t value, uint64_t byteSize) {
     uint64_t relativeAddr = address - startAddr;
-    try {
+    if (!inBounds(relativeAddr, byteSize)) return partialAccess(false, address, value, byteSize);
+
+    uint64_t offset = relativeAddr & (MEMORY_PAGE_SIZE - 1);
+    if (offset + byteSize <= MEMORY_PAGE_SIZE) {
+        memcpy(writePage(relativeAddr >> MEMORY_PAGE_BITS) + offset, &value, byteSize);
+    } else {
+        // crosses into the next page
+        for (uint64_t i = 0; i < byteSize; ++i) {
+            uint64_t addr = relativeAddr + i;
+            writePage(addr >> MEMORY_PAGE_BITS)[addr & (MEMORY_PAGE_SIZE - 1)] =
+                (value >> (i * 8)) & 0xFF;
+        }
+    }
+    return 0;
+}
+
+int MemoryStore::partialAccess(bool get, uint64_t address, uint64_t &value, uint64_t byteSize) {
+    // the bytes in front of the first one outside the memory are still accessed
+    uint64_t relativeAddr = address - startAddr;
+    if (get) value = 0;
+    for (uint64_t i = 0; i < byteSize && relativeAddr + i < memSize; ++i) {
+        uint64_t addr = relativeAddr + i;
+        uint64_t page = addr >> MEMORY_PAGE_BITS, offset = addr & (MEMORY_PAGE_SIZE - 1);
         if (get) {
-            value = 0;
-            for (uint64_t i = 0; i < byteSize; ++i) {
-                value |= ((uint64_t)memArr.at(relativeAddr + i) << (i * 8));
-            }
+            value |= ((uint64_t)readPage(page)[offset] << (i * 8));
         } else {
-            for (uint64_t i = 0; i < byteSize; ++i) {
-                memArr.at(relativeAddr + i) = (value >> (i * 8)) & 0xFF;
-            }
+            writePage(page)[offset] = (value >> (i * 8)) & 0xFF;
         }
-    } catch (const std::out_of_range &e) {
-        std::cerr << LOG_ERROR << "Access violation at address 0x" << std::hex << address << std::endl;
-        return -EINVAL;
     }
+    std::cerr << LOG_ERROR << "Access violation at address 0x" << std::hex << address << std::endl;
+    return -EINVAL;
+}
 
-    return 0;
+int MemoryStore::loadImage(uint64_t address, const uint8_t *data, uint64_t length) {
+    uint64_t relativeAddr = address - startAddr;
+    if (length == 0) return 0;
+
+    uint64_t fits = length;
+    if (!inBounds(relativeAddr, length)) fits = relativeAddr < memSize ? memSize - relativeAddr : 0;
+    // one copy per page
+    for (uint64_t copied = 0; copied < fits;) {
+        uint64_t addr = relativeAddr + copied;
+        uint64_t offset = addr & (MEMORY_PAGE_SIZE - 1);
+        uint64_t chunk = std::min<uint64_t>(MEMORY_PAGE_SIZE - offset, fits - copied);
+        memcpy(writePage(addr >> MEMORY_PAGE_BITS) + offset, data + copied, chunk);
+        copied += chunk;
+    }
+    if (fits == length) return 0;
+
+    std::cerr << LOG_ERROR << "Access violation at address 0x" << std::hex << address + fits
+              << std::endl;
+    return -EINVAL;
 }
 
-int MemoryStore::getMemValue(uint64_t address, uint64_t &value, MemEntrySize size) {
-    return getOrSetValue(true, address, value, size);
+void MemoryStore::saveState(CheckpointWriter &out) const {
+    std::vector<uint64_t> saved;
+    for (const auto &page : pages) {
+        if (memcmp(page.second->bytes, zeroPage.bytes, MEMORY_PAGE_SIZE) != 0) {
+            saved.push_back(page.first);
+        }
+    }
+    std::sort(saved.begin(), saved.end());
+
+    out.put(startAddr);
+    out.put(memSize);
+    out.put(entryPoint);
+    out.put(saved.size());
+    for (uint64_t pageNumber : saved) {
+        out.put(pageNumber);
+        out.putBytes(pages.at(pageNumber)->bytes, MEMORY_PAGE_SIZE);
+    }
 }
 
-int MemoryStore::setMemValue(uint64_t address, uint64_t value, MemEntrySize size) {
-    return getOrSetValue(false, address, value, size);
+int MemoryStore::restoreState(CheckpointReader &in) {
+    uint64_t start = in.get();
+    uint64_t size = in.get();
+    if (start != startAddr || size != memSize) {
+        std::cerr << LOG_ERROR << "The checkpoint memory does not match the program memory"
+                  << std::endl;
+        return -EINVAL;
+    }
+    entryPoint = in.get();
+    pages.clear();
+    forgetLastPage();
+    uint64_t count = in.get();
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t pageNumber = in.get();
+        const uint8_t *bytes = in.getBytes(MEMORY_PAGE_SIZE);
+        if (!bytes) return -EINVAL;
+        pages[pageNumber] = newPage(bytes);
+    }
+    return in.hasFailed() ? -EINVAL : 0;
 }
 
 int MemoryStore::loadFromFile(const char *fileName) {
-    // Open instruction file
-    std::ifstream infile(fileName, std::ios::binary | std::ios::in);
-
-    if (infile) {
-        // Get length of the file and read instruction file into a buffer
-        infile.seekg(0, std::ios::end);
-        int length = infile.tellg();
-        infile.seekg(0, std::ios::beg);
-
-        char *buf = new char[length];
-        infile.read(buf, length);
-        infile.close();
-
-        // Initialize memory store with buffer contents
-        int memLength = length / sizeof(buf[0]);
-        int i;
-        for (i = 0; i < memLength; i++) {
-            this->setMemValue(i * BYTE_SIZE, buf[i], BYTE_SIZE);
+    // Map the instruction file and copy it to address 0 in one go
+    MappedFile file(fileName);
+
+    if (file.isOpen) {
+        // a freshly loaded image is usually copied next, which must not write to it
+        if (file.length >= SELFMAG && memcmp(file.data, ELFMAG, SELFMAG) == 0) {
+            int status = loadElf(fileName, file.data, file.length);
+            forgetLastPage();
+            return status;
         }
+        entryPoint = 0;
+        loadImage(0, file.data, file.length);
+        forgetLastPage();
         return SUCCESS;
     } else {
         std::cerr << LOG_ERROR << "Unable to open memory file " << fileName << std::endl;
@@ -123,6 +356,355 @@ int MemoryStore::loadFromFile(const char *fileName) {
     }
 }
 
+void MemoryStore::zeroRange(uint64_t relativeAddr, uint64_t length) {
+    forgetLastPage();
+    for (uint64_t done = 0; done < length;) {
+        uint64_t addr = relativeAddr + done;
+        uint64_t offset = addr & (MEMORY_PAGE_SIZE - 1);
+        uint64_t chunk = std::min<uint64_t>(MEMORY_PAGE_SIZE - offset, length - done);
+        auto page = pages.find(addr >> MEMORY_PAGE_BITS);
+        if (page != pages.end()) {
+            if (chunk == MEMORY_PAGE_SIZE) {
+                pages.erase(page);  // missing pages read as zero
+            } else {
+                memset(writePage(addr >> MEMORY_PAGE_BITS) + offset, 0, chunk);
+            }
+        }
+        done += chunk;
+    }
+    forgetLastPage();
+}
+
+static int elfError(const char *fileName, const char *what) {
+    std::cerr << LOG_ERROR << fileName << ": " << what << std::endl;
+    return ERROR;
+}
+
+// name of an ELF section from the section name string table
+static std::string sectionName(const uint8_t *data, uint64_t length, const Elf64_Shdr &names,
+                               const Elf64_Shdr &section) {
+    if (section.sh_name >= names.sh_size || names.sh_offset > length ||
+        length - names.sh_offset < names.sh_size) {
+        return "";
+    }
+    const char *start = reinterpret_cast<const char *>(data + names.sh_offset + section.sh_name);
+    return std::string(start, strnlen(start, names.sh_size - section.sh_name));
+}
+
+int MemoryStore::loadElf(const char *fileName, const uint8_t *data, uint64_t length) {
+    Elf64_Ehdr header;
+    if (length < sizeof(header)) return elfError(fileName, "truncated ELF header");
+    memcpy(&header, data, sizeof(header));
+    if (header.e_ident[EI_CLASS] != ELFCLASS64 || header.e_ident[EI_DATA] != ELFDATA2LSB ||
+        header.e_machine != EM_RISCV) {
+        return elfError(fileName, "not a 64-bit little-endian RISC-V ELF file");
+    }
+    if (header.e_type == ET_REL) return loadElfSections(fileName, data, length);
+    if (header.e_type != ET_EXEC && header.e_type != ET_DYN) {
+        return elfError(fileName, "ELF file is neither an executable nor an object file");
+    }
+    if (header.e_phentsize != sizeof(Elf64_Phdr) || header.e_phoff > length ||
+        (length - header.e_phoff) / sizeof(Elf64_Phdr) < header.e_phnum) {
+        return elfError(fileName, "truncated ELF program headers");
+    }
+
+    // The whole file mapped privately writable, so that segment pages can alias it
+    // copy-on-write (see loadSegment); without it everything is copied.
+    std::shared_ptr<uint8_t> mapping;
+    int fd = open(fileName, O_RDONLY);
+    void *map = fd < 0 ? MAP_FAILED :
+                         mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map != MAP_FAILED) {
+        mapping.reset(static_cast<uint8_t *>(map),
+                      [length](uint8_t *bytes) { munmap(bytes, length); });
+    }
+
+    for (uint64_t i = 0; i < header.e_phnum; i++) {
+        Elf64_Phdr segment;
+        memcpy(&segment, data + header.e_phoff + i * sizeof(segment), sizeof(segment));
+        if (segment.p_type != PT_LOAD) continue;
+        if (segment.p_offset > length || length - segment.p_offset < segment.p_filesz ||
+            segment.p_filesz > segment.p_memsz) {
+            return elfError(fileName, "ELF segment outside the file");
+        }
+        if (loadSegment(segment.p_vaddr, segment.p_offset, segment.p_filesz, segment.p_memsz,
+                        data, mapping)) {
+            return ERROR;
+        }
+    }
+    entryPoint = header.e_entry;
+    return SUCCESS;
+}
+
+int MemoryStore::loadSegment(uint64_t address, uint64_t fileOffset, uint64_t fileSize,
+                             uint64_t segmentSize, const uint8_t *data,
+                             const std::shared_ptr<uint8_t> &mapping) {
+    uint64_t relativeAddr = address - startAddr;
+    if (!inBounds(relativeAddr, segmentSize)) {
+        std::cerr << LOG_ERROR << "Access violation at address 0x" << std::hex << address
+                  << std::endl;
+        return ERROR;
+    }
+
+    // Whole pages of file data whose file offset matches their place in memory alias
+    // a private writable mapping of the file: nothing is copied, and a page is only
+    // duplicated when it is written. The partial pages at either end are copied.
+    uint64_t first = (relativeAddr + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+    uint64_t last = (relativeAddr + fileSize) & ~(MEMORY_PAGE_SIZE - 1);
+    bool aliasable = mapping && first < last &&
+                     ((relativeAddr - fileOffset) & (MEMORY_PAGE_SIZE - 1)) == 0;
+
+    if (!aliasable) {
+        loadImage(address, data + fileOffset, fileSize);
+    } else {
+        uint64_t fileFirst = fileOffset + (first - relativeAddr);
+        loadImage(address, data + fileOffset, first - relativeAddr);
+        for (uint64_t page = first; page < last; page += MEMORY_PAGE_SIZE) {
+            uint8_t *bytes = mapping.get() + fileFirst + (page - first);
+            pages[page >> MEMORY_PAGE_BITS] =
+                std::shared_ptr<MemoryPage>(mapping, reinterpret_cast<MemoryPage *>(bytes));
+        }
+        forgetLastPage();
+        loadImage(startAddr + last, data + fileFirst + (last - first),
+                  relativeAddr + fileSize - last);
+    }
+    zeroRange(relativeAddr + fileSize, segmentSize - fileSize);  // bss
+    return SUCCESS;
+}
+
+// the instruction word insn with the immediate of its format replaced by value
+static uint32_t withImmI(uint32_t insn, uint64_t value) {
+    return (insn & 0x000fffff) | (uint32_t)(value & 0xfff) << 20;
+}
+
+static uint32_t withImmS(uint32_t insn, uint64_t value) {
+    return (insn & 0x01fff07f) | (uint32_t)((value >> 5) & 0x7f) << 25 |
+           (uint32_t)(value & 0x1f) << 7;
+}
+
+static uint32_t withImmB(uint32_t insn, uint64_t value) {
+    return (insn & 0x01fff07f) | (uint32_t)((value >> 12) & 1) << 31 |
+           (uint32_t)((value >> 5) & 0x3f) << 25 | (uint32_t)((value >> 1) & 0xf) << 8 |
+           (uint32_t)((value >> 11) & 1) << 7;
+}
+
+static uint32_t withImmJ(uint32_t insn, uint64_t value) {
+    return (insn & 0xfff) | (uint32_t)((value >> 20) & 1) << 31 |
+           (uint32_t)((value >> 1) & 0x3ff) << 21 | (uint32_t)((value >> 11) & 1) << 20 |
+           (uint32_t)((value >> 12) & 0xff) << 12;
+}
+
+// the upper 20 bits of value, rounded for the sign-extended lower 12 bits that follow
+static uint32_t withImmU(uint32_t insn, uint64_t value) {
+    return (insn & 0xfff) | (uint32_t)((value + 0x800) & 0xfffff000);
+}
+
+// replace the immediate of the instruction word at address by value, as withImm does
+static int patchWord(MemoryStore &memory, uint64_t address,
+                     uint32_t (*withImm)(uint32_t, uint64_t), uint64_t value) {
+    uint64_t insn = 0;
+    int status = memory.getMemValue<WORD_SIZE>(address, insn);
+    return status ? status : memory.setMemValue<WORD_SIZE>(address, withImm(insn, value));
+}
+
+// whether value fits a signed immediate of bits bits
+static bool fitsSigned(uint64_t value, int bits) {
+    int64_t signedValue = static_cast<int64_t>(value);
+    int64_t limit = INT64_C(1) << (bits - 1);
+    return signedValue >= -limit && signedValue < limit;
+}
+
+// Apply the RISC-V relocations of the allocated sections of a relocatable ELF file,
+// laid out at sectionAddress. Only what a single object needs is supported: absolute
+// and PC-relative references to its own symbols, branches, jumps and calls. Anything
+// else (undefined symbols, GOT/TLS, compressed instructions) makes the file fail to
+// load rather than run with unpatched instructions.
+static int applyRelocations(MemoryStore &memory, const char *fileName, const uint8_t *data,
+                            uint64_t length, const std::vector<Elf64_Shdr> &sections,
+                            const std::vector<uint64_t> &sectionAddress) {
+    for (const Elf64_Shdr &section : sections) {
+        if (section.sh_type != SHT_REL && section.sh_type != SHT_RELA) continue;
+        // relocations of debug information, or of a section left out as it is empty
+        if (section.sh_info >= sections.size() || sectionAddress[section.sh_info] == UINT64_MAX ||
+            section.sh_size == 0) {
+            continue;
+        }
+        if (section.sh_type == SHT_REL) {
+            return elfError(fileName, "REL relocations are not supported, only RELA");
+        }
+        if (section.sh_link >= sections.size() || section.sh_entsize != sizeof(Elf64_Rela) ||
+            section.sh_offset > length || length - section.sh_offset < section.sh_size) {
+            return elfError(fileName, "ELF relocation section outside the file");
+        }
+        const Elf64_Shdr &symbols = sections[section.sh_link];
+        if (symbols.sh_offset > length || length - symbols.sh_offset < symbols.sh_size) {
+            return elfError(fileName, "ELF symbol table outside the file");
+        }
+        uint64_t base = sectionAddress[section.sh_info];
+        uint64_t count = section.sh_size / sizeof(Elf64_Rela);
+        std::vector<Elf64_Rela> relocations(count);
+        memcpy(relocations.data(), data + section.sh_offset, count * sizeof(Elf64_Rela));
+
+        // S + A of every relocation, and the PC-relative value of each PCREL_HI20 by
+        // the address of its auipc, which the PCREL_LO12 relocations refer to
+        std::vector<uint64_t> values(count);
+        std::unordered_map<uint64_t, uint64_t> pcrelHi;
+        for (uint64_t i = 0; i < count; i++) {
+            const Elf64_Rela &rela = relocations[i];
+            uint64_t type = ELF64_R_TYPE(rela.r_info);
+            if (type == R_RISCV_RELAX || type == R_RISCV_ALIGN || type == R_RISCV_NONE) continue;
+            uint64_t index = ELF64_R_SYM(rela.r_info);
+            if (index >= symbols.sh_size / sizeof(Elf64_Sym)) {
+                return elfError(fileName, "ELF relocation of a missing symbol");
+            }
+            Elf64_Sym symbol;
+            memcpy(&symbol, data + symbols.sh_offset + index * sizeof(symbol), sizeof(symbol));
+            uint64_t value = symbol.st_value;
+            if (symbol.st_shndx == SHN_UNDEF) {
+                return elfError(fileName, "ELF relocation of an undefined symbol");
+            } else if (symbol.st_shndx != SHN_ABS) {
+                if (symbol.st_shndx >= sections.size() ||
+                    sectionAddress[symbol.st_shndx] == UINT64_MAX) {
+                    return elfError(fileName, "ELF relocation of a symbol outside the memory");
+                }
+                value += sectionAddress[symbol.st_shndx];
+            }
+            values[i] = value + rela.r_addend;
+            if (type == R_RISCV_PCREL_HI20) {
+                pcrelHi[base + rela.r_offset] = values[i] - (base + rela.r_offset);
+            }
+        }
+
+        for (uint64_t i = 0; i < count; i++) {
+            const Elf64_Rela &rela = relocations[i];
+            uint64_t type = ELF64_R_TYPE(rela.r_info);
+            uint64_t address = base + rela.r_offset;
+            uint64_t value = values[i];
+            uint64_t pcrel = value - address;
+            int status = 0;
+            switch (type) {
+                case R_RISCV_NONE:
+                case R_RISCV_RELAX:
+                case R_RISCV_ALIGN:
+                    // nothing is relaxed, the padding nops stay
+                    break;
+                case R_RISCV_32:
+                    status = memory.setMemValue<WORD_SIZE>(address, value);
+                    break;
+                case R_RISCV_64:
+                    status = memory.setMemValue<DOUBLE_SIZE>(address, value);
+                    break;
+                case R_RISCV_ADD32:
+                case R_RISCV_SUB32:
+                case R_RISCV_ADD64:
+                case R_RISCV_SUB64: {
+                    bool word = type == R_RISCV_ADD32 || type == R_RISCV_SUB32;
+                    bool add = type == R_RISCV_ADD32 || type == R_RISCV_ADD64;
+                    MemEntrySize size = word ? WORD_SIZE : DOUBLE_SIZE;
+                    uint64_t old = 0;
+                    status = memory.getMemValue(address, old, size);
+                    if (!status) {
+                        status = memory.setMemValue(address, add ? old + value : old - value, size);
+                    }
+                    break;
+                }
+                case R_RISCV_BRANCH:
+                    if (!fitsSigned(pcrel, 13)) return elfError(fileName, "branch out of range");
+                    status = patchWord(memory, address, withImmB, pcrel);
+                    break;
+                case R_RISCV_JAL:
+                    if (!fitsSigned(pcrel, 21)) return elfError(fileName, "jump out of range");
+                    status = patchWord(memory, address, withImmJ, pcrel);
+                    break;
+                case R_RISCV_CALL:
+                case R_RISCV_CALL_PLT:
+                    // an auipc and the jalr behind it
+                    if (!fitsSigned(pcrel, 32)) return elfError(fileName, "call out of range");
+                    status = patchWord(memory, address, withImmU, pcrel);
+                    if (!status) status = patchWord(memory, address + 4, withImmI, pcrel);
+                    break;
+                case R_RISCV_PCREL_HI20:
+                    if (!fitsSigned(pcrel, 32)) return elfError(fileName, "address out of range");
+                    status = patchWord(memory, address, withImmU, pcrel);
+                    break;
+                case R_RISCV_PCREL_LO12_I:
+                case R_RISCV_PCREL_LO12_S: {
+                    // the symbol is the auipc, the value the one of its PCREL_HI20
+                    auto hi = pcrelHi.find(value);
+                    if (hi == pcrelHi.end()) {
+                        return elfError(fileName, "PCREL_LO12 relocation without its PCREL_HI20");
+                    }
+                    status = patchWord(memory, address,
+                                       type == R_RISCV_PCREL_LO12_S ? withImmS : withImmI,
+                                       hi->second);
+                    break;
+                }
+                case R_RISCV_HI20:
+                    if (!fitsSigned(value, 32)) return elfError(fileName, "address out of range");
+                    status = patchWord(memory, address, withImmU, value);
+                    break;
+                case R_RISCV_LO12_I:
+                case R_RISCV_LO12_S:
+                    status = patchWord(memory, address,
+                                       type == R_RISCV_LO12_S ? withImmS : withImmI, value);
+                    break;
+                default:
+                    std::cerr << LOG_ERROR << fileName << ": unsupported RISC-V relocation type "
+                              << type << std::endl;
+                    return ERROR;
+            }
+            if (status) return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+int MemoryStore::loadElfSections(const char *fileName, const uint8_t *data, uint64_t length) {
+    Elf64_Ehdr header;
+    memcpy(&header, data, sizeof(header));
+    if (header.e_shentsize != sizeof(Elf64_Shdr) || header.e_shoff > length ||
+        (length - header.e_shoff) / sizeof(Elf64_Shdr) < header.e_shnum ||
+        header.e_shstrndx >= header.e_shnum) {
+        return elfError(fileName, "truncated ELF section headers");
+    }
+    std::vector<Elf64_Shdr> sections(header.e_shnum);
+    memcpy(sections.data(), data + header.e_shoff, header.e_shnum * sizeof(Elf64_Shdr));
+    const Elf64_Shdr &names = sections[header.e_shstrndx];
+
+    // .text first, so that the code starts at address 0 like the objcopy'd binary
+    std::vector<const Elf64_Shdr *> order;
+    std::vector<uint64_t> sectionAddress(sections.size(), UINT64_MAX);
+    for (const Elf64_Shdr &section : sections) {
+        if (!(section.sh_flags & SHF_ALLOC) || section.sh_size == 0) continue;
+        if (sectionName(data, length, names, section) == ".text") {
+            order.insert(order.begin(), &section);
+        } else {
+            order.push_back(&section);
+        }
+    }
+
+    uint64_t address = startAddr;
+    for (const Elf64_Shdr *section : order) {
+        uint64_t align = section->sh_addralign > 1 ? section->sh_addralign : 1;
+        address = (address + align - 1) / align * align;
+        sectionAddress[section - sections.data()] = address;
+        if (section->sh_type != SHT_NOBITS) {
+            if (section->sh_offset > length || length - section->sh_offset < section->sh_size) {
+                return elfError(fileName, "ELF section outside the file");
+            }
+            if (loadImage(address, data + section->sh_offset, section->sh_size)) return ERROR;
+        } else if (!inBounds(address - startAddr, section->sh_size)) {
+            return elfError(fileName, "ELF section outside the memory");
+        } else {
+            zeroRange(address - startAddr, section->sh_size);
+        }
+        address += section->sh_size;
+    }
+    entryPoint = 0;
+    return applyRelocations(*this, fileName, data, length, sections, sectionAddress);
+}
+
 int MemoryStore::printMemArray(uint64_t startAddr, uint64_t endAddr, uint64_t entrySize,
                                uint64_t entriesPerRow, std::ostream &out_stream) {
     // Validate the entry size
@@ -149,7 +731,7 @@ int MemoryStore::printMemArray(uint64_t startAddr, uint64_t endAddr, uint64_t en
                     out_stream << "0x";
                     for (int j = 0; j < (int)(entrySize); j++) {
                         out_stream << std::hex << std::setfill('0') << std::setw(BYTE_WIDTH)
-                                   << (uint64_t)(memArr.at(relStart + j));
+                                   << (uint64_t)(byteAt(relStart + j));
                     }
                     relStart += entrySize;
                     out_stream << " ";
@@ -174,6 +756,43 @@ int MemoryStore::printMemory(uint64_t startAddr, uint64_t endAddress) {
     return printMemArray(startAddr, endAddress, WORD_SIZE, 5, std::cout);
 }
 
+// Bytes from address 0 the PT_LOAD segments of an ELF executable need, at least
+// MEMORY_SIZE; 0 if fileName is no ELF executable
+static uint64_t executableMemorySize(const char *fileName) {
+    MappedFile file(fileName);
+    Elf64_Ehdr header;
+    if (file.length < sizeof(header) || memcmp(file.data, ELFMAG, SELFMAG) != 0) return 0;
+    memcpy(&header, file.data, sizeof(header));
+    if (header.e_type != ET_EXEC && header.e_type != ET_DYN) return 0;
+    if (header.e_phentsize != sizeof(Elf64_Phdr) || header.e_phoff > file.length ||
+        (file.length - header.e_phoff) / sizeof(Elf64_Phdr) < header.e_phnum) {
+        return MEMORY_SIZE;  // loadElf reports it
+    }
+
+    uint64_t size = MEMORY_SIZE;
+    for (uint64_t i = 0; i < header.e_phnum; i++) {
+        Elf64_Phdr segment;
+        memcpy(&segment, file.data + header.e_phoff + i * sizeof(segment), sizeof(segment));
+        if (segment.p_type != PT_LOAD || segment.p_vaddr > UINT64_MAX - segment.p_memsz) {
+            continue;
+        }
+        uint64_t end = segment.p_vaddr + segment.p_memsz;
+        // whole pages, unless that overflows
+        if (end <= UINT64_MAX - (MEMORY_PAGE_SIZE - 1)) {
+            end = (end + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+        }
+        size = std::max(size, end);
+    }
+    return size;
+}
+
+MemoryStore *createMemoryStore(const char *fileName) {
+    uint64_t size = executableMemorySize(fileName);
+    std::unique_ptr<MemoryStore> memory(new MemoryStore(0, size ? size : MEMORY_SIZE));
+    if (memory->loadFromFile(fileName) != SUCCESS) return nullptr;
+    return memory.release();
+}
+
 void dumpMemoryState(MemoryStore *mem, const std::string &base_output_name) {
     uint64_t startAddr;
     uint64_t endAddr;
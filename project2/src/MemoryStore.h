@@ -1,12 +1,30 @@
 #pragma once
 #include <inttypes.h>
 
+#include <cerrno>
+#include <cstring>
+#include <memory>
 #include <string>
-#include <vector>
+#include <unordered_map>
+
+// The fast accessors copy values straight out of the pages
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "MemoryStore assumes a little-endian host"
+#endif
 
 // The memory is 64 KB large.
 #define MEMORY_SIZE 0x10000
 
+// Memory is allocated in pages of 4 KB as it is first written.
+#define MEMORY_PAGE_BITS 12
+#define MEMORY_PAGE_SIZE (1ULL << MEMORY_PAGE_BITS)
+
+// A binary init_mem_image starts with this magic, followed by segments of a
+// little-endian 64-bit address, a 64-bit byte count and that many bytes.
+// Any other init_mem_image is read as text: hex address/word pairs.
+#define MEM_IMAGE_MAGIC "RVIMG001"
+#define MEM_IMAGE_MAGIC_SIZE 8
+
 #define BYTE_SHIFT 8
 #define BYTE_WIDTH 2
 #define WORD_WIDTH 8
@@ -14,31 +32,179 @@
 // The various sizes at which you can manipulate the memory.
 enum MemEntrySize { BYTE_SIZE = 1, HALF_SIZE = 2, WORD_SIZE = 4, DOUBLE_SIZE = 8 };
 
+class CheckpointReader;
+class CheckpointWriter;
+
+struct MemoryPage {
+    uint8_t bytes[MEMORY_PAGE_SIZE];
+};
+
 // A memory abstraction interface. Allows values to be set and retrieved at a number of
 // different size granularities. The implementation is also capable of printing out memory
 // values over a given address range.
+//
+// The numEntries bytes from startAddr are backed by a sparse page table: a page is
+// taken from a process-wide pool the first time it is written, untouched pages read
+// as zero. Copies of a store share its pages copy-on-write, so the copies of one
+// program image (even in different threads) only pay for the pages they modify.
 class MemoryStore {
    private:
     uint64_t startAddr;
-    std::vector<uint8_t> memArr;
+    uint64_t memSize;
+    std::unordered_map<uint64_t, std::shared_ptr<MemoryPage>> pages;
+    uint64_t entryPoint;
+
+    // The page of the last slow-path access, valid pages lie fully inside the memory.
+    // Writable means the page is not shared with a copy of the store.
+    mutable uint64_t lastPageNumber;
+    mutable uint8_t* lastPage;
+    mutable bool lastPageWritable;
+
+    // true if the size bytes at relativeAddr are all inside the memory
+    bool inBounds(uint64_t relativeAddr, uint64_t size) const {
+        return relativeAddr < memSize && memSize - relativeAddr >= size;
+    }
+
+    // bytes of a page, to read (zeros for a missing page) or made private to write
+    uint8_t* readPage(uint64_t pageNumber);
+    uint8_t* writePage(uint64_t pageNumber);
+    void rememberPage(uint64_t pageNumber, uint8_t* bytes, bool writable) {
+        // pages that are only partly inside the memory always take the slow path
+        if (pageNumber >= memSize / MEMORY_PAGE_SIZE) return;
+        lastPageNumber = pageNumber;
+        lastPage = bytes;
+        lastPageWritable = writable;
+    }
+    void forgetLastPage() const {
+        lastPageNumber = UINT64_MAX;
+        lastPage = nullptr;
+        lastPageWritable = false;
+    }
+
+    // ELF loading, see loadFromFile
+    int loadElf(const char* fileName, const uint8_t* data, uint64_t length);
+    int loadElfSections(const char* fileName, const uint8_t* data, uint64_t length);
+    int loadSegment(uint64_t address, uint64_t fileOffset, uint64_t fileSize,
+                    uint64_t segmentSize, const uint8_t* data,
+                    const std::shared_ptr<uint8_t>& mapping);
+    // make length bytes at relativeAddr zero, dropping the pages that become all zero
+    void zeroRange(uint64_t relativeAddr, uint64_t length);
 
-    int getOrSetValue(bool get, uint64_t address, uint64_t& value, MemEntrySize size);
+    // byte at relativeAddr, throws std::out_of_range outside the memory
+    uint8_t byteAt(uint64_t relativeAddr);
+
+    // slow paths: an access that is (partly) out of bounds reads/writes the bytes in
+    // front of the violation and reports it, an invalid size only reports
+    int getSlow(uint64_t address, uint64_t& value, uint64_t byteSize);
+    int setSlow(uint64_t address, uint64_t value, uint64_t byteSize);
+    int partialAccess(bool get, uint64_t address, uint64_t& value, uint64_t byteSize);
+    int invalidSize();
 
    public:
     MemoryStore(uint64_t startAddr, uint64_t numEntries);
     MemoryStore(uint64_t startAddr, uint64_t numEntries, const char* fileName);
+    // Copies share all pages with other. Copying a store from several threads at
+    // once is safe as long as none of them accesses the store itself meanwhile.
+    MemoryStore(const MemoryStore& other);
+    MemoryStore& operator=(const MemoryStore& other);
     ~MemoryStore(){};
 
+    // true if the size bytes at address are all inside the memory
+    bool contains(uint64_t address, uint64_t size) const {
+        return inBounds(address - startAddr, size);
+    }
+
+    // number of pages allocated (or shared) by this store
+    size_t residentPages() const { return pages.size(); }
+
+    // Checkpoint section: the layout and entry point, then the non-zero pages in
+    // address order. Restoring replaces all contents and fails (-EINVAL) if the
+    // checkpoint was taken of a memory with another layout or is truncated.
+    void saveState(CheckpointWriter& out) const;
+    int restoreState(CheckpointReader& in);
+
+    // Load a program. A raw binary is copied to address 0. An ELF executable has each
+    // PT_LOAD segment placed at its virtual address (file-backed pages are mapped
+    // copy-on-write instead of copied where the layout allows) and its bss zeroed; a
+    // relocatable ELF (assembler output) gets its allocated sections laid out from
+    // address 0, .text first, and its RISC-V relocations applied.
+    // Returns ERROR if the file cannot be read or loaded.
     int loadFromFile(const char* fileName);
-    int getMemValue(uint64_t address, uint64_t& value, MemEntrySize size);
-    int setMemValue(uint64_t address, uint64_t value, MemEntrySize size);
+    // where execution starts: the ELF entry point, 0 for raw binaries
+    uint64_t getEntryPoint() const { return entryPoint; }
+    // copy length bytes to address in one operation; on an access violation the
+    // bytes in front of it are still copied
+    int loadImage(uint64_t address, const uint8_t* data, uint64_t length);
+
+    // Size-specialized little-endian accessors. An access to the last page used is a
+    // single unaligned copy, everything else (other pages, accesses crossing a page,
+    // bounds violations) takes the slow path. Return 0, or -EINVAL after printing the
+    // access violation.
+    template <MemEntrySize size>
+    int getMemValue(uint64_t address, uint64_t& value) {
+        uint64_t relativeAddr = address - startAddr;
+        uint64_t offset = relativeAddr & (MEMORY_PAGE_SIZE - 1);
+        if ((relativeAddr >> MEMORY_PAGE_BITS) != lastPageNumber ||
+            offset > MEMORY_PAGE_SIZE - size) {
+            return getSlow(address, value, size);
+        }
+        value = 0;
+        memcpy(&value, lastPage + offset, size);
+        return 0;
+    }
+
+    template <MemEntrySize size>
+    int setMemValue(uint64_t address, uint64_t value) {
+        uint64_t relativeAddr = address - startAddr;
+        uint64_t offset = relativeAddr & (MEMORY_PAGE_SIZE - 1);
+        if ((relativeAddr >> MEMORY_PAGE_BITS) != lastPageNumber || !lastPageWritable ||
+            offset > MEMORY_PAGE_SIZE - size) {
+            return setSlow(address, value, size);
+        }
+        memcpy(lastPage + offset, &value, size);
+        return 0;
+    }
+
+    int getMemValue(uint64_t address, uint64_t& value, MemEntrySize size) {
+        switch (size) {
+            case BYTE_SIZE:
+                return getMemValue<BYTE_SIZE>(address, value);
+            case HALF_SIZE:
+                return getMemValue<HALF_SIZE>(address, value);
+            case WORD_SIZE:
+                return getMemValue<WORD_SIZE>(address, value);
+            case DOUBLE_SIZE:
+                return getMemValue<DOUBLE_SIZE>(address, value);
+            default:
+                return invalidSize();
+        }
+    }
+
+    int setMemValue(uint64_t address, uint64_t value, MemEntrySize size) {
+        switch (size) {
+            case BYTE_SIZE:
+                return setMemValue<BYTE_SIZE>(address, value);
+            case HALF_SIZE:
+                return setMemValue<HALF_SIZE>(address, value);
+            case WORD_SIZE:
+                return setMemValue<WORD_SIZE>(address, value);
+            case DOUBLE_SIZE:
+                return setMemValue<DOUBLE_SIZE>(address, value);
+            default:
+                return invalidSize();
+        }
+    }
+
     int printMemory(uint64_t startAddress, uint64_t endAddress);
     int printMemArray(uint64_t startAddr, uint64_t endAddr, uint64_t entrySize,
                       uint64_t entriesPerRow, std::ostream& out_stream);
 };
 
-// Creates a memory store.
-// extern MemoryStore *createMemoryStore();
+// Creates the memory store of a program file, nullptr if it cannot be loaded. Raw
+// binaries and relocatable ELF files get the MEMORY_SIZE memory at address 0, linked
+// ELF executables one from address 0 up to the end of their highest segment (and at
+// least MEMORY_SIZE large).
+MemoryStore* createMemoryStore(const char* fileName);
 
 // Dumps the section of memory relevant for the test.
 void dumpMemoryState(MemoryStore* mem, const std::string& base_output_name);
@@ -0,0 +1,96 @@
+#include "MissHandler.h"
+
+#include <algorithm>
+
+MissHandler::MissHandler(uint64_t mshrCount, uint64_t storeBufferEntries, const Cache& cache)
+    : mshrs(mshrCount, MSHR{UINT64_MAX, 0}),
+      storeBuffer(storeBufferEntries, 0),
+      blockOffsetBits(cache.blockOffsetBits) {}
+
+MissHandler::Outcome MissHandler::access(uint64_t address, bool hit, bool write, uint64_t cycle,
+                                         uint64_t latency) {
+    Outcome outcome = {0, cycle, false, false, false, false};
+    uint64_t block = address >> blockOffsetBits;
+
+    // a store waits for the oldest entry to drain if none is free
+    std::vector<uint64_t>::iterator entry = storeBuffer.end();
+    if (write) {
+        entry = std::min_element(storeBuffer.begin(), storeBuffer.end());
+        if (*entry >= cycle) {
+            outcome.stall = *entry + 1 - cycle;
+            outcome.storeBufferFull = true;
+        }
+    }
+    uint64_t start = cycle + outcome.stall;
+
+    // the fill of the block may be outstanding already (the cache has the line
+    // then, or evicted it again), otherwise a miss takes the first MSHR that frees
+    MSHR* pending = nullptr;
+    MSHR* first = &mshrs[0];
+    uint64_t busy = 0;
+    for (MSHR& mshr : mshrs) {
+        if (mshr.done >= start) {
+            busy++;
+            if (mshr.block == block) pending = &mshr;
+        }
+        if (mshr.done < first->done) first = &mshr;
+    }
+
+    uint64_t done = start;
+    if (pending) {
+        outcome.merged = true;
+        done = pending->done;
+    } else if (!hit) {
+        outcome.overlapped = busy > 0;
+        uint64_t issue = std::max(start, first->done + 1);
+        // a store issues its fill from the store buffer, a load waits in MEM for it
+        if (!write && issue > start) {
+            outcome.stall = issue - cycle;
+            outcome.mshrsFull = true;
+        }
+        first->block = block;
+        first->done = issue + latency;
+        done = first->done;
+    }
+
+    if (write) {
+        *entry = done;
+    } else {
+        outcome.ready = done;
+    }
+    return outcome;
+}
+
+void MissHandler::saveState(CheckpointWriter& out) const {
+    out.put(mshrs.size());
+    out.put(storeBuffer.size());
+    out.put(blockOffsetBits);
+    for (const MSHR& mshr : mshrs) {
+        out.put(mshr.block);
+        out.put(mshr.done);
+    }
+    for (uint64_t done : storeBuffer) out.put(done);
+}
+
+bool MissHandler::restoreState(CheckpointReader& in) {
+    uint64_t mshrCount = in.get();
+    uint64_t entries = in.get();
+    uint64_t offsetBits = in.get();
+
+    // read the whole section even if it is not used, the next one follows it
+    std::vector<MSHR> savedMshrs;
+    for (uint64_t i = 0; i < mshrCount && !in.hasFailed(); i++) {
+        uint64_t block = in.get();
+        savedMshrs.push_back(MSHR{block, in.get()});
+    }
+    std::vector<uint64_t> savedBuffer;
+    for (uint64_t i = 0; i < entries && !in.hasFailed(); i++) savedBuffer.push_back(in.get());
+
+    if (mshrCount != mshrs.size() || entries != storeBuffer.size() ||
+        offsetBits != blockOffsetBits || in.hasFailed()) {
+        return false;
+    }
+    mshrs.swap(savedMshrs);
+    storeBuffer.swap(savedBuffer);
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <inttypes.h>
+
+#include <vector>
+
+#include "Checkpoint.h"
+#include "cache.h"
+
+// Timing of a non-blocking D-cache: miss status holding registers (MSHRs) track the
+// outstanding block fills, a store buffer takes the stores off the pipeline. The
+// cache itself is still accessed (and filled) when the load or store is in MEM,
+// this only decides when its data is there and how long MEM has to wait.
+class MissHandler {
+   public:
+    struct Outcome {
+        uint64_t stall;        // cycles MEM waits for a free MSHR or store buffer entry
+        uint64_t ready;        // last cycle the data of a load is outstanding
+        bool merged;           // the block already had a miss outstanding
+        bool overlapped;       // a new miss while another one is outstanding
+        bool mshrsFull;        // stall from a load missing with all MSHRs busy
+        bool storeBufferFull;  // stall from a store with all entries busy
+    };
+
+   private:
+    // busy up to (and including) cycle done
+    struct MSHR {
+        uint64_t block;
+        uint64_t done;
+    };
+
+    std::vector<MSHR> mshrs;
+    std::vector<uint64_t> storeBuffer;  // entry done cycles
+    uint64_t blockOffsetBits;
+
+   public:
+    // mshrs and storeBufferEntries at least 1, for the geometry of cache
+    MissHandler(uint64_t mshrs, uint64_t storeBufferEntries, const Cache& cache);
+
+    // the load or store of address in MEM at cycle; hit as the cache answered it, a
+    // miss takes latency cycles once issued
+    Outcome access(uint64_t address, bool hit, bool write, uint64_t cycle, uint64_t latency);
+
+    // Checkpoint section, as Cache: a handler of another configuration is left as it
+    // is and restoreState returns false
+    void saveState(CheckpointWriter& out) const;
+    bool restoreState(CheckpointReader& in);
+};
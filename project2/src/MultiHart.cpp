@@ -0,0 +1,117 @@
+#include "MultiHart.h"
+
+#include <iostream>
+
+// the argument registers a hart starts with
+#define REG_A0 10
+#define REG_A1 11
+
+Status MultiHart::init(CacheConfig& iCacheConfig, CacheConfig& dCacheConfig, MemoryStore* memory,
+                       const std::string& output_name, const CycleOptions& options) {
+    if (options.harts == 0 || options.harts > 64) {
+        std::cerr << LOG_ERROR << "The number of harts must be 1 to 64" << std::endl;
+        return ERROR;
+    }
+    if (options.fastForward > 0 || !options.loadCheckpoint.empty() ||
+        !options.saveCheckpoint.empty() || !options.memTrace.empty()) {
+        std::cerr << LOG_ERROR
+                  << "Harts do not combine with a fast-forward, checkpoints or a memory trace"
+                  << std::endl;
+        return ERROR;
+    }
+    harts.clear();
+    logs.assign(options.harts, std::vector<SharedAccess>());
+    directory.clear();
+    statuses.assign(options.harts, SUCCESS);
+    blockOffsetBits = log2Int(dCacheConfig.blockSize);
+
+    for (uint64_t i = 0; i < options.harts; i++) {
+        harts.emplace_back(new CycleSimulator());
+        CycleSimulator& hart = *harts.back();
+        std::string hartName = output_name + "_hart" + std::to_string(i);
+        if (hart.init(iCacheConfig, dCacheConfig, memory, hartName, options) != SUCCESS) {
+            return ERROR;
+        }
+        hart.simulator->setRegister(REG_A0, i);
+        hart.simulator->setRegister(REG_A1, options.harts);
+        hart.sharedLog = &logs[i];
+    }
+    return SUCCESS;
+}
+
+// The D-cache of hart loses its copy of the block of address to the store of another
+// hart (write), or keeps it shared for the load of another one; a modified copy is
+// written back first.
+void MultiHart::snoop(CycleSimulator& hart, uint64_t address, bool write) {
+    Cache& dCache = *hart.dCache;
+    if (!dCache.contains(address)) return;
+    bool dirty = write ? dCache.invalidate(address) : dCache.clean(address);
+    hart.stats.add(write ? STAT_COHERENCE_INVALIDATIONS : STAT_COHERENCE_DOWNGRADES);
+    if (dirty) {
+        hart.stats.add(STAT_COHERENCE_WRITE_BACKS);
+        hart.writePenalty(dCache, dCache.getWriteBackAddress(), dCache.config.blockSize);
+    }
+}
+
+// Right after hart ran a cycle, before the next hart runs it: the stores and load
+// misses of the cycle go through the directory, and the stores make the other harts
+// forget what they pre-decoded from the bytes written
+void MultiHart::share(uint64_t hart) {
+    uint64_t self = 1ULL << hart;
+    for (const SharedAccess& access : logs[hart]) {
+        if (access.write) {
+            for (uint64_t other = 0; other < harts.size(); other++) {
+                if (other == hart) continue;
+                harts[other]->simulator->forgetStore(access.address, access.bytes);
+            }
+        }
+        DirectoryEntry& block =
+            directory.emplace(access.address >> blockOffsetBits, DirectoryEntry{0, -1})
+                .first->second;
+        if (access.write) {
+            // M: the other copies go
+            if (block.owner == static_cast<int64_t>(hart)) continue;
+            uint64_t others = block.sharers & ~self;
+            if (others) harts[hart]->stats.add(STAT_COHERENCE_UPGRADES);
+            for (uint64_t other = 0; others != 0; other++, others >>= 1) {
+                if (others & 1) snoop(*harts[other], access.address, true);
+            }
+            block.sharers = self;
+            block.owner = hart;
+        } else {
+            // S: a modified copy of another hart is shared from now on
+            if (block.owner >= 0 && block.owner != static_cast<int64_t>(hart)) {
+                snoop(*harts[block.owner], access.address, false);
+                block.owner = -1;
+            }
+            block.sharers |= self;
+        }
+    }
+    logs[hart].clear();
+}
+
+Status MultiHart::runCycles(uint64_t cycles) {
+    for (uint64_t count = 0; cycles == 0 || count < cycles; count++) {
+        bool running = false;
+        for (uint64_t i = 0; i < harts.size(); i++) {
+            if (statuses[i] != SUCCESS) continue;
+            statuses[i] = harts[i]->runCycles(1);
+            share(i);
+            if (statuses[i] == ERROR) return ERROR;
+            running = running || statuses[i] == SUCCESS;
+        }
+        if (!running) return HALT;
+    }
+    for (Status status : statuses) {
+        if (status == SUCCESS) return SUCCESS;
+    }
+    return HALT;
+}
+
+Status MultiHart::finalize() {
+    Status status = SUCCESS;
+    for (const auto& hart : harts) {
+        if (hart->finalize() != SUCCESS) status = ERROR;
+    }
+    return status;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <inttypes.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryStore.h"
+#include "Utilities.h"
+#include "cache.h"
+#include "cycle.h"
+
+// N harts running one program on one MemoryStore (CycleOptions::harts), each a
+// CycleSimulator of its own with its registers, pipeline, L1 caches (and L2/L3 behind
+// them, private as well). Hart i starts at the entry point with a0 = i and a1 = N.
+//
+// Memory model: the harts run in lock-step, every cycle hart 0 first, then hart 1 and
+// so on, and an instruction reads or writes the shared memory as it enters MEM. A load
+// sees every store of an earlier cycle and those of lower harts in the same cycle,
+// which makes the memory sequentially consistent in (cycle, hart) order. The D-caches
+// are kept coherent at the same points by an MSI directory: a store invalidates the
+// copies of the other harts (Cache::invalidate), a load miss downgrades a modified
+// copy of another hart to shared, and a modified copy is written back through its
+// hart's hierarchy as it loses that state. So the value a load reads is always the
+// one of the block's last writer, which a copy made stale by another hart's store
+// only gives after the miss to get it again. Stores to code make the other harts
+// forget the instructions they pre-decoded from it; their I-caches, and instructions
+// already in their pipelines, are not kept coherent.
+//
+// The cycles and everything else are deterministic. The harts run on the calling
+// thread: the order above needs them in step every cycle, a shared memory that is not
+// thread safe could not do better on host threads (sim_batch runs simulations in
+// parallel instead).
+class MultiHart {
+   private:
+    struct DirectoryEntry {
+        uint64_t sharers;  // bit i: hart i may have a copy
+        int64_t owner;     // the hart with the copy modified, -1 if none has
+    };
+
+    std::vector<std::unique_ptr<CycleSimulator>> harts;
+    std::vector<Status> statuses;
+    // the SharedAccesses of each hart in the cycle it is running
+    std::vector<std::vector<SharedAccess>> logs;
+    std::unordered_map<uint64_t, DirectoryEntry> directory;
+    uint64_t blockOffsetBits;
+
+    void share(uint64_t hart);
+    void snoop(CycleSimulator& hart, uint64_t address, bool write);
+
+   public:
+    // (re)start options.harts harts (at most 64) on memory, which stays owned by the
+    // caller, hart i writing its output files as <output_name>_hart<i>; options as for
+    // CycleSimulator::init, but without a fast-forward, checkpoints or a memory trace
+    Status init(CacheConfig& iCacheConfig, CacheConfig& dCacheConfig, MemoryStore* memory,
+                const std::string& output_name, const CycleOptions& options);
+
+    // run all harts for a certain number of cycles, cycles == 0 runs until all of them
+    // halt; HALT once they have, ERROR if one of them failed
+    Status runCycles(uint64_t cycles);
+
+    // a single runCycles() call with cycles == 0
+    Status runTillHalt() { return runCycles(0); }
+
+    // hart i, for its counters
+    const CycleSimulator& hart(uint64_t i) const { return *harts[i]; }
+
+    // dump the state of every hart, as CycleSimulator::finalize
+    Status finalize();
+};
@@ -0,0 +1,186 @@
+#include "PipeTrace.h"
+
+#include <cstring>
+#include <iostream>
+
+// Records are stored field by field so the file layout does not depend on struct
+// padding; the simulator hosts are little-endian, so no byte swapping is done.
+static void encodeRecord(const PipeTraceRecord& record, char* buf) {
+    memcpy(buf + 0, &record.cycle, 8);
+    memcpy(buf + 8, &record.ifPC, 8);
+    memcpy(buf + 16, &record.idInstr, 4);
+    memcpy(buf + 20, &record.exInstr, 4);
+    memcpy(buf + 24, &record.memInstr, 4);
+    memcpy(buf + 28, &record.wbInstr, 4);
+    memcpy(buf + 32, &record.repeat, 4);
+    buf[36] = record.ifStatus;
+    buf[37] = record.idStatus;
+    buf[38] = record.exStatus;
+    buf[39] = record.memStatus;
+    buf[40] = record.wbStatus;
+    buf[41] = buf[42] = buf[43] = 0;
+}
+
+static void decodeRecord(const char* buf, PipeTraceRecord& record) {
+    memcpy(&record.cycle, buf + 0, 8);
+    memcpy(&record.ifPC, buf + 8, 8);
+    memcpy(&record.idInstr, buf + 16, 4);
+    memcpy(&record.exInstr, buf + 20, 4);
+    memcpy(&record.memInstr, buf + 24, 4);
+    memcpy(&record.wbInstr, buf + 28, 4);
+    memcpy(&record.repeat, buf + 32, 4);
+    record.ifStatus = buf[36];
+    record.idStatus = buf[37];
+    record.exStatus = buf[38];
+    record.memStatus = buf[39];
+    record.wbStatus = buf[40];
+}
+
+// true if both records describe the same pipe contents (cycle/repeat aside)
+static bool sameState(const PipeTraceRecord& a, const PipeTraceRecord& b) {
+    return a.ifPC == b.ifPC && a.idInstr == b.idInstr && a.exInstr == b.exInstr &&
+           a.memInstr == b.memInstr && a.wbInstr == b.wbInstr && a.ifStatus == b.ifStatus &&
+           a.idStatus == b.idStatus && a.exStatus == b.exStatus &&
+           a.memStatus == b.memStatus && a.wbStatus == b.wbStatus;
+}
+
+PipeTrace::PipeTrace()
+    : buffer(PIPE_TRACE_BUFFER_SIZE), defaultFlags(out.flags()), isOpen(false),
+      pending(), hasPending(false) {}
+
+PipeTrace::~PipeTrace() {
+    close();
+}
+
+Status PipeTrace::open(const std::string& base_output_name) {
+    close();
+    if (config.mode == TRACE_OFF) return SUCCESS;
+
+    bool binary = config.format != TRACE_TEXT;
+    auto fileOp = std::ios::out | std::ios::trunc;
+    if (binary) fileOp |= std::ios::binary;
+
+    // the buffer has to be installed before the file is opened to take effect
+    out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    out.open(base_output_name + (binary ? "_pipe_state.trc" : "_pipe_state.out"), fileOp);
+    if (!out) {
+        std::cerr << LOG_ERROR << "Could not open pipe state file!" << std::endl;
+        return ERROR;
+    }
+    if (binary) out.write(PIPE_TRACE_MAGIC, PIPE_TRACE_MAGIC_SIZE);
+
+    defaultFlags = out.flags();
+    hasPending = false;
+    isOpen = true;
+    return SUCCESS;
+}
+
+Status PipeTrace::writeRecord(const PipeTraceRecord& record) {
+    char buf[PIPE_TRACE_RECORD_SIZE];
+    encodeRecord(record, buf);
+    out.write(buf, PIPE_TRACE_RECORD_SIZE);
+    return out ? SUCCESS : ERROR;
+}
+
+Status PipeTrace::write(const PipeState& state) {
+    if (!isOpen) return ERROR;
+
+    if (config.format == TRACE_TEXT) {
+        // printPipeState leaves std::left behind; every line must start from the
+        // default format, like a freshly opened stream
+        out.flags(defaultFlags);
+
+        // '\n' rather than std::endl, the stream only flushes when the buffer fills up
+        printPipeState(state, out);
+        out << '\n';
+        return out ? SUCCESS : ERROR;
+    }
+
+    PipeTraceRecord record;
+    record.cycle = state.cycle;
+    record.ifPC = state.ifPC;
+    record.idInstr = state.idInstr;
+    record.exInstr = state.exInstr;
+    record.memInstr = state.memInstr;
+    record.wbInstr = state.wbInstr;
+    record.repeat = 0;
+    record.ifStatus = state.ifStatus;
+    record.idStatus = state.idStatus;
+    record.exStatus = state.exStatus;
+    record.memStatus = state.memStatus;
+    record.wbStatus = state.wbStatus;
+
+    if (config.format == TRACE_BINARY) return writeRecord(record);
+
+    // run-length encoding: stall cycles with a frozen pipeline extend the pending record
+    if (hasPending && pending.repeat < UINT32_MAX &&
+        record.cycle == pending.cycle + pending.repeat + 1 && sameState(pending, record)) {
+        pending.repeat++;
+        return SUCCESS;
+    }
+    Status status = hasPending ? writeRecord(pending) : SUCCESS;
+    pending = record;
+    hasPending = true;
+    return status;
+}
+
+Status PipeTrace::flush() {
+    if (!isOpen) return ERROR;
+    out.flush();
+    return out ? SUCCESS : ERROR;
+}
+
+void PipeTrace::close() {
+    if (!isOpen) return;
+    if (hasPending) writeRecord(pending);
+    hasPending = false;
+    out.close();
+    isOpen = false;
+}
+
+Status renderPipeTrace(const std::string& traceFile, std::ostream& pipe_out) {
+    std::ifstream in(traceFile, std::ios::in | std::ios::binary);
+    if (!in) {
+        std::cerr << LOG_ERROR << "Could not open pipe trace " << traceFile << std::endl;
+        return ERROR;
+    }
+
+    char magic[PIPE_TRACE_MAGIC_SIZE];
+    if (!in.read(magic, PIPE_TRACE_MAGIC_SIZE) ||
+        memcmp(magic, PIPE_TRACE_MAGIC, PIPE_TRACE_MAGIC_SIZE) != 0) {
+        std::cerr << LOG_ERROR << traceFile << " is not a binary pipe trace" << std::endl;
+        return ERROR;
+    }
+
+    std::ios::fmtflags flags = pipe_out.flags();
+    char buf[PIPE_TRACE_RECORD_SIZE];
+    while (in.read(buf, PIPE_TRACE_RECORD_SIZE)) {
+        PipeTraceRecord record;
+        decodeRecord(buf, record);
+
+        PipeState state;
+        state.ifPC = record.ifPC;
+        state.idInstr = record.idInstr;
+        state.exInstr = record.exInstr;
+        state.memInstr = record.memInstr;
+        state.wbInstr = record.wbInstr;
+        state.ifStatus = static_cast<StageStatus>(record.ifStatus);
+        state.idStatus = static_cast<StageStatus>(record.idStatus);
+        state.exStatus = static_cast<StageStatus>(record.exStatus);
+        state.memStatus = static_cast<StageStatus>(record.memStatus);
+        state.wbStatus = static_cast<StageStatus>(record.wbStatus);
+
+        for (uint64_t i = 0; i <= record.repeat; i++) {
+            state.cycle = record.cycle + i;
+            pipe_out.flags(flags);
+            printPipeState(state, pipe_out);
+            pipe_out << '\n';
+        }
+    }
+    if (in.gcount() != 0) {
+        std::cerr << LOG_ERROR << "Truncated record at the end of " << traceFile << std::endl;
+        return ERROR;
+    }
+    pipe_out.flags(flags);
+    return pipe_out ? SUCCESS : ERROR;
+}
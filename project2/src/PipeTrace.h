@@ -0,0 +1,127 @@
+#pragma once
+#include <inttypes.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+
+// Size of the in-memory buffer the pipe state trace is formatted into.
+#define PIPE_TRACE_BUFFER_SIZE (1 << 20)
+
+// Binary trace layout: an 8 byte magic, then fixed-size little-endian records.
+#define PIPE_TRACE_MAGIC "RVPIPE01"
+#define PIPE_TRACE_MAGIC_SIZE 8
+#define PIPE_TRACE_RECORD_SIZE 44
+
+enum PipeTraceFormat {
+    TRACE_TEXT = 0,    // <name>_pipe_state.out, one printPipeState line per cycle
+    TRACE_BINARY,      // <name>_pipe_state.trc, one record per cycle
+    TRACE_BINARY_RLE,  // <name>_pipe_state.trc, identical consecutive cycles share a record
+};
+
+// Which cycles get a pipe state record
+enum PipeTraceMode {
+    TRACE_OFF = 0,  // no trace file at all
+    TRACE_ALL,      // every cycle
+    TRACE_EVERY,    // every interval-th cycle (cycle % interval == 0)
+    TRACE_WINDOW,   // cycles in [windowStart, windowEnd)
+};
+
+struct PipeTraceConfig {
+    PipeTraceFormat format = TRACE_TEXT;
+    PipeTraceMode mode = TRACE_ALL;
+    uint64_t interval = 1;
+    uint64_t windowStart = 0;
+    uint64_t windowEnd = 0;
+
+    bool traces(uint64_t cycle) const {
+        switch (mode) {
+            case TRACE_ALL:
+                return true;
+            case TRACE_EVERY:
+                return cycle % interval == 0;
+            case TRACE_WINDOW:
+                return cycle >= windowStart && cycle < windowEnd;
+            default:
+                return false;
+        }
+    }
+
+    // first traced cycle >= cycle, UINT64_MAX if there is none
+    uint64_t nextTraced(uint64_t cycle) const {
+        switch (mode) {
+            case TRACE_ALL:
+                return cycle;
+            case TRACE_EVERY: {
+                uint64_t rem = cycle % interval;
+                if (rem == 0) return cycle;
+                return cycle > UINT64_MAX - (interval - rem) ? UINT64_MAX : cycle + interval - rem;
+            }
+            case TRACE_WINDOW:
+                if (cycle < windowStart) return windowStart;
+                return cycle < windowEnd ? cycle : UINT64_MAX;
+            default:
+                return UINT64_MAX;
+        }
+    }
+};
+
+// One binary trace record. The instruction words are 32 bits wide; repeat counts
+// how many cycles directly after `cycle` had exactly the same pipe state.
+struct PipeTraceRecord {
+    uint64_t cycle;
+    uint64_t ifPC;
+    uint32_t idInstr;
+    uint32_t exInstr;
+    uint32_t memInstr;
+    uint32_t wbInstr;
+    uint32_t repeat;
+    uint8_t  ifStatus;
+    uint8_t  idStatus;
+    uint8_t  exStatus;
+    uint8_t  memStatus;
+    uint8_t  wbStatus;
+};
+
+// A persistent sink for the per-cycle pipe state trace. The output file stays open
+// for the whole run; records are formatted into a large buffer that is written out
+// in big chunks instead of reopening the file on every cycle. The text output is
+// byte-identical to the reference pipe state files.
+class PipeTrace {
+   private:
+    std::ofstream out;
+    std::vector<char> buffer;
+    std::ios::fmtflags defaultFlags;
+    bool isOpen;
+
+    PipeTraceConfig config;
+    PipeTraceRecord pending;  // last record, held back while it may still repeat
+    bool hasPending;
+
+    Status writeRecord(const PipeTraceRecord& record);
+
+   public:
+    PipeTrace();
+    ~PipeTrace();
+
+    void setConfig(const PipeTraceConfig& traceConfig) { config = traceConfig; }
+    const PipeTraceConfig& getConfig() const { return config; }
+
+    // true if the pipe state of this cycle should be written
+    bool traces(uint64_t cycle) const { return isOpen && config.traces(cycle); }
+    uint64_t nextTraced(uint64_t cycle) const {
+        return isOpen ? config.nextTraced(cycle) : UINT64_MAX;
+    }
+
+    // (re)create <base_output_name>_pipe_state.out (or .trc for binary traces),
+    // nothing is created when the trace mode is TRACE_OFF
+    Status open(const std::string& base_output_name);
+    Status write(const PipeState& state);
+    Status flush();
+    void close();
+};
+
+// Render a binary trace written by PipeTrace in the text format of TRACE_TEXT.
+Status renderPipeTrace(const std::string& traceFile, std::ostream& pipe_out);
@@ -0,0 +1,191 @@
+#include "Prefetcher.h"
+
+Prefetcher::Prefetcher(const CacheConfig& config)
+    : kind(config.prefetch),
+      maxDegree(config.prefetchDegree),
+      degree(config.prefetchDegree),
+      blockOffsetBits(log2Int(config.blockSize)),
+      lastBlock(UINT64_MAX),
+      strides(PREFETCH_STRIDE_ENTRIES, StrideEntry{UINT64_MAX, 0, 0, 0}),
+      streams(PREFETCH_STREAMS, Stream{0, 0, 0, 0}),
+      useCount(0),
+      inFlight(PREFETCH_IN_FLIGHT, InFlight{UINT64_MAX, 0}),
+      inFlightNext(0),
+      windowIssued(0),
+      windowUseful(0) {
+    candidates.reserve(maxDegree);
+}
+
+// the degree blocks after block, step blocks apart
+void Prefetcher::propose(uint64_t block, int64_t step) {
+    for (uint64_t i = 1; i <= degree; i++) {
+        candidates.push_back((block + step * (int64_t)i) << blockOffsetBits);
+    }
+}
+
+const std::vector<uint64_t>& Prefetcher::train(uint64_t PC, uint64_t address, bool hit,
+                                               bool hitPrefetched) {
+    candidates.clear();
+    uint64_t block = address >> blockOffsetBits;
+
+    if (kind == PREFETCH_NEXT_LINE) {
+        // only a new block triggers, a fetch runs through each one word by word
+        if (block != lastBlock) propose(block, 1);
+        lastBlock = block;
+    } else if (kind == PREFETCH_STRIDE) {
+        StrideEntry& entry = strides[(PC >> 2) % PREFETCH_STRIDE_ENTRIES];
+        if (entry.PC != PC) {
+            entry = StrideEntry{PC, address, 0, 0};
+            return candidates;
+        }
+        int64_t stride = (int64_t)(address - entry.address);
+        if (stride == entry.stride && stride != 0) {
+            if (entry.confidence < 3) entry.confidence++;
+        } else if (entry.confidence > 0) {
+            entry.confidence--;
+        } else {
+            entry.stride = stride;
+        }
+        entry.address = address;
+        if (entry.confidence >= 2) {
+            // a stride below the block size proposes each block once
+            uint64_t previous = block;
+            for (uint64_t i = 1; i <= degree; i++) {
+                uint64_t next = (address + entry.stride * (int64_t)i) >> blockOffsetBits;
+                if (next != previous) candidates.push_back(next << blockOffsetBits);
+                previous = next;
+            }
+        }
+    } else if (kind == PREFETCH_STREAM && (!hit || hitPrefetched)) {
+        // a miss or the first use of a prefetched block continues the stream within a
+        // few blocks of it, otherwise it starts one in place of the least recently used
+        useCount++;
+        Stream* stream = nullptr;
+        Stream* oldest = &streams[0];
+        for (Stream& candidate : streams) {
+            int64_t distance = (int64_t)(block - candidate.block);
+            if (candidate.lastUse > 0 && distance != 0 && distance >= -2 && distance <= 2) {
+                stream = &candidate;
+                break;
+            }
+            if (candidate.lastUse < oldest->lastUse) oldest = &candidate;
+        }
+        if (!stream) {
+            *oldest = Stream{block, 0, 0, useCount};
+            return candidates;
+        }
+        int64_t direction = (int64_t)(block - stream->block) > 0 ? 1 : -1;
+        if (direction == stream->direction) {
+            if (stream->confidence < 3) stream->confidence++;
+        } else {
+            stream->direction = direction;
+            stream->confidence = 1;
+        }
+        stream->block = block;
+        stream->lastUse = useCount;
+        // the blocks proposed before are there already, Cache::prefetch skips them
+        if (stream->confidence >= 2) propose(block, direction);
+    }
+    return candidates;
+}
+
+void Prefetcher::issued(uint64_t address, uint64_t ready) {
+    inFlight[inFlightNext] = InFlight{address >> blockOffsetBits, ready};
+    inFlightNext = (inFlightNext + 1) % PREFETCH_IN_FLIGHT;
+
+    if (++windowIssued < PREFETCH_WINDOW) return;
+    // accuracy above 3/4 raises the degree, below 2/5 lowers it
+    if (windowUseful * 4 > windowIssued * 3 && degree < maxDegree) {
+        degree++;
+    } else if (windowUseful * 5 < windowIssued * 2 && degree > 1) {
+        degree--;
+    }
+    windowIssued = windowUseful = 0;
+}
+
+uint64_t Prefetcher::useful(uint64_t address, uint64_t cycle) {
+    windowUseful++;
+    uint64_t block = address >> blockOffsetBits;
+    for (InFlight& entry : inFlight) {
+        if (entry.block != block) continue;
+        entry.block = UINT64_MAX;
+        return entry.ready > cycle ? entry.ready - cycle : 0;
+    }
+    return 0;
+}
+
+void Prefetcher::saveState(CheckpointWriter& out) const {
+    out.put(kind);
+    out.put(maxDegree);
+    out.put(blockOffsetBits);
+    out.put(degree);
+    out.put(lastBlock);
+    for (const StrideEntry& entry : strides) {
+        out.put(entry.PC);
+        out.put(entry.address);
+        out.put(entry.stride);
+        out.put(entry.confidence);
+    }
+    for (const Stream& stream : streams) {
+        out.put(stream.block);
+        out.put(stream.direction);
+        out.put(stream.confidence);
+        out.put(stream.lastUse);
+    }
+    out.put(useCount);
+    for (const InFlight& entry : inFlight) {
+        out.put(entry.block);
+        out.put(entry.ready);
+    }
+    out.put(inFlightNext);
+    out.put(windowIssued);
+    out.put(windowUseful);
+}
+
+bool Prefetcher::restoreState(CheckpointReader& in) {
+    uint64_t savedKind = in.get();
+    uint64_t savedMaxDegree = in.get();
+    uint64_t savedOffsetBits = in.get();
+
+    // read the whole section even if it is not used, the next one follows it
+    uint64_t savedDegree = in.get();
+    uint64_t savedLastBlock = in.get();
+    std::vector<StrideEntry> savedStrides(PREFETCH_STRIDE_ENTRIES);
+    for (StrideEntry& entry : savedStrides) {
+        entry.PC = in.get();
+        entry.address = in.get();
+        entry.stride = (int64_t)in.get();
+        entry.confidence = (uint8_t)in.get();
+    }
+    std::vector<Stream> savedStreams(PREFETCH_STREAMS);
+    for (Stream& stream : savedStreams) {
+        stream.block = in.get();
+        stream.direction = (int64_t)in.get();
+        stream.confidence = (uint8_t)in.get();
+        stream.lastUse = in.get();
+    }
+    uint64_t savedUseCount = in.get();
+    std::vector<InFlight> savedInFlight(PREFETCH_IN_FLIGHT);
+    for (InFlight& entry : savedInFlight) {
+        entry.block = in.get();
+        entry.ready = in.get();
+    }
+    uint64_t savedNext = in.get();
+    uint64_t savedIssued = in.get();
+    uint64_t savedUseful = in.get();
+
+    if (savedKind != (uint64_t)kind || savedMaxDegree != maxDegree ||
+        savedOffsetBits != blockOffsetBits || in.hasFailed()) {
+        return false;
+    }
+    degree = savedDegree;
+    lastBlock = savedLastBlock;
+    strides.swap(savedStrides);
+    streams.swap(savedStreams);
+    useCount = savedUseCount;
+    inFlight.swap(savedInFlight);
+    inFlightNext = savedNext % PREFETCH_IN_FLIGHT;
+    windowIssued = savedIssued;
+    windowUseful = savedUseful;
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <inttypes.h>
+
+#include <vector>
+
+#include "Checkpoint.h"
+#include "cache.h"
+
+// Table sizes of the prefetchers, and the window of issued prefetches after which
+// the degree is throttled by their accuracy
+#define PREFETCH_STRIDE_ENTRIES 64
+#define PREFETCH_STREAMS 8
+#define PREFETCH_IN_FLIGHT 64
+#define PREFETCH_WINDOW 256
+
+// Hardware prefetcher of one L1 cache, as configured by its prefetch key. It is
+// trained with the demand accesses of the pipeline and proposes the blocks to bring
+// in (see Cache::prefetch); the simulation tells it when each of them arrives, so a
+// demand access that finds a prefetched block still on its way waits for the rest.
+// The degree goes up while most prefetches get used and down while most do not.
+class Prefetcher {
+   private:
+    struct StrideEntry {
+        uint64_t PC;
+        uint64_t address;
+        int64_t stride;
+        uint8_t confidence;  // 2-bit, prefetches from 2 on
+    };
+    struct Stream {
+        uint64_t block;
+        int64_t direction;  // +1 or -1 once the stream has one, 0 before
+        uint8_t confidence;
+        uint64_t lastUse;
+    };
+    struct InFlight {
+        uint64_t block;
+        uint64_t ready;  // last cycle the block is still on its way
+    };
+
+    PrefetchKind kind;
+    uint64_t maxDegree;
+    uint64_t degree;
+    uint64_t blockOffsetBits;
+    uint64_t lastBlock;
+    std::vector<StrideEntry> strides;
+    std::vector<Stream> streams;
+    uint64_t useCount;
+    std::vector<InFlight> inFlight;  // circular, inFlightNext is the oldest entry
+    uint64_t inFlightNext;
+    uint64_t windowIssued;
+    uint64_t windowUseful;
+    std::vector<uint64_t> candidates;
+
+    void propose(uint64_t block, int64_t step);
+
+   public:
+    // config as checked by parseCacheConfig, kind not PREFETCH_NONE
+    explicit Prefetcher(const CacheConfig& config);
+
+    // The demand access of address by the instruction at PC (the fetch itself for
+    // the I-cache) hit or missed, hitPrefetched as the cache answered it: the block
+    // addresses to prefetch now, at most the current degree of them
+    const std::vector<uint64_t>& train(uint64_t PC, uint64_t address, bool hit,
+                                       bool hitPrefetched);
+    // the prefetch of block address issued at some cycle arrives after cycle ready
+    void issued(uint64_t address, uint64_t ready);
+    // a demand access at cycle hit a prefetched block for the first time: the cycles
+    // it still has to wait for the block, 0 if the prefetch was in time
+    uint64_t useful(uint64_t address, uint64_t cycle);
+
+    uint64_t getDegree() const { return degree; }
+
+    // Checkpoint section, as Cache: a prefetcher of another configuration is left as
+    // it is and restoreState returns false
+    void saveState(CheckpointWriter& out) const;
+    bool restoreState(CheckpointReader& in);
+};
@@ -0,0 +1,85 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static const char* const causeNames[NUM_PROFILE_CAUSES] = {
+    "retire", "icache", "dcache", "load-use", "squash", "except",
+};
+
+static uint64_t total(const Profiler::Entry& entry) {
+    uint64_t cycles = 0;
+    for (uint64_t charged : entry.cycles) cycles += charged;
+    return cycles;
+}
+
+Profiler::Entry& Profiler::grow(uint64_t PC) {
+    // the table always covers whole chunks
+    const uint64_t chunkBytes = PROFILE_CHUNK_ENTRIES * 4;
+    uint64_t chunkBase = PC & ~(chunkBytes - 1);
+    if (entries.empty()) {
+        base = chunkBase;
+        entries.resize(PROFILE_CHUNK_ENTRIES);
+    } else if (PC < base) {
+        uint64_t growBy = (base - chunkBase) >> 2;
+        if (growBy > PROFILE_MAX_ENTRIES - entries.size()) return other;
+        entries.insert(entries.begin(), growBy, Entry());
+        base = chunkBase;
+    } else {
+        uint64_t size = ((chunkBase - base) >> 2) + PROFILE_CHUNK_ENTRIES;
+        if (size > PROFILE_MAX_ENTRIES) return other;
+        entries.resize(size);
+    }
+    return entries[(PC - base) >> 2];
+}
+
+Status Profiler::dump(MemoryStore* memory, uint64_t totalCycles,
+                      const std::string& base_output_name) const {
+    std::ofstream out(base_output_name + "_profile.out");
+    if (!out) {
+        std::cerr << LOG_ERROR << "Could not create " << base_output_name << "_profile.out"
+                  << std::endl;
+        return ERROR;
+    }
+
+    uint64_t charged = total(other);
+    std::vector<uint64_t> indices;
+    for (uint64_t i = 0; i < entries.size(); i++) {
+        uint64_t cycles = total(entries[i]);
+        if (cycles == 0) continue;
+        charged += cycles;
+        indices.push_back(i);
+    }
+    std::stable_sort(indices.begin(), indices.end(), [this](uint64_t a, uint64_t b) {
+        return total(entries[a]) > total(entries[b]);
+    });
+
+    out << "Cycles: " << totalCycles << ", charged to instructions: " << charged
+        << " (the others fill and drain the pipeline or overlap a miss)" << std::endl;
+    out << std::left << std::setw(18) << "PC" << std::right << std::setw(10) << "cycles"
+        << std::setw(9) << "%";
+    for (const char* name : causeNames) out << std::setw(10) << name;
+    out << "  instruction" << std::endl;
+
+    auto line = [&](const std::string& PC, const Entry& entry, const std::string& text) {
+        uint64_t cycles = total(entry);
+        double share = totalCycles ? 100.0 * cycles / totalCycles : 0;
+        out << std::left << std::setw(18) << PC << std::right << std::setw(10) << cycles
+            << std::setw(8) << std::fixed << std::setprecision(2) << share << "%";
+        for (uint64_t count : entry.cycles) out << std::setw(10) << count;
+        out << "  " << text << std::endl;
+    };
+    for (uint64_t index : indices) {
+        uint64_t PC = base + (index << 2);
+        uint64_t instruction = 0;
+        std::ostringstream address;
+        address << "0x" << std::hex << PC;
+        bool readable = memory->contains(PC, WORD_SIZE) &&
+                        memory->getMemValue<WORD_SIZE>(PC, instruction) == 0;
+        line(address.str(), entries[index], readable ? disassemble(instruction) : "?");
+    }
+    if (total(other) > 0) line("other", other, "");
+    return SUCCESS;
+}
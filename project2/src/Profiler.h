@@ -0,0 +1,56 @@
+#pragma once
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+
+#include "MemoryStore.h"
+#include "Utilities.h"
+
+// Entries the per-PC table grows by, and the most it grows to (PCs further away from
+// the first one profiled are counted as "other")
+#define PROFILE_CHUNK_ENTRIES 1024
+#define PROFILE_MAX_ENTRIES (1 << 20)
+
+// What a cycle charged to an instruction was spent on. Every slot the pipeline turns
+// into a BUBBLE or SQUASHED (or retires as NORMAL) is charged to the instruction
+// that caused it.
+enum ProfileCause {
+    PROFILE_RETIRE = 0,  // the cycle it retires
+    PROFILE_ICACHE,      // I-cache miss cycles fetching it
+    PROFILE_DCACHE,      // D-cache miss cycles of its load or store
+    PROFILE_LOAD_USE,    // bubbles while it waits in ID for a load (or ALU result of a branch)
+    PROFILE_SQUASH,      // the fetch it squashes as a mispredicted (taken) branch or jump
+    PROFILE_EXCEPTION,   // the slots it squashes as an illegal instruction
+    NUM_PROFILE_CAUSES
+};
+
+// Per-PC cycle accounting for runCycles. The counters live in a flat table indexed
+// by (PC - base) >> 2, which only grows when a PC outside it shows up.
+class Profiler {
+   public:
+    struct Entry {
+        uint64_t cycles[NUM_PROFILE_CAUSES];
+    };
+
+   private:
+    uint64_t base;
+    std::vector<Entry> entries;
+    Entry other;
+
+    Entry& grow(uint64_t PC);
+
+   public:
+    Profiler() : base(0), other() {}
+
+    void charge(uint64_t PC, ProfileCause cause, uint64_t cycles = 1) {
+        uint64_t index = (PC - base) >> 2;
+        Entry& entry = index < entries.size() ? entries[index] : grow(PC);
+        entry.cycles[cause] += cycles;
+    }
+
+    // Write <base_output_name>_profile.out: one line per instruction charged, the most
+    // expensive first, disassembled from the memory as it is at the end
+    Status dump(MemoryStore* memory, uint64_t totalCycles,
+                const std::string& base_output_name) const;
+};
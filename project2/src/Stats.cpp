@@ -0,0 +1,169 @@
+#include "Stats.h"
+
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+static const char* const counterNames[NUM_STAT_COUNTERS] = {
+    "dynamic_instructions",
+    "total_cycles",
+    "icache_hits",
+    "icache_misses",
+    "dcache_hits",
+    "dcache_misses",
+    "load_use_stalls",
+    "arith_branch_stalls",
+    "load_branch_stalls",
+    "icache_stall_cycles",
+    "dcache_stall_cycles",
+    "branch_squashes",
+    "exceptions",
+    "fast_forwarded_instructions",
+    "control_transfers",
+    "mispredicts",
+    "btb_hits",
+    "mshr_merges",
+    "overlapped_misses",
+    "mshr_full_cycles",
+    "store_buffer_full_cycles",
+    "icache_miss_cycles",
+    "dcache_miss_cycles",
+    "l2_hits",
+    "l2_misses",
+    "l3_hits",
+    "l3_misses",
+    "memory_reads",
+    "memory_wait_cycles",
+    "icache_prefetches",
+    "icache_useful_prefetches",
+    "icache_late_prefetches",
+    "dcache_prefetches",
+    "dcache_useful_prefetches",
+    "dcache_late_prefetches",
+    "dcache_write_backs",
+    "dcache_write_bytes",
+    "write_buffer_full_cycles",
+    "memory_writes",
+    "memory_write_bytes",
+    "dual_issue_cycles",
+    "coherence_invalidations",
+    "coherence_downgrades",
+    "coherence_upgrades",
+    "coherence_write_backs",
+};
+
+void StatsRegistry::reset() {
+    for (uint64_t& counter : counters) counter = 0;
+}
+
+const char* StatsRegistry::name(StatCounter counter) {
+    return counterNames[counter];
+}
+
+double StatsRegistry::cpi() const {
+    if (counters[STAT_INSTRUCTIONS] == 0) return 0;
+    return (double)counters[STAT_CYCLES] / counters[STAT_INSTRUCTIONS];
+}
+
+double StatsRegistry::predictionAccuracy() const {
+    if (counters[STAT_CONTROL_TRANSFERS] == 0) return 1;
+    return 1 - (double)counters[STAT_MISPREDICTS] / counters[STAT_CONTROL_TRANSFERS];
+}
+
+double StatsRegistry::hitRate(StatCounter hits, StatCounter misses) const {
+    uint64_t accesses = counters[hits] + counters[misses];
+    if (accesses == 0) return 0;
+    return (double)counters[hits] / accesses;
+}
+
+double StatsRegistry::dualIssueRate() const {
+    if (counters[STAT_CYCLES] == 0) return 0;
+    return (double)counters[STAT_DUAL_ISSUE_CYCLES] / counters[STAT_CYCLES];
+}
+
+double StatsRegistry::prefetchAccuracy(StatCounter prefetches, StatCounter useful) const {
+    if (counters[prefetches] == 0) return 0;
+    return (double)counters[useful] / counters[prefetches];
+}
+
+double StatsRegistry::amat(StatCounter hits, StatCounter misses, StatCounter missCycles) const {
+    uint64_t accesses = counters[hits] + counters[misses];
+    if (accesses == 0) return 1;
+    return 1 + (double)counters[missCycles] / accesses;
+}
+
+SimulationStats StatsRegistry::toSimulationStats() const {
+    return SimulationStats{counters[STAT_INSTRUCTIONS], counters[STAT_CYCLES],
+                           counters[STAT_IC_HITS],      counters[STAT_IC_MISSES],
+                           counters[STAT_DC_HITS],      counters[STAT_DC_MISSES],
+                           counters[STAT_LOAD_USE_STALLS]};
+}
+
+void StatsRegistry::saveState(CheckpointWriter& out) const {
+    out.put(NUM_STAT_COUNTERS);
+    for (uint64_t counter : counters) out.put(counter);
+}
+
+void StatsRegistry::restoreState(CheckpointReader& in) {
+    reset();
+    uint64_t count = in.get();
+    for (uint64_t i = 0; i < count && !in.hasFailed(); i++) {
+        uint64_t value = in.get();
+        if (i < NUM_STAT_COUNTERS) counters[i] = value;
+    }
+}
+
+Status StatsRegistry::dump(StatsFormat format, const std::string& base_output_name) const {
+    if (format == STATS_TEXT) return SUCCESS;
+
+    std::string fileName = base_output_name + (format == STATS_JSON ? "_sim_stats.json"
+                                                                    : "_sim_stats.csv");
+    std::ofstream out(fileName);
+    if (!out) {
+        std::cerr << LOG_ERROR << "Could not create " << fileName << std::endl;
+        return ERROR;
+    }
+    const std::pair<const char*, double> derived[] = {
+        {"cpi", cpi()},
+        {"prediction_accuracy", predictionAccuracy()},
+        {"icache_hit_rate", hitRate(STAT_IC_HITS, STAT_IC_MISSES)},
+        {"dcache_hit_rate", hitRate(STAT_DC_HITS, STAT_DC_MISSES)},
+        {"l2_hit_rate", hitRate(STAT_L2_HITS, STAT_L2_MISSES)},
+        {"l3_hit_rate", hitRate(STAT_L3_HITS, STAT_L3_MISSES)},
+        {"icache_amat", amat(STAT_IC_HITS, STAT_IC_MISSES, STAT_IC_MISS_CYCLES)},
+        {"dcache_amat", amat(STAT_DC_HITS, STAT_DC_MISSES, STAT_DC_MISS_CYCLES)},
+        {"icache_prefetch_accuracy",
+         prefetchAccuracy(STAT_IC_PREFETCHES, STAT_IC_USEFUL_PREFETCHES)},
+        {"dcache_prefetch_accuracy",
+         prefetchAccuracy(STAT_DC_PREFETCHES, STAT_DC_USEFUL_PREFETCHES)},
+        {"dual_issue_rate", dualIssueRate()},
+    };
+    if (format == STATS_JSON) {
+        out << "{" << std::endl;
+        for (int i = 0; i < NUM_STAT_COUNTERS; i++) {
+            out << "  \"" << counterNames[i] << "\": " << counters[i] << "," << std::endl;
+        }
+        const char* separator = "";
+        for (const auto& metric : derived) {
+            out << separator << "  \"" << metric.first << "\": " << metric.second;
+            separator = ",\n";
+        }
+        out << std::endl << "}" << std::endl;
+    } else {
+        for (int i = 0; i < NUM_STAT_COUNTERS; i++) out << counterNames[i] << ",";
+        const char* separator = "";
+        for (const auto& metric : derived) {
+            out << separator << metric.first;
+            separator = ",";
+        }
+        out << std::endl;
+        for (int i = 0; i < NUM_STAT_COUNTERS; i++) out << counters[i] << ",";
+        separator = "";
+        for (const auto& metric : derived) {
+            out << separator << metric.second;
+            separator = ",";
+        }
+        out << std::endl;
+    }
+    return SUCCESS;
+}
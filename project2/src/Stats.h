@@ -0,0 +1,106 @@
+#pragma once
+#include <inttypes.h>
+
+#include <string>
+
+#include "Checkpoint.h"
+#include "Utilities.h"
+
+// The performance counters of one simulation. The first seven are the ones of
+// SimulationStats (<name>_sim_stats.out), in its order.
+enum StatCounter {
+    STAT_INSTRUCTIONS = 0,     // instructions retired by the pipeline
+    STAT_CYCLES,               // simulated cycles
+    STAT_IC_HITS,              // I-cache hits and misses, taken from the cache
+    STAT_IC_MISSES,
+    STAT_DC_HITS,              // D-cache hits and misses, taken from the cache
+    STAT_DC_MISSES,
+    STAT_LOAD_USE_STALLS,      // cycles ID waits for a load in EX (or outstanding, see MSHRs)
+    STAT_ARITH_BRANCH_STALLS,  // cycles a branch in ID waits for an ALU result in EX
+    STAT_LOAD_BRANCH_STALLS,   // second cycles a branch in ID waits for a load
+    STAT_IC_STALL_CYCLES,      // cycles fetch waits for an I-cache miss
+    STAT_DC_STALL_CYCLES,      // cycles the pipeline waits for a D-cache miss
+    STAT_BRANCH_SQUASHES,      // taken branches and jumps squashing the fetched instruction
+    STAT_EXCEPTIONS,           // illegal instructions redirected to the exception handler
+    STAT_FAST_FORWARDED,       // instructions run functionally before the pipeline started
+    STAT_CONTROL_TRANSFERS,    // branches and jumps resolved in ID
+    STAT_MISPREDICTS,          // of them, fetched past the wrong next PC (no predictor: taken)
+    STAT_BTB_HITS,             // fetches the BTB predicted a control transfer for
+    STAT_MSHR_MERGES,          // non-blocking D-cache: accesses to a block with a miss outstanding
+    STAT_OVERLAPPED_MISSES,    // misses issued while others were outstanding
+    STAT_MSHR_FULL_CYCLES,     // cycles a missing load waits in MEM for an MSHR
+    STAT_STORE_BUFFER_FULL_CYCLES,  // cycles a store waits in MEM for a store buffer entry
+    STAT_IC_MISS_CYCLES,       // miss penalties of the I- and D-cache misses, summed up
+    STAT_DC_MISS_CYCLES,
+    STAT_L2_HITS,              // L2 and L3 hits and misses, taken from the hierarchy
+    STAT_L2_MISSES,
+    STAT_L3_HITS,
+    STAT_L3_MISSES,
+    STAT_MEMORY_READS,         // blocks read from memory
+    STAT_MEMORY_WAIT_CYCLES,   // cycles they waited for the memory bandwidth
+    STAT_IC_PREFETCHES,        // blocks the I-cache prefetcher brought in, taken from the cache
+    STAT_IC_USEFUL_PREFETCHES, // of them, hit by a fetch before their eviction
+    STAT_IC_LATE_PREFETCHES,   // of those, still on their way when the fetch hit them
+    STAT_DC_PREFETCHES,        // the same for the D-cache prefetcher and loads and stores
+    STAT_DC_USEFUL_PREFETCHES,
+    STAT_DC_LATE_PREFETCHES,
+    STAT_DC_WRITE_BACKS,       // dirty D-cache blocks written back, taken from the cache
+    STAT_DC_WRITE_BYTES,       // bytes the D-cache wrote to the level behind it
+    STAT_WRITE_BUFFER_FULL_CYCLES,  // cycles a store waits in MEM for a write buffer entry
+    STAT_MEMORY_WRITES,        // writes that reached the memory, and their bytes
+    STAT_MEMORY_WRITE_BYTES,
+    STAT_DUAL_ISSUE_CYCLES,    // dual-issue pipeline: cycles two instructions went on to EX
+    STAT_COHERENCE_INVALIDATIONS,  // MultiHart: D-cache blocks other harts' stores invalidated
+    STAT_COHERENCE_DOWNGRADES, // modified D-cache blocks other harts' loads made shared
+    STAT_COHERENCE_UPGRADES,   // stores that invalidated the copies of other harts
+    STAT_COHERENCE_WRITE_BACKS,  // dirty blocks the invalidations and downgrades wrote back
+    NUM_STAT_COUNTERS
+};
+
+// Machine-readable copy of the counters written next to <name>_sim_stats.out
+enum StatsFormat {
+    STATS_TEXT = 0,  // only <name>_sim_stats.out
+    STATS_JSON,      // also <name>_sim_stats.json, one object
+    STATS_CSV,       // also <name>_sim_stats.csv, a header and a value line
+};
+
+// Plain counters owned by one simulation, without any locking: each simulation
+// (thread) counts into its own registry.
+class StatsRegistry {
+   private:
+    uint64_t counters[NUM_STAT_COUNTERS];
+
+   public:
+    StatsRegistry() { reset(); }
+
+    void reset();
+    void add(StatCounter counter, uint64_t count = 1) { counters[counter] += count; }
+    void set(StatCounter counter, uint64_t value) { counters[counter] = value; }
+    uint64_t get(StatCounter counter) const { return counters[counter]; }
+
+    // snake_case name of a counter, as used in the JSON and CSV files
+    static const char* name(StatCounter counter);
+    // cycles per retired instruction, 0 before the first one retires
+    double cpi() const;
+    // share of the control transfers with a correct next PC, 1 without any
+    double predictionAccuracy() const;
+    // share of the accesses that hit, 0 without any
+    double hitRate(StatCounter hits, StatCounter misses) const;
+    // share of the cycles that issued two instructions, 0 before the first cycle
+    double dualIssueRate() const;
+    // share of the prefetches issued that were useful, 0 without any
+    double prefetchAccuracy(StatCounter prefetches, StatCounter useful) const;
+    // average memory access time of an L1 in cycles: a hit takes the one of its
+    // pipeline stage, a miss its penalty on top
+    double amat(StatCounter hits, StatCounter misses, StatCounter missCycles) const;
+    SimulationStats toSimulationStats() const;
+
+    // Checkpoint section: the number of counters, then their values. Counters a
+    // checkpoint does not have stay 0.
+    void saveState(CheckpointWriter& out) const;
+    void restoreState(CheckpointReader& in);
+
+    // write <base_output_name>_sim_stats.json or .csv (nothing for STATS_TEXT): the
+    // counters, then the metrics derived from them
+    Status dump(StatsFormat format, const std::string& base_output_name) const;
+};
@@ -0,0 +1,50 @@
+#include "ThreadPool.h"
+
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(size_t threads) : numThreads(threads) {
+    if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0) numThreads = 1;
+}
+
+bool WorkStealingPool::popOwn(size_t worker, size_t& task) {
+    WorkQueue& queue = queues[worker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) return false;
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t worker, size_t& task) {
+    for (size_t i = 1; i < numThreads; i++) {
+        WorkQueue& victim = queues[(worker + i) % numThreads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty()) continue;
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::work(size_t worker, const std::function<void(size_t)>& task) {
+    // no task is ever added while the workers run, so once neither the own deque
+    // nor any other one has work left the worker is done
+    size_t next;
+    while (popOwn(worker, next) || steal(worker, next)) task(next);
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t)>& task) {
+    // deal the tasks out round-robin; the own deque is worked from the back, so
+    // fill it in reverse to start with the lowest indices
+    queues = std::vector<WorkQueue>(numThreads);
+    for (size_t i = count; i-- > 0;) queues[i % numThreads].tasks.push_back(i);
+
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < numThreads; worker++) {
+        threads.emplace_back(&WorkStealingPool::work, this, worker, std::cref(task));
+    }
+    work(0, task);
+    for (std::thread& thread : threads) thread.join();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs independent, coarse-grained tasks (whole simulations) on a fixed number of
+// threads. Every worker owns a deque of task indices: it takes work from the back
+// of its own deque and, once that is empty, steals from the front of the others,
+// so a few long runs do not leave the rest of the machine idle.
+class WorkStealingPool {
+   private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    size_t numThreads;
+    std::vector<WorkQueue> queues;
+
+    bool popOwn(size_t worker, size_t& task);
+    bool steal(size_t worker, size_t& task);
+    void work(size_t worker, const std::function<void(size_t)>& task);
+
+   public:
+    // threads == 0 uses one thread per hardware thread of the host
+    explicit WorkStealingPool(size_t threads = 0);
+
+    size_t size() const { return numThreads; }
+
+    // call task(i) for every i in [0, count) and wait until all calls returned
+    void run(size_t count, const std::function<void(size_t)>& task);
+};
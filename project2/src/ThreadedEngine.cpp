@@ -0,0 +1,326 @@
+#include "ThreadedEngine.h"
+
+#include <algorithm>
+
+// The handlers, one (template instance) per instruction. Each of them does exactly
+// what simInstruction does for its instruction, see simArithLogic,
+// simNextPCResolution and simMemAccess.
+struct EngineHandlers {
+    typedef ThreadedEngine::Op Op;
+    typedef uint64_t (*AluFunction)(uint64_t, uint64_t);
+    typedef bool (*Condition)(uint64_t, uint64_t);
+
+    static uint64_t add(uint64_t a, uint64_t b) { return a + b; }
+    static uint64_t sub(uint64_t a, uint64_t b) { return a - b; }
+    static uint64_t sll(uint64_t a, uint64_t b) { return a << (b & 0x3F); }
+    static uint64_t slt(uint64_t a, uint64_t b) { return (int64_t)a < (int64_t)b; }
+    static uint64_t sltu(uint64_t a, uint64_t b) { return a < b; }
+    static uint64_t xorOp(uint64_t a, uint64_t b) { return a ^ b; }
+    static uint64_t srl(uint64_t a, uint64_t b) { return a >> (b & 0x3F); }
+    static uint64_t sra(uint64_t a, uint64_t b) { return (int64_t)a >> (b & 0x3F); }
+    static uint64_t orOp(uint64_t a, uint64_t b) { return a | b; }
+    static uint64_t andOp(uint64_t a, uint64_t b) { return a & b; }
+    static uint64_t addw(uint64_t a, uint64_t b) { return sext64((uint32_t)a + (uint32_t)b, 31); }
+    static uint64_t subw(uint64_t a, uint64_t b) { return sext64((uint32_t)a - (uint32_t)b, 31); }
+    static uint64_t sllw(uint64_t a, uint64_t b) {
+        return sext64((uint32_t)a << (uint32_t)(b & 0x1F), 31);
+    }
+    static uint64_t srlw(uint64_t a, uint64_t b) {
+        return sext64((uint32_t)a >> (uint32_t)(b & 0x1F), 31);
+    }
+    static uint64_t sraw(uint64_t a, uint64_t b) {
+        return sext64((int32_t)a >> (uint32_t)(b & 0x1F), 31);
+    }
+
+    static bool beq(uint64_t a, uint64_t b) { return a == b; }
+    static bool bne(uint64_t a, uint64_t b) { return a != b; }
+    static bool blt(uint64_t a, uint64_t b) { return (int64_t)a < (int64_t)b; }
+    static bool bge(uint64_t a, uint64_t b) { return (int64_t)a >= (int64_t)b; }
+    static bool bltu(uint64_t a, uint64_t b) { return a < b; }
+    static bool bgeu(uint64_t a, uint64_t b) { return a >= b; }
+
+    template <AluFunction f>
+    static uint64_t reg(ThreadedEngine& e, const Op& op) {
+        e.setRd(op.rd, f(e.registers[op.rs1], e.registers[op.rs2]));
+        return op.PC + 4;
+    }
+
+    template <AluFunction f>
+    static uint64_t imm(ThreadedEngine& e, const Op& op) {
+        e.setRd(op.rd, f(e.registers[op.rs1], op.imm));
+        return op.PC + 4;
+    }
+
+    template <Condition taken>
+    static uint64_t branch(ThreadedEngine& e, const Op& op) {
+        return taken(e.registers[op.rs1], e.registers[op.rs2]) ? op.imm : op.PC + 4;
+    }
+
+    static uint64_t lui(ThreadedEngine& e, const Op& op) {
+        e.setRd(op.rd, op.imm);
+        return op.PC + 4;
+    }
+
+    static uint64_t auipc(ThreadedEngine& e, const Op& op) {
+        e.setRd(op.rd, op.PC + op.imm);
+        return op.PC + 4;
+    }
+
+    static uint64_t jal(ThreadedEngine& e, const Op& op) {
+        e.setRd(op.rd, op.PC + 4);
+        return op.imm;
+    }
+
+    static uint64_t jalr(ThreadedEngine& e, const Op& op) {
+        uint64_t target = (e.registers[op.rs1] + op.imm) & ~1ULL;
+        e.setRd(op.rd, op.PC + 4);
+        return target;
+    }
+
+    static uint64_t nop(ThreadedEngine&, const Op& op) { return op.PC + 4; }
+
+    template <MemEntrySize size, bool isSigned>
+    static uint64_t load(ThreadedEngine& e, const Op& op) {
+        uint64_t value;
+        e.memory->getMemValue<size>(e.registers[op.rs1] + op.imm, value);
+        e.setRd(op.rd, isSigned ? sext64(value, size * 8 - 1) : value);
+        return op.PC + 4;
+    }
+
+    template <MemEntrySize size>
+    static uint64_t store(ThreadedEngine& e, const Op& op) {
+        uint64_t address = e.registers[op.rs1] + op.imm;
+        e.memory->setMemValue<size>(address, e.registers[op.rs2]);
+        e.stored(address, size);
+        return op.PC + 4;
+    }
+
+    // anything else goes through simInstruction
+    static uint64_t generic(ThreadedEngine& e, const Op& op) {
+        Simulator::Instruction inst;
+        e.simulator.simInstruction(op.PC, inst);
+        e.genericOps++;
+        if (inst.isHalt || !inst.isLegal) {
+            e.stopStatus = inst.isHalt ? HALT : ERROR;
+            e.stopPC = op.PC;
+            e.leaveBlock = true;
+        } else if (inst.writesMem) {
+            e.stored(inst.memAddress, DOUBLE_SIZE);
+        }
+        return inst.nextPC;
+    }
+
+    // the handler of a decoded legal instruction (see simArithLogic for the funct
+    // fields each case looks at), nullptr for the generic path
+    static ThreadedEngine::Handler select(const Simulator::Instruction& inst) {
+        uint64_t upperImm12 = inst.funct7 >> 1;
+        if (inst.isNop) return nop;
+        switch (inst.opcode) {
+            case OP_INT:
+                switch (inst.funct3) {
+                    case FUNCT3_ADD:
+                        if (inst.funct7 == FUNCT7_ADD) return reg<add>;
+                        if (inst.funct7 == FUNCT7_SUB) return reg<sub>;
+                        return nullptr;
+                    case FUNCT3_SLL: return reg<sll>;
+                    case FUNCT3_SLT: return reg<slt>;
+                    case FUNCT3_SLTU: return reg<sltu>;
+                    case FUNCT3_XOR: return reg<xorOp>;
+                    case FUNCT3_SR:
+                        if (upperImm12 == FUNCT7_LOGICAL) return reg<srl>;
+                        if (upperImm12 == UPPERIMM_ARITH) return reg<sra>;
+                        return nullptr;
+                    case FUNCT3_OR: return reg<orOp>;
+                    case FUNCT3_AND: return reg<andOp>;
+                }
+                return nullptr;
+            case OP_INTW:
+                switch (inst.funct3) {
+                    case FUNCT3_ADD:
+                        if (inst.funct7 == FUNCT7_ADD) return reg<addw>;
+                        if (inst.funct7 == FUNCT7_SUB) return reg<subw>;
+                        return nullptr;
+                    case FUNCT3_SLL: return reg<sllw>;
+                    case FUNCT3_SR:
+                        if (upperImm12 == FUNCT7_LOGICAL) return reg<srlw>;
+                        if (upperImm12 == UPPERIMM_ARITH) return reg<sraw>;
+                        return nullptr;
+                }
+                return nullptr;
+            case OP_INTIMM:
+                switch (inst.funct3) {
+                    case FUNCT3_ADD: return imm<add>;
+                    case FUNCT3_SLL: return imm<sll>;
+                    case FUNCT3_SLT: return imm<slt>;
+                    case FUNCT3_SLTU: return imm<sltu>;
+                    case FUNCT3_XOR: return imm<xorOp>;
+                    case FUNCT3_SR:
+                        if (upperImm12 == UPPERIMM_LOGICAL) return imm<srl>;
+                        if (upperImm12 == UPPERIMM_ARITH) return imm<sra>;
+                        return nullptr;
+                    case FUNCT3_OR: return imm<orOp>;
+                    case FUNCT3_AND: return imm<andOp>;
+                }
+                return nullptr;
+            case OP_INTIMMW:
+                switch (inst.funct3) {
+                    case FUNCT3_ADD: return imm<addw>;
+                    case FUNCT3_SLL: return imm<sllw>;
+                    case FUNCT3_SR:
+                        if (upperImm12 == UPPERIMM_LOGICAL) return imm<srlw>;
+                        if (upperImm12 == UPPERIMM_ARITH) return imm<sraw>;
+                        return nullptr;
+                }
+                return nullptr;
+            case OP_LOAD:
+                switch (inst.funct3) {
+                    case FUNCT3_B: return load<BYTE_SIZE, true>;
+                    case FUNCT3_H: return load<HALF_SIZE, true>;
+                    case FUNCT3_W: return load<WORD_SIZE, true>;
+                    case FUNCT3_D: return load<DOUBLE_SIZE, false>;
+                    case FUNCT3_BU: return load<BYTE_SIZE, false>;
+                    case FUNCT3_HU: return load<HALF_SIZE, false>;
+                    case FUNCT3_WU: return load<WORD_SIZE, false>;
+                }
+                return nullptr;
+            case OP_STORE:
+                switch (inst.funct3) {
+                    case FUNCT3_B: return store<BYTE_SIZE>;
+                    case FUNCT3_H: return store<HALF_SIZE>;
+                    case FUNCT3_W: return store<WORD_SIZE>;
+                    case FUNCT3_D: return store<DOUBLE_SIZE>;
+                }
+                return nullptr;
+            case OP_BRANCH:
+                switch (inst.funct3) {
+                    case FUNCT3_BEQ: return branch<beq>;
+                    case FUNCT3_BNE: return branch<bne>;
+                    case FUNCT3_BLT: return branch<blt>;
+                    case FUNCT3_BGE: return branch<bge>;
+                    case FUNCT3_BLTU: return branch<bltu>;
+                    case FUNCT3_BGEU: return branch<bgeu>;
+                }
+                return nullptr;
+            case OP_LUI: return lui;
+            case OP_AUIPC: return auipc;
+            case OP_JAL: return jal;
+            case OP_JALR: return jalr;
+        }
+        return nullptr;
+    }
+};
+
+ThreadedEngine::ThreadedEngine(Simulator& sim)
+    : simulator(sim),
+      memory(sim.memory),
+      registers(sim.regData.registers),
+      lookup(ENGINE_BLOCK_LOOKUP, nullptr),
+      codeLow(UINT64_MAX),
+      codeHigh(0),
+      leaveBlock(false),
+      codeModified(false),
+      stopStatus(SUCCESS),
+      stopPC(0),
+      genericOps(0) {}
+
+// Fill op for the instruction at PC. Returns true if the op ends its block: control
+// transfers and the generic ops, whose next PC is only known once they ran.
+bool ThreadedEngine::translateOne(uint64_t PC, Op& op) {
+    op = Op();
+    op.PC = PC;
+    op.handler = EngineHandlers::generic;
+
+    // fetches outside the memory are left to simInstruction, which reports them
+    uint64_t instruction;
+    if (!memory->contains(PC, WORD_SIZE)) return true;
+    memory->getMemValue<WORD_SIZE>(PC, instruction);
+
+    Simulator::Instruction inst;
+    inst.PC = PC;
+    inst.instruction = (uint32_t)instruction;
+    simulator.simDecode(inst);
+    if (!inst.isLegal || inst.isHalt) return true;
+
+    Handler handler = EngineHandlers::select(inst);
+    if (!handler) return true;
+    op.handler = handler;
+    op.rd = inst.rd;
+    op.rs1 = inst.rs1;
+    op.rs2 = inst.rs2;
+    bool transfer = inst.opcode == OP_BRANCH || inst.opcode == OP_JAL || inst.opcode == OP_JALR;
+    op.imm = (inst.opcode == OP_BRANCH || inst.opcode == OP_JAL) ? inst.target : inst.imm;
+    return transfer;
+}
+
+void ThreadedEngine::translate(Block& block) {
+    uint64_t PC = block.PC;
+    bool ends = false;
+    while (!ends && block.ops.size() < ENGINE_MAX_BLOCK) {
+        Op op;
+        ends = translateOne(PC, op);
+        block.ops.push_back(op);
+        codeLow = std::min(codeLow, PC);
+        codeHigh = std::max(codeHigh, PC + 4);
+        PC += 4;
+    }
+}
+
+ThreadedEngine::Block& ThreadedEngine::getBlock(uint64_t PC) {
+    Block*& slot = lookup[(PC >> 2) & (ENGINE_BLOCK_LOOKUP - 1)];
+    if (slot && slot->PC == PC) return *slot;
+
+    // the blocks of the map never move, so the lookup can point into it
+    Block& block = blocks[PC];
+    if (block.ops.empty()) {
+        block.PC = PC;
+        translate(block);
+    }
+    slot = &block;
+    return block;
+}
+
+void ThreadedEngine::flush() {
+    blocks.clear();
+    std::fill(lookup.begin(), lookup.end(), nullptr);
+    codeLow = UINT64_MAX;
+    codeHigh = 0;
+    codeModified = false;
+}
+
+// Keep the pre-decoded instructions of the simulator and the translations in sync
+// with a store to [address, address + size). A store into translated code ends the
+// block, all translations are dropped before the next one starts.
+void ThreadedEngine::stored(uint64_t address, uint64_t size) {
+    simulator.invalidateDecoded(address, size);
+    if (address < codeHigh && (address >= codeLow || codeLow - address < size)) {
+        codeModified = true;
+        leaveBlock = true;
+    }
+}
+
+Status ThreadedEngine::run(uint64_t& PC, uint64_t instructions) {
+    uint64_t executed = 0;
+    genericOps = 0;
+    stopStatus = SUCCESS;
+
+    while (stopStatus == SUCCESS && (instructions == 0 || executed < instructions)) {
+        if (codeModified) flush();
+        Block& block = getBlock(PC);
+
+        uint64_t count = block.ops.size();
+        if (instructions != 0) count = std::min(count, instructions - executed);
+        const Op* op = block.ops.data();
+        const Op* end = op + count;
+        leaveBlock = false;
+        while (op != end) {
+            PC = op->handler(*this, *op);
+            op++;
+            if (leaveBlock) break;
+        }
+        executed += op - block.ops.data();
+    }
+
+    // the generic ops were counted by simInstruction already
+    simulator.din += executed - genericOps;
+    return stopStatus;
+}
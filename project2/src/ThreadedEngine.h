@@ -0,0 +1,86 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryStore.h"
+#include "Utilities.h"
+#include "simulator.h"
+
+// Longest basic block translated in one piece
+#define ENGINE_MAX_BLOCK 64
+// Number of entries of the direct-mapped block lookup (a power of 2)
+#define ENGINE_BLOCK_LOOKUP 4096
+
+// A fast functional engine, architecturally identical to Simulator::simInstruction.
+// Code is translated one basic block at a time into an array of operations, each a
+// pointer to the handler of its exact instruction plus the operands pre-extracted
+// from the encoding. Executing a block is a tight loop of indirect calls (call
+// threading), without the generic decode and ALU switches on the way.
+//
+// Anything out of the ordinary (the halt instruction, illegal encodings, fetches
+// outside the memory) is run through simInstruction itself, so its behavior and
+// error reporting stay exactly the same. Stores into translated code drop all
+// translations, which makes self-modifying code behave as in simInstruction.
+class ThreadedEngine {
+   public:
+    struct Op;
+    // executes op and returns the next PC
+    typedef uint64_t (*Handler)(ThreadedEngine& engine, const Op& op);
+
+    struct Op {
+        Handler handler;
+        uint64_t PC;
+        uint64_t imm;  // immediate, branch/jump target or shift amount
+        uint8_t rd;
+        uint8_t rs1;
+        uint8_t rs2;
+    };
+
+   private:
+    struct Block {
+        uint64_t PC;
+        std::vector<Op> ops;
+    };
+
+    Simulator& simulator;
+    MemoryStore* memory;
+    uint64_t* registers;
+
+    std::unordered_map<uint64_t, Block> blocks;
+    std::vector<Block*> lookup;
+    uint64_t codeLow;  // [codeLow, codeHigh) covers all translated instructions
+    uint64_t codeHigh;
+
+    // set by a handler to leave the block after its operation
+    bool leaveBlock;
+    bool codeModified;
+    Status stopStatus;       // HALT or ERROR once a generic op stopped, else SUCCESS
+    uint64_t stopPC;         // PC of the instruction that stopped
+    uint64_t genericOps;     // executed through simInstruction, which counts them in din
+
+    Block& getBlock(uint64_t PC);
+    void translate(Block& block);
+    bool translateOne(uint64_t PC, Op& op);
+    void flush();
+
+    // handlers share these, see ThreadedEngine.cpp
+    void setRd(uint8_t rd, uint64_t value) {
+        registers[rd] = value;
+        registers[0] = 0;
+    }
+    void stored(uint64_t address, uint64_t size);
+    friend struct EngineHandlers;
+
+   public:
+    // runs on the registers, memory and din of simulator
+    explicit ThreadedEngine(Simulator& simulator);
+
+    // Run from PC for a certain number of instructions, 0 runs until halt or error.
+    // PC is left at the next instruction, as the loop over simInstruction leaves it.
+    // Return SUCCESS after the instructions, HALT on 0xfeedfeed and ERROR on an
+    // illegal instruction.
+    Status run(uint64_t& PC, uint64_t instructions);
+
+    // after run returned HALT or ERROR: the PC of the halt or illegal instruction
+    uint64_t getStopPC() const { return stopPC; }
+};
@@ -207,6 +207,15 @@ uint64_t sext64(uint64_t imm, int signBit) {
     return (imm & (1ULL << signBit)) ? imm | (~0ULL << (signBit + 1)) : imm;
 }
 
+uint64_t log2Int(uint64_t value) {
+    uint64_t bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
 static void handleIAndR(uint64_t curInst, std::ostream &out_stream) {
     uint64_t opcode = extractBits(curInst, 6, 0);
     uint64_t rd = extractBits(curInst, 11, 7);
@@ -348,18 +357,16 @@ static void printIFPC(uint64_t pc, StageStatus status, std::ostream &pipeState)
     pipeState << std::left << std::setw(25) << sb.str();
 }
 
-static void printInstr(uint32_t curInst, StageStatus status, std::ostream &pipeState) {
-    std::ostringstream sb;
+// format curInst with a leading space, as the pipe state shows it
+static void formatInstr(uint32_t curInst, std::ostream &sb) {
     if (curInst == 0xfeedfeed) {
-        sb << " HALT" << stageStatusStr.at(status);
-        pipeState << std::left << std::setw(25) << sb.str();
+        sb << " HALT";
         return;
     // } else if (curInst == 0xdeefdeef) {
-    //     pipeState << std::left << std::setw(25) << " UNKNOWN ";
+    //     sb << " UNKNOWN";
     //     return;
     } else if (curInst == 0x00000013) {
-        sb << " NOP" << stageStatusStr.at(status);
-        pipeState << std::left << std::setw(25) << sb.str();
+        sb << " NOP";
         return;
     }
 
@@ -392,37 +399,34 @@ static void printInstr(uint32_t curInst, StageStatus status, std::ostream &pipeS
             // except for the case with a 0 opcode and illegal function.
             sb << " ILLEGAL";
     }
+}
+
+static void printInstr(uint32_t curInst, StageStatus status, std::ostream &pipeState) {
+    std::ostringstream sb;
+    formatInstr(curInst, sb);
     sb << stageStatusStr.at(status);
     pipeState << std::left << std::setw(25) << sb.str();
 }
 
-Status dumpPipeState(PipeState &state, const std::string &base_output_name) {
-    static auto fileInit = false;
-    auto fileOp = std::ios::app;
-    if (!fileInit) {
-        fileOp = std::ios::out;
-        fileInit = true;
-    }
-    std::ofstream pipe_out(base_output_name + "_pipe_state.out", fileOp);
-
-    if (pipe_out) {
-        pipe_out << "Cycle: " << std::setw(8) << state.cycle << "\t|";
-        pipe_out << "|";
-        printIFPC(state.ifPC, state.ifStatus, pipe_out);
-        pipe_out << "|";
-        printInstr(state.idInstr, state.idStatus, pipe_out);
-        pipe_out << "|";
-        printInstr(state.exInstr, state.exStatus, pipe_out);
-        pipe_out << "|";
-        printInstr(state.memInstr, state.memStatus, pipe_out);
-        pipe_out << "|";
-        printInstr(state.wbInstr, state.wbStatus, pipe_out);
-        pipe_out << "|" << std::endl;
-        return SUCCESS;
-    } else {
-        std::cerr << LOG_ERROR << "Could not open pipe state file!" << std::endl;
-        return ERROR;
-    }
+std::string disassemble(uint32_t instruction) {
+    std::ostringstream sb;
+    formatInstr(instruction, sb);
+    return sb.str().substr(1);
+}
+
+void printPipeState(const PipeState &state, std::ostream &pipe_out) {
+    pipe_out << "Cycle: " << std::setw(8) << state.cycle << "\t|";
+    pipe_out << "|";
+    printIFPC(state.ifPC, state.ifStatus, pipe_out);
+    pipe_out << "|";
+    printInstr(state.idInstr, state.idStatus, pipe_out);
+    pipe_out << "|";
+    printInstr(state.exInstr, state.exStatus, pipe_out);
+    pipe_out << "|";
+    printInstr(state.memInstr, state.memStatus, pipe_out);
+    pipe_out << "|";
+    printInstr(state.wbInstr, state.wbStatus, pipe_out);
+    pipe_out << "|";
 }
 
 Status dumpSimStats(SimulationStats &stats, const std::string &base_output_name) {
@@ -142,8 +142,14 @@ uint32_t sext32(uint32_t imm, int signBit);
 // sign extend imm to a 64 bit unsigned int
 uint64_t sext64(uint64_t imm, int signBit);
 
+// floor(log2(value)), the bits of a power-of-2 cache geometry
+uint64_t log2Int(uint64_t value);
+
 // Implemented in UtilityFunctions.o
-Status dumpPipeState(PipeState& state, const std::string& base_output_name);
+// Disassemble one instruction as the pipe state shows it, e.g. "addi t0, zero, 60"
+std::string disassemble(uint32_t instruction);
+// Format one pipe state line (without the trailing newline)
+void printPipeState(const PipeState& state, std::ostream& pipe_out);
 Status dumpSimStats(SimulationStats& stats, const std::string& base_output_name);
 
 // handle output file names
@@ -3,124 +3,561 @@
 
 #include "cache.h"
 #include <random>
+#include <sstream>
 #include <vector>
 
 using namespace std;
 
-// Random generator for cache hit/miss simulation
-static std::mt19937 generator(42);  // Fixed seed for deterministic results
-std::uniform_real_distribution<double> distribution(0.0, 1.0);
+static const char* const replacementNames[] = {"lru", "plru", "srrip", "brrip", "fifo", "random"};
 
-// Constructor definition
-Cache::Cache(CacheConfig configParam, CacheDataType cacheType) : config(configParam) {
-    // Here you can initialize other cache-specific attributes
-    // For instance, if you had cache tables or other structures, initialize them here
-    
+const char* replacementName(ReplacementPolicy policy) {
+    return replacementNames[policy];
+}
+
+static const char* const prefetchNames[] = {"none", "next-line", "stride", "stream"};
+
+const char* prefetchName(PrefetchKind kind) {
+    return prefetchNames[kind];
+}
+
+static const char* const writePolicyNames[] = {"none", "write-back", "write-through",
+                                               "write-buffer"};
+
+const char* writePolicyName(WritePolicy policy) {
+    return writePolicyNames[policy];
+}
+
+// apply one "<key> <value>" line of the optional cache_config.txt section
+static void setCacheOption(CacheConfig& config, const std::string& key, const std::string& value) {
+    if (key == "replacement") {
+        for (int i = REPL_LRU; i <= REPL_RANDOM; i++) {
+            if (value == replacementNames[i]) {
+                config.replacement = static_cast<ReplacementPolicy>(i);
+                return;
+            }
+        }
+        throw std::invalid_argument("Unknown replacement policy: " + value);
+    } else if (key == "seed") {
+        config.seed = std::stoull(value, nullptr, 0);
+    } else if (key == "prefetch") {
+        for (int i = PREFETCH_NONE; i <= PREFETCH_STREAM; i++) {
+            if (value == prefetchNames[i]) {
+                config.prefetch = static_cast<PrefetchKind>(i);
+                return;
+            }
+        }
+        throw std::invalid_argument("Unknown prefetcher: " + value);
+    } else if (key == "prefetch_degree") {
+        config.prefetchDegree = std::stoull(value, nullptr, 0);
+        if (config.prefetchDegree == 0) {
+            throw std::invalid_argument("prefetch_degree must be at least 1");
+        }
+    } else if (key == "write_policy") {
+        for (int i = WRITE_NONE; i <= WRITE_BUFFER; i++) {
+            if (value == writePolicyNames[i]) {
+                config.writePolicy = static_cast<WritePolicy>(i);
+                return;
+            }
+        }
+        throw std::invalid_argument("Unknown write policy: " + value);
+    } else if (key == "write_buffer") {
+        config.writeBufferEntries = std::stoull(value, nullptr, 0);
+        if (config.writeBufferEntries == 0) {
+            throw std::invalid_argument("write_buffer must be at least 1");
+        }
+    } else {
+        throw std::invalid_argument("Unknown cache config key: " + key);
+    }
+}
+
+// apply one "<key> <value>" line of a lower level, "l2.size 262144"
+static void setLevelOption(CacheConfig& config, const std::string& key, const std::string& value) {
+    if (key == "size") {
+        config.cacheSize = std::stoull(value, nullptr, 0);
+    } else if (key == "block") {
+        config.blockSize = std::stoull(value, nullptr, 0);
+    } else if (key == "ways") {
+        config.ways = std::stoull(value, nullptr, 0);
+    } else if (key == "latency") {
+        config.missLatency = std::stoull(value, nullptr, 0);
+    } else {
+        setCacheOption(config, key, value);
+    }
+}
+
+static void setMemoryOption(HierarchyConfig& hierarchy, const std::string& key,
+                            const std::string& value) {
+    if (key == "latency") {
+        hierarchy.memoryLatency = std::stoull(value, nullptr, 0);
+    } else if (key == "bandwidth") {
+        hierarchy.memoryBandwidth = std::stoull(value, nullptr, 0);
+    } else {
+        throw std::invalid_argument("Unknown memory config key: " + key);
+    }
+}
+
+static bool isPowerOf2(uint64_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+void parseCacheConfig(std::istream& file, CacheConfig& icConfig, CacheConfig& dcConfig) {
+    HierarchyConfig hierarchy;
+    parseCacheConfig(file, icConfig, dcConfig, hierarchy);
+    if (!hierarchy.empty()) {
+        throw std::invalid_argument("Only the L1 caches are supported here, not l2., l3. or "
+                                    "memory. keys");
+    }
+}
+
+void parseCacheConfig(std::istream& file, CacheConfig& icConfig, CacheConfig& dcConfig,
+                      HierarchyConfig& hierarchy) {
+    int line = 0;
+    auto parseNextLine = [&](const char* name) -> uint32_t {
+        line++;
+        uint32_t value;
+        if (!(file >> value)) {
+            std::stringstream errorMessage;
+            errorMessage << "Failed to parse property at line " << line << " for property "
+                         << name;
+            throw std::invalid_argument(errorMessage.str());
+        }
+        std::string discard;
+        std::getline(file, discard);  // discard rest of the line
+        return value;
+    };
+
+    icConfig.cacheSize = parseNextLine("ICache cache size");
+    icConfig.blockSize = parseNextLine("ICache block size");
+    icConfig.ways = parseNextLine("ICache ways");
+    icConfig.missLatency = parseNextLine("ICache miss latency");
+
+    dcConfig.cacheSize = parseNextLine("DCache cache size");
+    dcConfig.blockSize = parseNextLine("DCache block size");
+    dcConfig.ways = parseNextLine("DCache ways");
+    dcConfig.missLatency = parseNextLine("DCache miss latency");
+
+    // optional "icache.<key> <value>" / "dcache.<key> <value>" lines, the lower
+    // levels start out with no geometry
+    const CacheConfig noLevel = {0, 0, 0, 0};
+    CacheConfig levels[MAX_LOWER_LEVELS] = {noLevel, noLevel};
+    bool levelPolicies[MAX_LOWER_LEVELS] = {false, false};
+    hierarchy = HierarchyConfig();
+    std::string key, value, discard;
+    while (file >> key) {
+        line++;
+        if (key[0] == '#') {
+            std::getline(file, discard);
+            continue;
+        }
+        if (!(file >> value)) {
+            std::stringstream errorMessage;
+            errorMessage << "Missing value at line " << line << " for " << key;
+            throw std::invalid_argument(errorMessage.str());
+        }
+        std::getline(file, discard);
+
+        size_t dot = key.find('.');
+        std::string prefix = key.substr(0, dot);
+        std::string option = dot == std::string::npos ? "" : key.substr(dot + 1);
+        if (dot != std::string::npos && (prefix == "icache" || prefix == "dcache")) {
+            setCacheOption(prefix == "icache" ? icConfig : dcConfig, option, value);
+        } else if (dot != std::string::npos && (prefix == "l2" || prefix == "l3")) {
+            setLevelOption(levels[prefix == "l2" ? 0 : 1], option, value);
+            if (option == "write_policy") levelPolicies[prefix == "l2" ? 0 : 1] = true;
+        } else if (dot != std::string::npos && prefix == "memory") {
+            setMemoryOption(hierarchy, option, value);
+        } else {
+            throw std::invalid_argument(
+                "Cache config key must start with icache., dcache., l2., l3. or memory.: " + key);
+        }
+    }
+
+    // a level is there once it has a size, an L3 needs an L2 in front of it
+    for (int i = 0; i < MAX_LOWER_LEVELS; i++) {
+        CacheConfig& level = levels[i];
+        std::string name = "l" + std::to_string(i + 2);
+        if (level.cacheSize == 0 && level.blockSize == 0 && level.ways == 0) continue;
+        if (!isPowerOf2(level.cacheSize) || !isPowerOf2(level.blockSize) ||
+            !isPowerOf2(level.ways) || level.cacheSize < level.blockSize * level.ways) {
+            throw std::invalid_argument(name + " needs a power-of-2 size, block and ways");
+        }
+        if (hierarchy.levels.size() != (size_t)i) {
+            throw std::invalid_argument(name + " needs the levels in front of it");
+        }
+        if (level.prefetch != PREFETCH_NONE) {
+            throw std::invalid_argument("Only the L1 caches prefetch, not " + name);
+        }
+        if (level.writePolicy == WRITE_BUFFER) {
+            throw std::invalid_argument("Only the D-cache has a write buffer, use " + name +
+                                        ".write_policy write-through");
+        }
+        // the writes of a D-cache with a write policy reach every level: one that took
+        // them as reads would drop them before the memory
+        if (dcConfig.writePolicy != WRITE_NONE && level.writePolicy == WRITE_NONE) {
+            if (levelPolicies[i]) {
+                throw std::invalid_argument(name + ".write_policy none drops the writes of "
+                                            "the D-cache, use write-back or write-through");
+            }
+            level.writePolicy = WRITE_BACK;
+        }
+        hierarchy.levels.push_back(level);
+    }
+
+    // the stride prefetcher is indexed by the PC of a load or store
+    if (icConfig.prefetch == PREFETCH_STRIDE) {
+        throw std::invalid_argument("icache.prefetch stride needs load/store PCs, use next-line");
+    }
+    if (icConfig.writePolicy != WRITE_NONE) {
+        throw std::invalid_argument("The I-cache is never written, it takes no write_policy");
+    }
+
+    std::vector<const CacheConfig*> configs = {&icConfig, &dcConfig};
+    for (const CacheConfig& level : hierarchy.levels) configs.push_back(&level);
+    for (const CacheConfig* config : configs) {
+        if (config->replacement == REPL_PLRU && (!isPowerOf2(config->ways) || config->ways > 64)) {
+            throw std::invalid_argument("plru needs a power-of-2 number of ways up to 64");
+        }
+    }
+}
+
+// Replacement policies. onHit and onFill update the state of a way after a hit or
+// after a block was placed in it; victim picks the way to evict from a full set.
+
+// true LRU: the way with the oldest access timestamp
+struct Cache::LRUPolicy {
+    static void onHit(Cache& cache, uint64_t, CacheLine* set, uint64_t way) {
+        set[way].meta = ++cache.time;
+    }
+    static void onFill(Cache& cache, uint64_t, CacheLine* set, uint64_t way) {
+        set[way].meta = ++cache.time;
+    }
+    static uint64_t victim(Cache& cache, uint64_t, CacheLine* set) {
+        uint64_t victim = 0;
+        for (uint64_t i = 1; i < cache.config.ways; i++) {
+            victim = set[i].meta < set[victim].meta ? i : victim;
+        }
+        return victim;
+    }
+};
+
+// FIFO: like LRU, but only the fill time counts
+struct Cache::FIFOPolicy {
+    static void onHit(Cache&, uint64_t, CacheLine*, uint64_t) {}
+    static void onFill(Cache& cache, uint64_t index, CacheLine* set, uint64_t way) {
+        LRUPolicy::onFill(cache, index, set, way);
+    }
+    static uint64_t victim(Cache& cache, uint64_t index, CacheLine* set) {
+        return LRUPolicy::victim(cache, index, set);
+    }
+};
+
+// Tree pseudo-LRU. The ways are the leaves of a binary tree stored heap-style in
+// the per-set word: node n has children 2n and 2n+1, leaf ways + w is way w. A
+// node bit of 1 means the pseudo-LRU way is in the right subtree.
+struct Cache::PLRUPolicy {
+    static void onHit(Cache& cache, uint64_t index, CacheLine*, uint64_t way) {
+        // point every node on the path away from the accessed way
+        uint64_t& bits = cache.setState[index];
+        for (uint64_t node = cache.config.ways + way; node > 1; node >>= 1) {
+            uint64_t parentBit = 1ULL << (node >> 1);
+            bits = (node & 1) ? (bits & ~parentBit) : (bits | parentBit);
+        }
+    }
+    static void onFill(Cache& cache, uint64_t index, CacheLine* set, uint64_t way) {
+        onHit(cache, index, set, way);
+    }
+    static uint64_t victim(Cache& cache, uint64_t index, CacheLine*) {
+        uint64_t bits = cache.setState[index];
+        uint64_t node = 1;
+        while (node < cache.config.ways) node = 2 * node + ((bits >> node) & 1);
+        return node - cache.config.ways;
+    }
+};
+
+// 2-bit re-reference prediction values: 0 is near-immediate, RRPV_MAX distant
+static const uint64_t RRPV_MAX = 3;
+
+// SRRIP (hit promotion): hits predict a near re-reference, fills a long one
+struct Cache::SRRIPPolicy {
+    static void onHit(Cache&, uint64_t, CacheLine* set, uint64_t way) { set[way].meta = 0; }
+    static void onFill(Cache&, uint64_t, CacheLine* set, uint64_t way) {
+        set[way].meta = RRPV_MAX - 1;
+    }
+    static uint64_t victim(Cache& cache, uint64_t, CacheLine* set) {
+        // age the whole set until some way is predicted distant, in a single step,
+        // then evict the first distant way
+        uint64_t oldest = 0;
+        for (uint64_t i = 0; i < cache.config.ways; i++) {
+            oldest = set[i].meta > oldest ? set[i].meta : oldest;
+        }
+        uint64_t aging = RRPV_MAX - oldest;
+        uint64_t victim = cache.config.ways;
+        for (uint64_t i = cache.config.ways; i-- > 0;) {
+            set[i].meta += aging;
+            victim = set[i].meta == RRPV_MAX ? i : victim;
+        }
+        return victim;
+    }
+};
 
+// BRRIP: SRRIP with distant fills, only one in 32 fills is predicted long
+struct Cache::BRRIPPolicy {
+    static void onHit(Cache& cache, uint64_t index, CacheLine* set, uint64_t way) {
+        SRRIPPolicy::onHit(cache, index, set, way);
+    }
+    static void onFill(Cache& cache, uint64_t, CacheLine* set, uint64_t way) {
+        set[way].meta = cache.generator() % 32 == 0 ? RRPV_MAX - 1 : RRPV_MAX;
+    }
+    static uint64_t victim(Cache& cache, uint64_t index, CacheLine* set) {
+        return SRRIPPolicy::victim(cache, index, set);
+    }
+};
+
+// random: any way of the set, from the per-cache seeded generator
+struct Cache::RandomPolicy {
+    static void onHit(Cache&, uint64_t, CacheLine*, uint64_t) {}
+    static void onFill(Cache&, uint64_t, CacheLine*, uint64_t) {}
+    static uint64_t victim(Cache& cache, uint64_t, CacheLine*) {
+        return cache.generator() % cache.config.ways;
+    }
+};
+
+// Constructor definition
+Cache::Cache(CacheConfig configParam, CacheDataType cacheType)
+    : generator(static_cast<std::mt19937::result_type>(configParam.seed)), config(configParam) {
     hits=0;
     misses=0;
+    prefetches = usefulPrefetches = uselessPrefetches = 0;
+    prefetchHit = false;
+    writeBacks = 0;
+    writeBack = false;
+    writeBackAddress = 0;
     type = cacheType;
     time=0;
 
     // Initialize cache structures
-    numBlocks = config.cacheSize/config.blockSize;
-    numSets = numBlocks/config.ways;
-    
-
     // cacheSize/blockSize gives number of blocks
     // (cacheSize/blockSize)/ways gives number of sets
     // configParam.ways gives number of blocks per set
-    cacheArray.assign(numSets, vector<uint64_t>(config.ways, 0));
-
-    // follows from above, every entry is set to false initially
-    validBits.assign(numSets,vector<bool>(config.ways, false));
+    numBlocks = config.cacheSize/config.blockSize;
+    numSets = numBlocks/config.ways;
 
-    // initialize LRU counters to 0, there is one counter per set
-    LRUCounter.assign(numSets, vector<uint64_t>(config.ways, 0));
+    // every block starts out invalid
+    lines.assign(numSets * config.ways, CacheLine{0, 0, 0, 0, 0});
+    if (config.replacement == REPL_PLRU) setState.assign(numSets, 0);
 
+    // tag, index, block offset sizes
+    blockOffsetBits = log2Int(config.blockSize);
+    indexBits = log2Int(numSets);
+    indexMask = (1ULL << indexBits) - 1;
 }
 
-// Access method definition
-bool Cache::access(uint64_t address, CacheOperation readWrite) {
+void Cache::saveState(CheckpointWriter& out) const {
+    out.put(config.cacheSize);
+    out.put(config.blockSize);
+    out.put(config.ways);
+    out.put(config.missLatency);
+    out.put(config.replacement);
+    out.put(config.seed);
+    out.put(config.writePolicy);
+    out.put(hits);
+    out.put(misses);
+    out.put(prefetches);
+    out.put(usefulPrefetches);
+    out.put(uselessPrefetches);
+    out.put(writeBacks);
+    out.put(time);
+    out.put(lines.size());
+    for (const CacheLine& line : lines) {
+        out.put(line.tag);
+        out.put(line.meta | (uint64_t)line.dirty << 61 | (uint64_t)line.prefetched << 62 |
+                (uint64_t)line.valid << 63);
+    }
+    out.put(setState.size());
+    for (uint64_t state : setState) out.put(state);
+    std::ostringstream random;
+    random << generator;
+    out.putString(random.str());
+}
 
-    // find tag, index, block offset sizes
-    uint64_t blockOffsetBits = log2(config.blockSize);
-    uint64_t indexBits = log2(numSets); // not sure of the signature
-    // uint64_t tagBits = 64 - blockOffsetBits - indexBits;
+bool Cache::restoreState(CheckpointReader& in) {
+    CacheConfig saved;
+    saved.cacheSize = in.get();
+    saved.blockSize = in.get();
+    saved.ways = in.get();
+    saved.missLatency = in.get();
+    saved.replacement = static_cast<ReplacementPolicy>(in.get());
+    saved.seed = in.get();
+    saved.writePolicy = static_cast<WritePolicy>(in.get());
+    uint64_t savedHits = in.get();
+    uint64_t savedMisses = in.get();
+    uint64_t savedPrefetches[3];
+    for (uint64_t& count : savedPrefetches) count = in.get();
+    uint64_t savedWriteBacks = in.get();
+    uint64_t savedTime = in.get();
+    // the lines and set states of another geometry are read past as well
+    uint64_t numLines = in.get();
+    vector<CacheLine> savedLines;
+    for (uint64_t i = 0; i < numLines && !in.hasFailed(); i++) {
+        uint64_t tag = in.get();
+        uint64_t meta = in.get();
+        savedLines.push_back(CacheLine{tag, meta & ((1ULL << 61) - 1), (meta >> 61) & 1,
+                                       (meta >> 62) & 1, meta >> 63});
+    }
+    uint64_t numStates = in.get();
+    vector<uint64_t> savedState;
+    for (uint64_t i = 0; i < numStates && !in.hasFailed(); i++) savedState.push_back(in.get());
+    std::istringstream random(in.getString());
 
-    // extract tag, index, block offset from address
-    // uint64_t blockOffset = address & ((1 << blockOffsetBits) - 1);
-    uint64_t index = (address >> blockOffsetBits) & ((1 << indexBits) - 1);
-    uint64_t tag = address >> (blockOffsetBits + indexBits);
+    bool same = saved.cacheSize == config.cacheSize && saved.blockSize == config.blockSize &&
+                saved.ways == config.ways && saved.missLatency == config.missLatency &&
+                saved.replacement == config.replacement && saved.seed == config.seed &&
+                saved.writePolicy == config.writePolicy;
+    if (!same || in.hasFailed() || savedLines.size() != lines.size() ||
+        savedState.size() != setState.size()) {
+        return false;
+    }
+    hits = savedHits;
+    misses = savedMisses;
+    prefetches = savedPrefetches[0];
+    usefulPrefetches = savedPrefetches[1];
+    uselessPrefetches = savedPrefetches[2];
+    writeBacks = savedWriteBacks;
+    time = savedTime;
+    lines.swap(savedLines);
+    setState.swap(savedState);
+    random >> generator;
+    return true;
+}
 
-    // look for hit in the corresponding set
-    bool hit = false;
-    for(uint64_t i = 0; i < config.ways; i++) {
-        if(validBits[index][i] && (cacheArray[index][i] == tag)) {
-            hit = true;
-            hits++;
-            // update LRU counter
-            LRUCounter[index][i] = ++time;
-            return hit;
-        }
-    }
-
-    // on miss, increase miss count and replace LRU block
-    if(!hit){
-        misses++;
-
-        // look for an invalid block first
-        for(uint64_t i=0; i<config.ways; i++){
-            if(!validBits[index][i]){
-                cacheArray[index][i] = tag;
-                validBits[index][i] = true;
-                LRUCounter[index][i] = ++time;
-                return hit;
-            }
-        }
+// fill the first invalid block of set with tag; only a full set asks the policy for
+// a victim, which is written back if it is dirty
+template <class Policy>
+void Cache::fill(uint64_t index, CacheLine* set, uint64_t tag, bool prefetched, bool dirty) {
+    uint64_t way = config.ways;
+    for (uint64_t i = config.ways; i-- > 0;) {
+        way = set[i].valid ? way : i;
+    }
+    if (way == config.ways) way = Policy::victim(*this, index, set);
+    uselessPrefetches += set[way].valid & set[way].prefetched;
+    if (set[way].valid && set[way].dirty) {
+        writeBacks++;
+        writeBack = true;
+        writeBackAddress = ((set[way].tag << indexBits) | index) << blockOffsetBits;
+    }
+    set[way].tag = tag;
+    set[way].valid = 1;
+    set[way].dirty = dirty;
+    set[way].prefetched = prefetched;
+    Policy::onFill(*this, index, set, way);
+}
 
-        // if all blocks are valid, replace LRU block
-        uint64_t leastTime=LRUCounter[index][0];
-        uint64_t LRUBlock=0;
+template <class Policy>
+bool Cache::accessWith(uint64_t address, bool write) {
+    uint64_t index = getIndex(address);
+    CacheLine* set = &lines[index * config.ways];
+    uint64_t tag = getTag(address);
+    writeBack = false;
 
-        // find LRU block
-        for(uint64_t i=0; i<config.ways; i++){
-            if(LRUCounter[index][i]<leastTime){
-                leastTime = LRUCounter[index][i];
-                LRUBlock = i;
-            }
-        }
-        cacheArray[index][LRUBlock] = tag;
-        validBits[index][LRUBlock] = true;
-        LRUCounter[index][LRUBlock] = ++time;
-        return hit;
+    // look for hit in the corresponding set
+    uint64_t way = findWay(set, tag);
+    if (way < config.ways) {
+        hits++;
+        prefetchHit = set[way].prefetched;
+        usefulPrefetches += prefetchHit;
+        set[way].prefetched = 0;
+        set[way].dirty |= write && config.writePolicy == WRITE_BACK;
+        Policy::onHit(*this, index, set, way);
+        return true;
     }
 
-    // For simplicity, we're using a random boolean to simulate cache hit/miss
-    /*bool hit = distribution(generator) < 0.20;  // random 20% hit for a strange cache
-    hits += hit;
-    misses += !hit;*/
-    return hit;
+    // on miss, increase miss count and fill the block, unless a write goes past it
+    misses++;
+    prefetchHit = false;
+    if (write && (config.writePolicy == WRITE_THROUGH || config.writePolicy == WRITE_BUFFER)) {
+        return false;
+    }
+    fill<Policy>(index, set, tag, false, write && config.writePolicy == WRITE_BACK);
+    return false;
 }
 
+bool Cache::prefetch(uint64_t address) {
+    uint64_t index = getIndex(address);
+    CacheLine* set = &lines[index * config.ways];
+    uint64_t tag = getTag(address);
+    writeBack = false;
+    if (findWay(set, tag) < config.ways) return false;
 
-void Cache::invalidate(uint64_t address){
-    // find tag, index, block offset sizes
-    uint64_t blockOffsetBits = log2(config.blockSize);
-    uint64_t indexBits = log2(numSets); // not sure of the signature
-    // uint64_t tagBits = 64 - blockOffsetBits - indexBits;
+    prefetches++;
+    switch (config.replacement) {
+        case REPL_PLRU:
+            fill<PLRUPolicy>(index, set, tag, true, false);
+            break;
+        case REPL_SRRIP:
+            fill<SRRIPPolicy>(index, set, tag, true, false);
+            break;
+        case REPL_BRRIP:
+            fill<BRRIPPolicy>(index, set, tag, true, false);
+            break;
+        case REPL_FIFO:
+            fill<FIFOPolicy>(index, set, tag, true, false);
+            break;
+        case REPL_RANDOM:
+            fill<RandomPolicy>(index, set, tag, true, false);
+            break;
+        default:
+            fill<LRUPolicy>(index, set, tag, true, false);
+    }
+    return true;
+}
 
-    // extract tag, index, block offset from address
-    // uint64_t blockOffset = address & ((1 << blockOffsetBits) - 1);
-    uint64_t index = (address >> blockOffsetBits) & ((1 << indexBits) - 1);
-    uint64_t tag = address >> (blockOffsetBits + indexBits);
+// Access method definition
+bool Cache::access(uint64_t address, CacheOperation readWrite) {
+    switch (config.replacement) {
+        case REPL_PLRU:
+            return accessWith<PLRUPolicy>(address, readWrite == CACHE_WRITE);
+        case REPL_SRRIP:
+            return accessWith<SRRIPPolicy>(address, readWrite == CACHE_WRITE);
+        case REPL_BRRIP:
+            return accessWith<BRRIPPolicy>(address, readWrite == CACHE_WRITE);
+        case REPL_FIFO:
+            return accessWith<FIFOPolicy>(address, readWrite == CACHE_WRITE);
+        case REPL_RANDOM:
+            return accessWith<RandomPolicy>(address, readWrite == CACHE_WRITE);
+        default:
+            return accessWith<LRUPolicy>(address, readWrite == CACHE_WRITE);
+    }
+}
 
-    for(uint64_t i=0; i<config.ways; i++){
-        if(validBits[index][i] && cacheArray[index][i] == tag){
-            validBits[index][i] = false; // invalidate the block
-            break;
+
+bool Cache::invalidate(uint64_t address){
+    CacheLine* set = getSet(address);
+    uint64_t way = findWay(set, getTag(address));
+    writeBack = false;
+    if (way < config.ways) {
+        if (set[way].dirty) {
+            writeBacks++;
+            writeBack = true;
+            writeBackAddress = address >> blockOffsetBits << blockOffsetBits;
         }
+        set[way].valid = 0; // invalidate the block
+        set[way].meta = 0;
+        set[way].dirty = 0;
+        set[way].prefetched = 0;
+    }
+    return writeBack;
+}
+
+bool Cache::clean(uint64_t address) {
+    CacheLine* set = getSet(address);
+    uint64_t way = findWay(set, getTag(address));
+    writeBack = way < config.ways && set[way].dirty;
+    if (writeBack) {
+        writeBacks++;
+        writeBackAddress = address >> blockOffsetBits << blockOffsetBits;
+        set[way].dirty = 0;
     }
+    return writeBack;
 }
 
 // debug: dump information as you needed, here are some examples
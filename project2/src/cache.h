@@ -1,12 +1,51 @@
 #pragma once
 #include <inttypes.h>
 #include <iostream>
+#include <random>
+#include <string>
 #include <vector>
+#include "Checkpoint.h"
 #include "Utilities.h"
 #include <cmath>
 
 using namespace std;
 
+// Block replacement policy of a cache. Invalid ways are always filled first; the
+// policy only picks the victim among the valid ways of a full set.
+enum ReplacementPolicy {
+    REPL_LRU = 0,  // true LRU, per-way timestamp of the last access
+    REPL_PLRU,     // tree pseudo-LRU, ways - 1 bits per set (power-of-2 ways up to 64)
+    REPL_SRRIP,    // static re-reference interval prediction, 2-bit RRPV per way
+    REPL_BRRIP,    // bimodal RRIP, most fills are predicted distant
+    REPL_FIFO,     // oldest fill is replaced, hits do not update anything
+    REPL_RANDOM,   // uniformly random way from a seeded generator
+};
+
+// name used in cache_config.txt ("lru", "plru", "srrip", "brrip", "fifo", "random")
+const char* replacementName(ReplacementPolicy policy);
+
+// Hardware prefetcher of an L1 cache (see Prefetcher)
+enum PrefetchKind {
+    PREFETCH_NONE = 0,
+    PREFETCH_NEXT_LINE,  // the blocks following every new block accessed
+    PREFETCH_STRIDE,     // per load/store PC, once its address stride repeats
+    PREFETCH_STREAM,     // ahead of runs of misses to consecutive blocks
+};
+
+// name used in cache_config.txt ("none", "next-line", "stride", "stream")
+const char* prefetchName(PrefetchKind kind);
+
+// What a write does to a cache and the level behind it
+enum WritePolicy {
+    WRITE_NONE = 0,     // a write is handled as a read, nothing is ever written back
+    WRITE_BACK,         // write-allocate, dirty blocks are written back when evicted
+    WRITE_THROUGH,      // no-write-allocate, every write waits for the next level
+    WRITE_BUFFER,       // the same through a write buffer, a write only waits if it is full
+};
+
+// name used in cache_config.txt ("none", "write-back", "write-through", "write-buffer")
+const char* writePolicyName(WritePolicy policy);
+
 struct CacheConfig {
     // Cache size in bytes.
     uint64_t cacheSize;
@@ -16,22 +55,102 @@ struct CacheConfig {
     uint64_t ways;
     // Additional miss latency in cycles.
     uint64_t missLatency;
+    // Optional settings, given as "icache.<key> <value>" / "dcache.<key> <value>"
+    // lines after the eight numeric lines of cache_config.txt
+    ReplacementPolicy replacement = REPL_LRU;
+    // seed of the generator used by REPL_RANDOM and REPL_BRRIP
+    uint64_t seed = 42;
+    // L1 only: the prefetcher and the most blocks it fetches ahead per access
+    PrefetchKind prefetch = PREFETCH_NONE;
+    uint64_t prefetchDegree = 4;
+    // the write policy, and the entries of the write buffer of WRITE_BUFFER
+    WritePolicy writePolicy = WRITE_NONE;
+    uint64_t writeBufferEntries = 8;
     // debug: Overload << operator to allow easy printing of CacheConfig
     friend std::ostream& operator<<(std::ostream& os, const CacheConfig& config) {
         os << "CacheConfig { " << config.cacheSize << ", " << config.blockSize << ", "
-           << config.ways << ", " << config.missLatency << " }";
+           << config.ways << ", " << config.missLatency;
+        if (config.replacement != REPL_LRU) os << ", " << replacementName(config.replacement);
+        if (config.prefetch != PREFETCH_NONE) {
+            os << ", " << prefetchName(config.prefetch) << " x" << config.prefetchDegree;
+        }
+        if (config.writePolicy != WRITE_NONE) os << ", " << writePolicyName(config.writePolicy);
+        os << " }";
         return os;
     }
 };
 
+// Lower levels cache_config.txt can describe: l2 and l3
+#define MAX_LOWER_LEVELS 2
+
+// The unified levels behind the split L1 caches (see CacheHierarchy), given as
+// "l2.<key> <value>" / "l3.<key> <value>" and "memory.<key> <value>" lines of
+// cache_config.txt. Empty, an L1 miss costs just its missLatency.
+struct HierarchyConfig {
+    // L2 first; the missLatency of a level is the latency a lookup in it adds to a miss
+    // of the level above
+    std::vector<CacheConfig> levels;
+    // cycles added by a miss of the last level
+    uint64_t memoryLatency = 0;
+    // bytes the memory transfers per cycle, 0 for no limit
+    uint64_t memoryBandwidth = 0;
+
+    bool empty() const { return levels.empty() && memoryLatency == 0 && memoryBandwidth == 0; }
+};
+
 enum CacheDataType { I_CACHE = false, D_CACHE = true };
 enum CacheOperation { CACHE_READ = false, CACHE_WRITE = true };
 
+// Parse a cache_config.txt stream: the eight numeric lines (ICache size, block
+// size, ways, miss latency, then the same for the DCache) followed by optional
+// "icache.<key> <value>" lines; '#' starts a comment. Known keys are
+// "replacement", "seed", "prefetch", "prefetch_degree", "write_policy" and
+// "write_buffer", the lower levels also take "size", "block", "ways" and "latency",
+// the memory "latency" and "bandwidth". A lower level without a write_policy is
+// write-back if the D-cache has one. Throws std::invalid_argument on malformed input.
+void parseCacheConfig(std::istream& file, CacheConfig& icConfig, CacheConfig& dcConfig,
+                      HierarchyConfig& hierarchy);
+// the same for users of the L1 caches only, a hierarchy in the file is an error
+void parseCacheConfig(std::istream& file, CacheConfig& icConfig, CacheConfig& dcConfig);
+
+// One cache block. Tag, valid bit and replacement state are packed into 16 bytes
+// so that all ways of a set sit next to each other in memory.
+struct CacheLine {
+    uint64_t tag;
+    uint64_t meta : 61;        // policy state: LRU/FIFO timestamp or RRPV, 0 when invalid
+    uint64_t dirty : 1;        // written since the fill (WRITE_BACK)
+    uint64_t prefetched : 1;   // filled by a prefetch and not accessed since
+    uint64_t valid : 1;
+};
+
 class Cache {
 private:
     uint64_t hits, misses;    
     CacheDataType type;
     uint64_t time;
+    std::mt19937 generator;  // REPL_RANDOM victims and REPL_BRRIP insertions
+
+    // the replacement policies; each one provides static onHit/onFill/victim hooks
+    // that accessWith is instantiated with, so the hot path has no indirect calls
+    struct LRUPolicy;
+    struct PLRUPolicy;
+    struct SRRIPPolicy;
+    struct BRRIPPolicy;
+    struct FIFOPolicy;
+    struct RandomPolicy;
+    template <class Policy>
+    bool accessWith(uint64_t address, bool write);
+    template <class Policy>
+    void fill(uint64_t index, CacheLine* set, uint64_t tag, bool prefetched, bool dirty);
+
+    // prefetches filled, hit by a demand access, evicted before any
+    uint64_t prefetches, usefulPrefetches, uselessPrefetches;
+    bool prefetchHit;
+    // dirty blocks written back, whether the last access (or prefetch) evicted one and
+    // its address
+    uint64_t writeBacks;
+    bool writeBack;
+    uint64_t writeBackAddress;
 
 public:
     CacheConfig config;
@@ -42,23 +161,75 @@ public:
      * @return true for hit and false for miss
      * @param
      *      address: memory address
-     *      readWrite: true for read operation and false for write operation
+     *      readWrite: CACHE_READ or CACHE_WRITE, which only differ with a write policy
      */
     bool access(uint64_t address, CacheOperation readWrite);
+    // whether the last access hit a block a prefetch brought in, its first use
+    bool hitPrefetched() const { return prefetchHit; }
+    // whether the last access, prefetch or invalidate wrote a dirty block back, and
+    // the address of that block
+    bool wroteBack() const { return writeBack; }
+    uint64_t getWriteBackAddress() const { return writeBackAddress; }
+
+    // Bring the block of address in without a demand access (no hit or miss counted);
+    // false if it is there already
+    bool prefetch(uint64_t address);
 
     // debug: dump information as you needed
     Status dump(const std::string& base_output_name);
 
     // TODO: You may add more methods and fields as needed
 
-    uint64_t getHits() { return hits; }
-    uint64_t getMisses() { return misses; }
-    void invalidate(uint64_t address);
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+    uint64_t getPrefetches() const { return prefetches; }
+    uint64_t getUsefulPrefetches() const { return usefulPrefetches; }
+    uint64_t getUselessPrefetches() const { return uselessPrefetches; }
+    uint64_t getWriteBacks() const { return writeBacks; }
+    // restart the hit/miss, prefetch and write-back counts, the contents stay (after
+    // a warmup)
+    void resetStats() {
+        hits = misses = prefetches = usefulPrefetches = uselessPrefetches = writeBacks = 0;
+    }
 
-    vector<vector<uint64_t>> cacheArray; // model for cache
-    vector<vector<bool>> validBits; // valid bits for each cache block
-    vector<vector<uint64_t>> LRUCounter; // keeps track of LRU for each set
+    // Checkpoint section: the configuration, statistics, lines and replacement state.
+    // A cache of another configuration is left as it is, restoreState returns false.
+    void saveState(CheckpointWriter& out) const;
+    bool restoreState(CheckpointReader& in);
+    // whether the block of address is in the cache, nothing counted
+    bool contains(uint64_t address) {
+        return findWay(getSet(address), getTag(address)) < config.ways;
+    }
+    // drop the block of address; true if it was dirty and got written back first
+    bool invalidate(uint64_t address);
+    // write the block of address back if it is dirty and keep it, clean; true if it was
+    bool clean(uint64_t address);
+
+    // model for cache: numSets * ways lines, the ways of a set are contiguous
+    vector<CacheLine> lines;
+    // per-set replacement state shared by the ways (tree bits for REPL_PLRU)
+    vector<uint64_t> setState;
 
     uint64_t numSets;
     uint64_t numBlocks;
+
+    // address decomposition, computed once from the configuration
+    uint64_t blockOffsetBits;
+    uint64_t indexBits;
+    uint64_t indexMask;
+
+    uint64_t getIndex(uint64_t address) { return (address >> blockOffsetBits) & indexMask; }
+    CacheLine* getSet(uint64_t address) { return &lines[getIndex(address) * config.ways]; }
+    uint64_t getTag(uint64_t address) { return address >> (blockOffsetBits + indexBits); }
+
+    // way holding tag in set, config.ways if there is none
+    uint64_t findWay(const CacheLine* set, uint64_t tag) {
+        // every way is compared without an early exit; at most one can match
+        uint64_t way = config.ways;
+        for (uint64_t i = 0; i < config.ways; i++) {
+            bool match = set[i].valid & (set[i].tag == tag);
+            way = match ? i : way;
+        }
+        return way;
+    }
 };
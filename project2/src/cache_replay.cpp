@@ -0,0 +1,84 @@
+/** Replays a memory trace written with --mem-trace through the I- and D-caches of
+ * one or more cache configurations, in a single pass over the trace.
+ */
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "MemTrace.h"
+#include "Utilities.h"
+#include "cache.h"
+
+using namespace std;
+
+struct ReplayCaches {
+    std::string name;
+    Cache* iCache;
+    Cache* dCache;
+};
+
+static void printCache(const std::string& name, const char* type, Cache& cache,
+                       std::ostream& out) {
+    uint64_t accesses = cache.getHits() + cache.getMisses();
+    double missRate = accesses ? static_cast<double>(cache.getMisses()) / accesses : 0.0;
+    // the config path goes last, it may be of any length
+    out << std::left << std::setw(8) << type << std::right << std::setw(12) << accesses
+        << std::setw(12) << cache.getHits() << std::setw(12) << cache.getMisses()
+        << std::setw(10) << std::fixed << std::setprecision(4) << missRate << std::setw(14)
+        << cache.getMisses() * cache.config.missLatency << "  " << name << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        cerr << LOG_ERROR << "Usage: " << argv[0] << " <trace.mtr> <cache_config.txt>..."
+             << endl;
+        return ERROR;
+    }
+
+    std::vector<ReplayCaches> configs;
+    for (int i = 2; i < argc; i++) {
+        std::ifstream file(argv[i]);
+        if (!file.is_open()) {
+            cerr << LOG_ERROR << "Failed to open cache config file: " << argv[i] << endl;
+            return ERROR;
+        }
+        CacheConfig icConfig, dcConfig;
+        try {
+            parseCacheConfig(file, icConfig, dcConfig);
+        } catch (const std::exception& e) {
+            cerr << LOG_ERROR << argv[i] << ": " << e.what() << endl;
+            return ERROR;
+        }
+        configs.push_back({argv[i], new Cache(icConfig, I_CACHE), new Cache(dcConfig, D_CACHE)});
+    }
+
+    MemTraceReader trace;
+    if (trace.open(argv[1]) != SUCCESS) return ERROR;
+
+    for (uint64_t record : trace) {
+        uint64_t address = memTraceAddress(record);
+        MemTraceType type = memTraceType(record);
+        for (ReplayCaches& caches : configs) {
+            if (type == MEM_IFETCH) {
+                caches.iCache->access(address, CACHE_READ);
+            } else {
+                caches.dCache->access(address, type == MEM_WRITE ? CACHE_WRITE : CACHE_READ);
+            }
+        }
+    }
+
+    // stall cycles are estimated as misses * miss latency, the overlap of I- and
+    // D-cache stalls in the pipeline is not modeled
+    cout << std::left << std::setw(8) << "cache" << std::right << std::setw(12) << "accesses"
+         << std::setw(12) << "hits" << std::setw(12) << "misses" << std::setw(10) << "missRate"
+         << std::setw(14) << "stallCycles" << "  config" << endl;
+    for (ReplayCaches& caches : configs) {
+        printCache(caches.name, "icache", *caches.iCache, cout);
+        printCache(caches.name, "dcache", *caches.dCache, cout);
+        delete caches.iCache;
+        delete caches.dCache;
+    }
+    return SUCCESS;
+}
@@ -1,23 +1,20 @@
 #include "cycle.h"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
 
+#include "MemTrace.h"
+#include "MultiHart.h"
+#include "PipeTrace.h"
 #include "Utilities.h"
 #include "cache.h"
 #include "simulator.h"
+#include "sweep.h"
 
 #define EXCEPTION_HANDLER 0x8000
 
-static Simulator* simulator = nullptr;
-static Cache* iCache = nullptr;
-static Cache* dCache = nullptr;
-static std::string output;
-static uint64_t cycleCount = 0;
-
-static uint64_t PC = 0;
-
 /**TODO: Implement pipeline simulation for the RISCV machine in this file.
  * A basic template is provided below that doesn't account for any hazards.
  */
@@ -31,29 +28,131 @@ Simulator::Instruction nop(StageStatus status) {
     return nop;
 }
 
-static struct PipelineInfo {
-    Simulator::Instruction ifInst = nop(IDLE);
-    Simulator::Instruction idInst = nop(IDLE);
-    Simulator::Instruction exInst = nop(IDLE);
-    Simulator::Instruction memInst = nop(IDLE);
-    Simulator::Instruction wbInst = nop(IDLE);
-} pipelineInfo;
-
+CycleSimulator::CycleSimulator()
+    : statsFormat(STATS_TEXT),
+      cycleCount(0),
+      PC(0),
+      dualIssue(false),
+      latch(0),
+      iCacheStallCycles(0),
+      dCacheStallCycles(0),
+      loadReady(),
+      sharedLog(nullptr) {}
 
 // initialize the simulator
-Status initSimulator(CacheConfig& iCacheConfig, CacheConfig& dCacheConfig, MemoryStore* mem,
-                     const std::string& output_name) {
+Status CycleSimulator::init(CacheConfig& iCacheConfig, CacheConfig& dCacheConfig,
+                            MemoryStore* mem, const std::string& output_name,
+                            const CycleOptions& options) {
     output = output_name;
-    simulator = new Simulator();
+    simulator.reset(new Simulator());
     simulator->setMemory(mem);
-    iCache = new Cache(iCacheConfig, I_CACHE);
-    dCache = new Cache(dCacheConfig, D_CACHE);
+    iCache.reset(new Cache(iCacheConfig, I_CACHE));
+    dCache.reset(new Cache(dCacheConfig, D_CACHE));
+    hierarchy.reset(new CacheHierarchy(options.hierarchy));
+    iSweep.reset();
+    dSweep.reset();
+    if (!options.iCacheSweep.empty() || !options.dCacheSweep.empty()) {
+        iSweep.reset(new CacheSweep(options.iCacheSweep));
+        dSweep.reset(new CacheSweep(options.dCacheSweep));
+    }
+    profiler.reset(options.profile ? new Profiler() : nullptr);
+    predictor.reset(options.predictor.kind != PREDICT_NONE ? new BranchPredictor(options.predictor)
+                                                           : nullptr);
+    missHandler.reset(options.mshrs > 0
+                          ? new MissHandler(options.mshrs, options.storeBufferEntries, *dCache)
+                          : nullptr);
+    // an ideal L1 has nothing to prefetch for
+    iPrefetcher.reset(iCacheConfig.prefetch != PREFETCH_NONE && iCacheConfig.missLatency > 0
+                          ? new Prefetcher(iCacheConfig)
+                          : nullptr);
+    dPrefetcher.reset(dCacheConfig.prefetch != PREFETCH_NONE && dCacheConfig.missLatency > 0
+                          ? new Prefetcher(dCacheConfig)
+                          : nullptr);
+    // with MSHRs the store buffer is the write buffer
+    writeBuffer.assign(dCacheConfig.writePolicy == WRITE_BUFFER && !missHandler
+                           ? dCacheConfig.writeBufferEntries
+                           : 0,
+                       0);
+    std::fill(std::begin(loadReady), std::end(loadReady), 0);
+    stats.reset();
+    statsFormat = options.statsFormat;
+    cycleCount = 0;
+    PC = mem->getEntryPoint();
+    latch = 0;
+    pipeline[latch] = {nop(IDLE), nop(IDLE), nop(IDLE), nop(IDLE), nop(IDLE)};
+    dualIssue = options.dualIssue;
+    DualPipelineInfo& dual = dualPipeline[latch];
+    for (int slot = 0; slot < 2; slot++) {
+        dual.ifInst[slot] = dual.idInst[slot] = dual.exInst[slot] = nop(IDLE);
+        dual.memInst[slot] = dual.wbInst[slot] = nop(IDLE);
+    }
+    iCacheStallCycles = 0;
+    dCacheStallCycles = 0;
+
+    memTrace.close();
+    if (!options.memTrace.empty() && memTrace.open(options.memTrace) != SUCCESS) return ERROR;
+    pipeTrace.setConfig(options.trace);
+    if (pipeTrace.open(output) != SUCCESS) return ERROR;
+    if (!options.loadCheckpoint.empty() && loadCheckpoint(options.loadCheckpoint) != SUCCESS) {
+        return ERROR;
+    }
+    if (options.fastForward > 0) fastForward(options.fastForward, options.warmup);
+    if (!options.saveCheckpoint.empty()) return saveCheckpoint(options.saveCheckpoint);
     return SUCCESS;
 }
 
+// Execute up to instructions instructions functionally from PC, with the semantics of
+// simInstruction. The last warmup of them go through the interpreter and access the
+// caches (and sweeps) as their fetches, loads and stores would, the others run on
+// the ThreadedEngine. A halt or illegal instruction ends the fast-forward in front of
+// it, so the pipeline still handles it the cycle-accurate way. The pipeline then
+// starts out empty at the next PC; cache statistics and the memory trace only cover
+// the cycle-accurate part.
+void CycleSimulator::fastForward(uint64_t instructions, uint64_t warmup) {
+    uint64_t cold = instructions - std::min(instructions, warmup);
+    if (cold > 0) {
+        uint64_t din = simulator->getDin();
+        ThreadedEngine engine(*simulator);
+        if (engine.run(PC, cold) != SUCCESS) {
+            // stopped at a halt or illegal instruction, which din counts already,
+            // nothing was cached
+            PC = engine.getStopPC();
+            stats.add(STAT_FAST_FORWARDED, simulator->getDin() - din - 1);
+            return;
+        }
+        stats.add(STAT_FAST_FORWARDED, cold);
+    }
+
+    Simulator::Instruction inst;
+    for (uint64_t i = cold; i < instructions; i++) {
+        simulator->simInstruction(PC, inst);
+        if (inst.isHalt || !inst.isLegal) break;
+        stats.add(STAT_FAST_FORWARDED);
+
+        if (!iCache->access(PC, CACHE_READ) && iCache->config.missLatency > 0) {
+            hierarchy->warm(PC);
+        }
+        if (iSweep) iSweep->access(PC);
+        if (inst.readsMem || inst.writesMem) {
+            CacheOperation type = inst.readsMem ? CACHE_READ : CACHE_WRITE;
+            if (!dCache->access(inst.memAddress, type) && dCache->config.missLatency > 0) {
+                hierarchy->warm(inst.memAddress);
+            }
+            if (dSweep) dSweep->access(inst.memAddress);
+        }
+        PC = inst.nextPC;
+    }
+
+    iCache->resetStats();
+    dCache->resetStats();
+    hierarchy->resetStats();
+    if (iSweep) iSweep->resetStats();
+    if (dSweep) dSweep->resetStats();
+}
+
 static uint64_t forwarding(uint64_t rs, bool readsRs, uint64_t opVal,
-                       const Simulator::Instruction exPrev,
-                       const Simulator::Instruction memPrev) {
+                       const Simulator::Instruction& exPrev,
+                       const Simulator::Instruction& memPrev) {
     if (!readsRs || rs == 0) return opVal;
 
     // exPrev (closer)
@@ -71,16 +170,447 @@ static uint64_t forwarding(uint64_t rs, bool readsRs, uint64_t opVal,
     return opVal;
 }
 
-// keep track of the number of cycles stall is applied
-// static uint64_t loadStallCount = 0;
-static uint64_t iCacheStallCycles = 0;
-static uint64_t dCacheStallCycles = 0;
+// whether a slot of the dual-issue pipeline holds an instruction, not a bubble
+static bool holdsInstruction(const Simulator::Instruction& inst) {
+    return inst.status == NORMAL || inst.status == SPECULATIVE;
+}
+
+static bool isControlTransfer(const Simulator::Instruction& inst) {
+    return inst.opcode == OP_BRANCH || inst.opcode == OP_JALR || inst.opcode == OP_JAL;
+}
+
+static bool isMemoryAccess(const Simulator::Instruction& inst) {
+    return inst.readsMem || inst.writesMem;
+}
+
+// whether inst reads register reg, never for x0
+static bool readsRegister(const Simulator::Instruction& inst, uint64_t reg) {
+    return reg != 0 && ((inst.readsRs1 && inst.rs1 == reg) || (inst.readsRs2 && inst.rs2 == reg));
+}
+
+// forwarding() over both slots of EX and MEM, the younger slot of a stage first
+static uint64_t forwardingDual(uint64_t rs, bool readsRs, uint64_t opVal,
+                               const Simulator::Instruction (&exPrev)[2],
+                               const Simulator::Instruction (&memPrev)[2]) {
+    if (!readsRs || rs == 0) return opVal;
+
+    for (int slot = 1; slot >= 0; slot--) {
+        const Simulator::Instruction& ex = exPrev[slot];
+        if (ex.writesRd && ex.rd == rs && ex.doesArithLogic) return ex.arithResult;
+    }
+    for (int slot = 1; slot >= 0; slot--) {
+        const Simulator::Instruction& mem = memPrev[slot];
+        if (mem.writesRd && mem.rd == rs) {
+            if (mem.readsMem)
+                return mem.memResult;
+            else if (mem.doesArithLogic)
+                return mem.arithResult;
+        }
+    }
+    return opVal;
+}
+
+// whether younger may issue together with older, the instruction in front of it: the
+// pair has one memory port and resolves one branch or jump, and does not bypass
+// within itself
+static bool pairs(const Simulator::Instruction& older, const Simulator::Instruction& younger) {
+    if (!holdsInstruction(younger) || !younger.isLegal || older.isHalt) return false;
+    if (isMemoryAccess(older) && isMemoryAccess(younger)) return false;
+    if (isControlTransfer(older) && isControlTransfer(younger)) return false;
+    return !(older.writesRd && readsRegister(younger, older.rd));
+}
+
+static bool anyHalt(const Simulator::Instruction (&slots)[2]) {
+    return slots[0].isHalt || slots[1].isHalt;
+}
+
+static bool allBubbles(const Simulator::Instruction (&slots)[2]) {
+    return slots[0].status == BUBBLE && slots[1].status == BUBBLE;
+}
+
+// Number of the remaining `stall` cycles that runCycles pays in one step starting at
+// `cycle`, the (count)th cycle of a runCycles(cycles) call. The step never goes past
+// the cycle budget, and ends on the next traced cycle so that its state gets dumped.
+uint64_t CycleSimulator::stallSkip(uint64_t stall, uint64_t cycle, uint64_t cycles, uint64_t count) {
+    uint64_t skip = stall;
+    if (cycles != 0) skip = std::min(skip, cycles - count + 1);
+    uint64_t traced = pipeTrace.nextTraced(cycle);
+    if (traced != UINT64_MAX) skip = std::min(skip, traced - cycle + 1);
+    return skip;
+}
+
+// a pipeline latch in a checkpoint: the narrow fields and flags packed in two words
+static void putInstruction(CheckpointWriter& out, const Simulator::Instruction& inst) {
+    out.put(inst.PC);
+    out.put((uint64_t)inst.instruction | (uint64_t)inst.opcode << 32 |
+            (uint64_t)inst.funct3 << 40 | (uint64_t)inst.funct7 << 48);
+    out.put((uint64_t)inst.rd | (uint64_t)inst.rs1 << 8 | (uint64_t)inst.rs2 << 16 |
+            (uint64_t)inst.status << 24 | (uint64_t)inst.isHalt << 32 |
+            (uint64_t)inst.isLegal << 33 | (uint64_t)inst.isNop << 34 |
+            (uint64_t)inst.readsMem << 35 | (uint64_t)inst.writesMem << 36 |
+            (uint64_t)inst.doesArithLogic << 37 | (uint64_t)inst.writesRd << 38 |
+            (uint64_t)inst.readsRs1 << 39 | (uint64_t)inst.readsRs2 << 40 |
+            (uint64_t)inst.isDecoded << 41);
+    out.put(inst.imm);
+    out.put(inst.target);
+    out.put(inst.nextPC);
+    out.put(inst.op1Val);
+    out.put(inst.op2Val);
+    out.put(inst.arithResult);
+    out.put(inst.memAddress);
+    out.put(inst.memResult);
+    out.put(inst.instructionID);
+    out.put(inst.predictedPC);
+}
+
+static void getInstruction(CheckpointReader& in, Simulator::Instruction& inst) {
+    inst.PC = in.get();
+    uint64_t encoding = in.get();
+    inst.instruction = (uint32_t)encoding;
+    inst.opcode = encoding >> 32;
+    inst.funct3 = encoding >> 40;
+    inst.funct7 = encoding >> 48;
+    uint64_t fields = in.get();
+    inst.rd = fields;
+    inst.rs1 = fields >> 8;
+    inst.rs2 = fields >> 16;
+    inst.status = static_cast<StageStatus>((fields >> 24) & 0xFF);
+    inst.isHalt = (fields >> 32) & 1;
+    inst.isLegal = (fields >> 33) & 1;
+    inst.isNop = (fields >> 34) & 1;
+    inst.readsMem = (fields >> 35) & 1;
+    inst.writesMem = (fields >> 36) & 1;
+    inst.doesArithLogic = (fields >> 37) & 1;
+    inst.writesRd = (fields >> 38) & 1;
+    inst.readsRs1 = (fields >> 39) & 1;
+    inst.readsRs2 = (fields >> 40) & 1;
+    inst.isDecoded = (fields >> 41) & 1;
+    inst.imm = in.get();
+    inst.target = in.get();
+    inst.nextPC = in.get();
+    inst.op1Val = in.get();
+    inst.op2Val = in.get();
+    inst.arithResult = in.get();
+    inst.memAddress = in.get();
+    inst.memResult = in.get();
+    inst.instructionID = in.get();
+    inst.predictedPC = in.get();
+}
+
+Status CycleSimulator::saveCheckpoint(const std::string& fileName) {
+    CheckpointWriter out;
+    if (out.open(fileName) != SUCCESS) return ERROR;
+    simulator->saveState(out);
+    simulator->getMemory()->saveState(out);
+    iCache->saveState(out);
+    dCache->saveState(out);
+    hierarchy->saveState(out);
+    out.put(predictor != nullptr);
+    if (predictor) predictor->saveState(out);
+    out.put(missHandler != nullptr);
+    if (missHandler) {
+        missHandler->saveState(out);
+        for (uint64_t ready : loadReady) out.put(ready);
+    }
+    for (const Prefetcher* prefetcher : {iPrefetcher.get(), dPrefetcher.get()}) {
+        out.put(prefetcher != nullptr);
+        if (prefetcher) prefetcher->saveState(out);
+    }
+    out.put(writeBuffer.size());
+    for (uint64_t done : writeBuffer) out.put(done);
+
+    out.put(PC);
+    out.put(cycleCount);
+    out.put(iCacheStallCycles);
+    out.put(dCacheStallCycles);
+    stats.saveState(out);
+    // the latches: their width, then that many slots of each stage
+    out.put(dualIssue ? 2 : 1);
+    if (dualIssue) {
+        const DualPipelineInfo& state = dualPipeline[latch];
+        for (const Simulator::Instruction* stage :
+             {state.ifInst, state.idInst, state.exInst, state.memInst, state.wbInst}) {
+            putInstruction(out, stage[0]);
+            putInstruction(out, stage[1]);
+        }
+    } else {
+        const PipelineInfo& state = pipeline[latch];
+        putInstruction(out, state.ifInst);
+        putInstruction(out, state.idInst);
+        putInstruction(out, state.exInst);
+        putInstruction(out, state.memInst);
+        putInstruction(out, state.wbInst);
+    }
+
+    if (out.close() != SUCCESS) {
+        std::cerr << LOG_ERROR << "Could not write checkpoint " << fileName << std::endl;
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+Status CycleSimulator::loadCheckpoint(const std::string& fileName) {
+    CheckpointReader in;
+    if (in.open(fileName) != SUCCESS) return ERROR;
+    simulator->restoreState(in);
+    if (simulator->getMemory()->restoreState(in) != 0) {
+        if (in.hasFailed()) {
+            std::cerr << LOG_ERROR << "Truncated checkpoint " << fileName << std::endl;
+        }
+        return ERROR;
+    }
+    if (!iCache->restoreState(in)) {
+        std::cout << LOG_INFO << "I-cache configuration differs from " << fileName
+                  << ", starting cold" << std::endl;
+    }
+    if (!dCache->restoreState(in)) {
+        std::cout << LOG_INFO << "D-cache configuration differs from " << fileName
+                  << ", starting cold" << std::endl;
+    }
+    if (!hierarchy->restoreState(in)) {
+        std::cout << LOG_INFO << "L2/L3/memory configuration differs from " << fileName
+                  << ", starting cold" << std::endl;
+    }
+    if (in.get()) {
+        // a section for a predictor this simulation has none of is read all the same
+        BranchPredictor unused((PredictorConfig()));
+        if (!(predictor ? predictor.get() : &unused)->restoreState(in) && predictor) {
+            std::cout << LOG_INFO << "Predictor configuration differs from " << fileName
+                      << ", starting cold" << std::endl;
+        }
+    } else if (predictor) {
+        std::cout << LOG_INFO << fileName << " has no predictor state, starting cold"
+                  << std::endl;
+    }
+    std::fill(std::begin(loadReady), std::end(loadReady), 0);
+    if (in.get()) {
+        MissHandler unused(1, 1, *dCache);
+        uint64_t savedReady[32];
+        bool restored = (missHandler ? missHandler.get() : &unused)->restoreState(in);
+        for (uint64_t& ready : savedReady) ready = in.get();
+        if (restored && missHandler) {
+            std::copy(std::begin(savedReady), std::end(savedReady), std::begin(loadReady));
+        } else if (missHandler) {
+            std::cout << LOG_INFO << "MSHR configuration differs from " << fileName
+                      << ", no misses outstanding" << std::endl;
+        }
+    }
+    for (Prefetcher* prefetcher : {iPrefetcher.get(), dPrefetcher.get()}) {
+        const char* name = prefetcher == iPrefetcher.get() ? "I-cache" : "D-cache";
+        if (in.get()) {
+            Prefetcher unused(CacheConfig{0, 1, 1, 0, REPL_LRU, 42, PREFETCH_NEXT_LINE});
+            if (!(prefetcher ? prefetcher : &unused)->restoreState(in) && prefetcher) {
+                std::cout << LOG_INFO << name << " prefetcher configuration differs from "
+                          << fileName << ", starting cold" << std::endl;
+            }
+        } else if (prefetcher) {
+            std::cout << LOG_INFO << fileName << " has no " << name
+                      << " prefetcher state, starting cold" << std::endl;
+        }
+    }
+    // the count comes from the file, the entries are only taken as long as it has them
+    uint64_t entries = in.get();
+    std::vector<uint64_t> savedBuffer;
+    for (uint64_t i = 0; i < entries && !in.hasFailed(); i++) savedBuffer.push_back(in.get());
+    if (!in.hasFailed() && savedBuffer.size() == writeBuffer.size()) {
+        writeBuffer.swap(savedBuffer);
+    } else {
+        std::fill(writeBuffer.begin(), writeBuffer.end(), 0);
+        if (!writeBuffer.empty()) {
+            std::cout << LOG_INFO << "Write buffer configuration differs from " << fileName
+                      << ", starting empty" << std::endl;
+        }
+    }
+
+    PC = in.get();
+    cycleCount = in.get();
+    iCacheStallCycles = in.get();
+    dCacheStallCycles = in.get();
+    stats.restoreState(in);
+    // either pipeline starts from either width: slot 0 is the single-issue latch, and
+    // the dual-issue one starts with its slots 1 empty
+    uint64_t width = in.get();
+    latch = 0;
+    PipelineInfo& state = pipeline[latch];
+    DualPipelineInfo& dual = dualPipeline[latch];
+    Simulator::Instruction* stages[] = {&state.ifInst, &state.idInst, &state.exInst,
+                                        &state.memInst, &state.wbInst};
+    Simulator::Instruction* dualStages[] = {dual.ifInst, dual.idInst, dual.exInst,
+                                            dual.memInst, dual.wbInst};
+    bool paired = false;
+    for (int stage = 0; stage < 5; stage++) {
+        getInstruction(in, *stages[stage]);
+        dualStages[stage][0] = *stages[stage];
+        dualStages[stage][1] = nop(BUBBLE);
+        if (width == 2) {
+            getInstruction(in, dualStages[stage][1]);
+            paired = paired || holdsInstruction(dualStages[stage][1]);
+        }
+    }
+
+    if (in.hasFailed()) {
+        std::cerr << LOG_ERROR << "Truncated checkpoint " << fileName << std::endl;
+        return ERROR;
+    }
+    if (paired && !dualIssue) {
+        std::cerr << LOG_ERROR << fileName
+                  << " holds instructions in the second slots, it needs --dual-issue"
+                  << std::endl;
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+// The pipeline accesses the caches only through these, so that a configured sweep
+// or memory trace sees exactly the access streams of the simulated caches.
+bool CycleSimulator::iCacheAccess(uint64_t address) {
+    if (iSweep) iSweep->access(address);
+    if (memTrace.isOpen()) memTrace.write(address, MEM_IFETCH);
+    return iCache->access(address, CACHE_READ);
+}
+
+bool CycleSimulator::dCacheAccess(uint64_t address, CacheOperation type) {
+    if (dSweep) dSweep->access(address);
+    if (memTrace.isOpen()) memTrace.write(address, type == CACHE_WRITE ? MEM_WRITE : MEM_READ);
+    return dCache->access(address, type);
+}
+
+// Stall cycles of a miss l1 just filled: its own miss latency and the time the
+// hierarchy behind it takes, after the write-back of the dirty block the fill evicted
+// if there is one. An ideal L1 (missLatency 0) stays ideal, it does not use the
+// hierarchy.
+uint64_t CycleSimulator::missPenalty(const Cache& l1, uint64_t address) {
+    if (l1.config.missLatency == 0) return 0;
+    uint64_t penalty = 0;
+    if (l1.wroteBack()) penalty = writePenalty(l1, l1.getWriteBackAddress(), l1.config.blockSize);
+    return penalty + l1.config.missLatency +
+           hierarchy->missLatency(address, cycleCount + penalty, l1.config.blockSize);
+}
 
-// run the simulator for a certain number of cycles
+// Stall cycles of a write of bytes at address from l1 to the level behind it (counted
+// in STAT_DC_WRITE_BYTES), 0 for an ideal L1
+uint64_t CycleSimulator::writePenalty(const Cache& l1, uint64_t address, uint64_t bytes) {
+    if (l1.config.missLatency == 0) return 0;
+    stats.add(STAT_DC_WRITE_BYTES, bytes);
+    return l1.config.missLatency +
+           hierarchy->writeLatency(address, bytes, cycleCount + l1.config.missLatency);
+}
+
+// Let prefetcher train with the demand access of address by the instruction at PC
+// that just hit or missed l1, and issue the prefetches it proposes; each one arrives
+// after the miss penalty of its block. Returns the cycles the access still waits for
+// a prefetched block on its way (counted in late), 0 if l1 has no prefetcher.
+uint64_t CycleSimulator::prefetchAfter(Cache& l1, Prefetcher* prefetcher, uint64_t PC,
+                                       uint64_t address, bool hit, StatCounter late) {
+    if (!prefetcher) return 0;
+    uint64_t wait = l1.hitPrefetched() ? prefetcher->useful(address, cycleCount) : 0;
+    stats.add(late, wait > 0);
+    for (uint64_t block : prefetcher->train(PC, address, hit, l1.hitPrefetched())) {
+        if (l1.prefetch(block)) {
+            prefetcher->issued(block, cycleCount + missPenalty(l1, block));
+        }
+    }
+    return wait;
+}
+
+// whether inst is a store the D-cache writes through to the level behind it
+bool CycleSimulator::writesThrough(const Simulator::Instruction& inst) const {
+    WritePolicy policy = dCache->config.writePolicy;
+    return inst.writesMem && (policy == WRITE_THROUGH || policy == WRITE_BUFFER);
+}
+
+// whether inst has to wait in ID for a load outstanding in the non-blocking D-cache,
+// for a source or (as the load would overwrite it) its destination
+bool CycleSimulator::waitsForLoad(const Simulator::Instruction& inst) const {
+    return (inst.readsRs1 && loadReady[inst.rs1] >= cycleCount) ||
+           (inst.readsRs2 && loadReady[inst.rs2] >= cycleCount) ||
+           (inst.writesRd && loadReady[inst.rd] >= cycleCount);
+}
+
+// The D-cache access of the load or store memInst entering MEM, setting the cycles
+// MEM stalls for it (dCacheStallCycles)
+void CycleSimulator::dCacheTiming(const Simulator::Instruction& memInst) {
+    CacheOperation type = memInst.readsMem ? CACHE_READ : CACHE_WRITE;
+    bool hit = dCacheAccess(memInst.memAddress, type);
+    uint64_t bytes = 1u << (memInst.funct3 & 3);
+    if (sharedLog && (memInst.writesMem || !hit)) {
+        sharedLog->push_back(SharedAccess{memInst.memAddress, (uint8_t)bytes, memInst.writesMem});
+    }
+    if (missHandler) {
+        // non-blocking: MEM only waits for a free MSHR or store buffer entry, a load's
+        // consumers wait in ID (waitsForLoad). The store buffer is the write buffer of
+        // a write-through D-cache.
+        uint64_t latency = 0;
+        if (writesThrough(memInst)) {
+            hit = false;
+            latency = writePenalty(*dCache, memInst.memAddress, bytes);
+        } else if (!hit) {
+            latency = missPenalty(*dCache, memInst.memAddress);
+            stats.add(STAT_DC_MISS_CYCLES, latency);
+        }
+        // a late prefetch is waited for as the miss it still is
+        uint64_t wait = prefetchAfter(*dCache, dPrefetcher.get(), memInst.PC,
+                                      memInst.memAddress, hit, STAT_DC_LATE_PREFETCHES);
+        if (wait > 0) {
+            hit = false;
+            latency = std::max(latency, wait);
+        }
+        MissHandler::Outcome outcome = missHandler->access(memInst.memAddress, hit,
+                                                           type == CACHE_WRITE, cycleCount,
+                                                           latency);
+        if (memInst.readsMem && memInst.writesRd && memInst.rd != 0) {
+            loadReady[memInst.rd] = outcome.ready;
+        }
+        dCacheStallCycles = outcome.stall;
+        stats.add(STAT_MSHR_MERGES, outcome.merged);
+        stats.add(STAT_OVERLAPPED_MISSES, outcome.overlapped);
+        if (outcome.mshrsFull) stats.add(STAT_MSHR_FULL_CYCLES, outcome.stall);
+        if (outcome.storeBufferFull) stats.add(STAT_STORE_BUFFER_FULL_CYCLES, outcome.stall);
+        return;
+    }
+
+    // blocking: a miss stalls for its penalty, a write-through store for the next
+    // level or a free write buffer entry
+    uint64_t stall = 0;
+    if (writesThrough(memInst)) {
+        if (writeBuffer.empty()) {
+            stall = writePenalty(*dCache, memInst.memAddress, bytes);
+        } else {
+            // the oldest entry drains first if all are taken
+            auto entry = std::min_element(writeBuffer.begin(), writeBuffer.end());
+            stall = *entry >= cycleCount ? *entry + 1 - cycleCount : 0;
+            *entry = cycleCount + stall + writePenalty(*dCache, memInst.memAddress, bytes);
+            stats.add(STAT_WRITE_BUFFER_FULL_CYCLES, stall);
+        }
+    } else if (!hit) {
+        stall = missPenalty(*dCache, memInst.memAddress);
+        stats.add(STAT_DC_MISS_CYCLES, stall);
+    }
+    uint64_t wait = prefetchAfter(*dCache, dPrefetcher.get(), memInst.PC, memInst.memAddress,
+                                  hit, STAT_DC_LATE_PREFETCHES);
+    dCacheStallCycles = std::max(stall, wait);
+}
+
+// The I-cache access of the fetch at PC, setting the cycles fetch stalls for a miss
+// or a late prefetch (iCacheStallCycles) unless stalls is false
+void CycleSimulator::fetchTiming(uint64_t PC, bool stalls) {
+    bool hit = iCacheAccess(PC);
+    uint64_t wait = prefetchAfter(*iCache, iPrefetcher.get(), PC, PC, hit,
+                                  STAT_IC_LATE_PREFETCHES);
+    if (!stalls) return;
+    iCacheStallCycles = wait;
+    if (!hit) {
+        iCacheStallCycles = missPenalty(*iCache, PC);
+        stats.add(STAT_IC_MISS_CYCLES, iCacheStallCycles);
+    }
+}
+
+// run the simulator for a certain number of cycles (cycles == 0 runs until halt),
+// dumping the pipe state of every cycle the trace policy selects
 // return SUCCESS if reaching desired cycles.
 // return HALT if the simulator halts on 0xfeedfeed
-
-Status runCycles(uint64_t cycles) {
+Status CycleSimulator::runCycles(uint64_t cycles) {
+    if (dualIssue) return runCyclesDual(cycles);
     uint64_t count = 0;
     auto status = SUCCESS;
     PipeState pipeState = {
@@ -94,220 +624,616 @@ Status runCycles(uint64_t cycles) {
         count++;
         cycleCount++;
 
-        // PREVIOUS STATE OF PIPELINE
-        Simulator::Instruction ifPrev = pipelineInfo.ifInst;
-        Simulator::Instruction idPrev = pipelineInfo.idInst;
-        Simulator::Instruction exPrev = pipelineInfo.exInst;
-        Simulator::Instruction memPrev = pipelineInfo.memInst;
-        Simulator::Instruction wbPrev = pipelineInfo.wbInst;
+        // PREVIOUS STATE OF PIPELINE, a regular cycle writes its successor to the
+        // other latch buffer. The stages below may update the previous latches in
+        // place (forwarding), which only the copies they make to the next ones see.
+        PipelineInfo& prev = pipeline[latch];
+        PipelineInfo& pipelineInfo = pipeline[latch ^ 1];
+        Simulator::Instruction& ifPrev = prev.ifInst;
+        Simulator::Instruction& idPrev = prev.idInst;
+        Simulator::Instruction& exPrev = prev.exInst;
+        Simulator::Instruction& memPrev = prev.memInst;
+        Simulator::Instruction& wbPrev = prev.wbInst;
 
 
         // DATA CACHE STALLING
         if (dCacheStallCycles > 0){
 
-            // Pay one cycle of the stall
-            dCacheStallCycles--;
+            // Pay the stall: every stall cycle leaves the pipeline exactly as the
+            // one before, so as many of them as allowed are paid in one step
+            uint64_t skip = stallSkip(dCacheStallCycles, pipeState.cycle, cycles, count);
+            dCacheStallCycles -= skip;
+            stats.add(STAT_DC_STALL_CYCLES, skip);
+            if (profiler) profiler->charge(memPrev.PC, PROFILE_DCACHE, skip);
+            count += skip - 1;
+            cycleCount += skip - 1;
+            pipeState.cycle += skip - 1;
 
-            // Keep the MEM-stage instruction (the load/store that missed)
-            pipelineInfo.memInst = memPrev;
+            // The MEM-stage instruction (the load/store that missed) and the younger
+            // stages stay in their latches; nothing new retires while the miss is
+            // outstanding
+            prev.wbInst = nop(BUBBLE);
 
-            // Freeze younger stages: EX, ID, IF stay the same
-            pipelineInfo.exInst  = exPrev;
-            pipelineInfo.idInst  = idPrev;
-            pipelineInfo.ifInst  = ifPrev;
+            // Let any outstanding I-cache miss proceed in parallel
+            iCacheStallCycles -= std::min(iCacheStallCycles, skip);
 
-            // Nothing new retires while the miss is outstanding
-            pipelineInfo.wbInst = nop(BUBBLE);
+            goto DUMP_STATE;
+        }
 
-            // Let any outstanding I-cache miss proceed in parallel
-            if (iCacheStallCycles > 0) {
-                iCacheStallCycles--;
-            }
+        // INSTRUCTION CACHE STALLING ON A DRAINED PIPELINE
+        // With only bubbles behind IF, a stall cycle just shifts bubbles down the
+        // pipe, which leaves it unchanged, so the stall can be paid in bulk as well
+        if (iCacheStallCycles > 0 && idPrev.status == BUBBLE && exPrev.status == BUBBLE &&
+            memPrev.status == BUBBLE) {
+            uint64_t skip = stallSkip(iCacheStallCycles, pipeState.cycle, cycles, count);
+            iCacheStallCycles -= skip;
+            stats.add(STAT_IC_STALL_CYCLES, skip);
+            if (profiler) profiler->charge(ifPrev.PC, PROFILE_ICACHE, skip);
+            count += skip - 1;
+            cycleCount += skip - 1;
+            pipeState.cycle += skip - 1;
 
+            prev.wbInst = memPrev;
             goto DUMP_STATE;
         }
 
-        // BRANCH CATCHER
-        bool idIsBranch = (idPrev.opcode == OP_BRANCH) || (idPrev.opcode == OP_JALR) ||
-                          (idPrev.opcode == OP_JAL);
+        // A regular cycle. Its locals live in their own scope so that the stall
+        // paths above can jump straight to DUMP_STATE.
+        {
+            // BRANCH CATCHER
+            bool idIsBranch = (idPrev.opcode == OP_BRANCH) || (idPrev.opcode == OP_JALR) ||
+                              (idPrev.opcode == OP_JAL);
 
-        // BRANCH TAKEN OR NOT
-        bool taken = false;
+            // BRANCH TAKEN OR NOT
+            bool taken = false;
 
-        // THE NEXT PC TO BE CALCULATED
-        uint64_t nextPC = PC;
+            // THE NEXT PC TO BE CALCULATED
+            uint64_t nextPC = PC;
 
-        // HAZARD DETECTION (LOAD-USE, ARITHMETIC-BRANCH, LOAD-BRANCH)
+            // HAZARD DETECTION (LOAD-USE, ARITHMETIC-BRANCH, LOAD-BRANCH)
 
-        // Catches load use stall (vanilla) and first stall of load branch
-        bool catchLoadUse = ((idPrev.rs1 == exPrev.rd) || (idPrev.rs2 == exPrev.rd))
-                            && exPrev.readsMem && (exPrev.rd!=0);
+            // Catches load use stall (vanilla) and first stall of load branch
+            bool catchLoadUse = ((idPrev.rs1 == exPrev.rd) || (idPrev.rs2 == exPrev.rd))
+                                && exPrev.readsMem && (exPrev.rd!=0);
 
-        bool catchArithBranch = ((idPrev.rs1 == exPrev.rd) || (idPrev.rs2 == exPrev.rd))
-                                && (exPrev.rd!=0) && idIsBranch && exPrev.doesArithLogic
-                                && exPrev.writesRd;
+            bool catchArithBranch = ((idPrev.rs1 == exPrev.rd) || (idPrev.rs2 == exPrev.rd))
+                                    && (exPrev.rd!=0) && idIsBranch && exPrev.doesArithLogic
+                                    && exPrev.writesRd;
 
-        // Catches second cycle of load branch
-        bool catchLoadBranch = idIsBranch && exPrev.isNop && memPrev.readsMem
-                                && ((idPrev.rs1 == memPrev.rd) || (idPrev.rs2 == memPrev.rd))
-                                && (memPrev.rd != 0);
+            // Catches second cycle of load branch
+            bool catchLoadBranch = idIsBranch && exPrev.isNop && memPrev.readsMem
+                                    && ((idPrev.rs1 == memPrev.rd) || (idPrev.rs2 == memPrev.rd))
+                                    && (memPrev.rd != 0);
 
-        bool bubbleEXstallID = (catchLoadUse || catchArithBranch) || catchLoadBranch;
+            // Catches a load still outstanding in the non-blocking D-cache
+            bool catchPendingLoad = missHandler && waitsForLoad(idPrev);
 
-        // D_CACHE MISS DETECTION
-        // first check for a memory exception on the address that will access D-Cache
-        // Memory access happens in MEM stage: use memPrev
-        bool memAccess = false;
+            bool bubbleEXstallID = (catchLoadUse || catchArithBranch) || catchLoadBranch
+                                   || catchPendingLoad;
+            stats.add(STAT_LOAD_USE_STALLS, catchLoadUse || catchPendingLoad);
+            stats.add(STAT_ARITH_BRANCH_STALLS, catchArithBranch);
+            stats.add(STAT_LOAD_BRANCH_STALLS, catchLoadBranch);
+            if (profiler && bubbleEXstallID) profiler->charge(idPrev.PC, PROFILE_LOAD_USE);
 
-        bool dCacheStall = false;
-        bool iCacheStall = false;
+            // D_CACHE MISS DETECTION
+            // first check for a memory exception on the address that will access D-Cache
+            // Memory access happens in MEM stage: use memPrev
+            bool memAccess = false;
 
 
-        // WB SEQUENCE
-        // WB Check for halt instruction 
-        pipelineInfo.wbInst = nop(BUBBLE);
-        pipelineInfo.wbInst = simulator->simWB(memPrev);
+            // WB SEQUENCE
+            // WB Check for halt instruction 
+            pipelineInfo.wbInst = memPrev;
+            simulator->simWB(pipelineInfo.wbInst);
+            bool retires = pipelineInfo.wbInst.status == NORMAL && !pipelineInfo.wbInst.isNop;
+            stats.add(STAT_INSTRUCTIONS, retires);
+            if (profiler && retires) profiler->charge(pipelineInfo.wbInst.PC, PROFILE_RETIRE);
 
-        // MEM SEQUENCE
-        // special forwarding load-store data dependency
-        if(exPrev.writesMem && exPrev.readsRs2 && exPrev.rs2 != 0){
-                if ((wbPrev.rd == exPrev.rs2) && wbPrev.readsMem)
-                exPrev.op2Val = wbPrev.memResult;
-        }
-        pipelineInfo.memInst = simulator->simMEM(exPrev);
+            // MEM SEQUENCE
+            // special forwarding load-store data dependency
+            if(exPrev.writesMem && exPrev.readsRs2 && exPrev.rs2 != 0){
+                    if ((wbPrev.rd == exPrev.rs2) && wbPrev.readsMem)
+                    exPrev.op2Val = wbPrev.memResult;
+            }
+            pipelineInfo.memInst = exPrev;
+            simulator->simMEM(pipelineInfo.memInst);
         
-        // catch the DCache stall
-        memAccess = (pipelineInfo.memInst.readsMem || pipelineInfo.memInst.writesMem);
-        if (memAccess && dCacheStallCycles == 0) {
-            CacheOperation type = pipelineInfo.memInst.readsMem ? CACHE_READ : CACHE_WRITE;
-            dCacheStall = !dCache->access(pipelineInfo.memInst.memAddress, type);
-        }
-        if (dCacheStall){
-            dCacheStall = false;
-            dCacheStallCycles = dCache->config.missLatency;
-        }
+            // catch the DCache stall
+            memAccess = (pipelineInfo.memInst.readsMem || pipelineInfo.memInst.writesMem);
+            if (memAccess && dCacheStallCycles == 0) dCacheTiming(pipelineInfo.memInst);
 
-        // EX SEQUENCE
-        if(bubbleEXstallID){
-            pipelineInfo.exInst = nop(BUBBLE);
-        }
-        else{
+            // EX SEQUENCE
+            if(bubbleEXstallID){
+                pipelineInfo.exInst = nop(BUBBLE);
+            }
+            else{
+                idPrev.op1Val = forwarding(idPrev.rs1, idPrev.readsRs1, idPrev.op1Val, exPrev, memPrev);
+                idPrev.op2Val = forwarding(idPrev.rs2, idPrev.readsRs2, idPrev.op2Val, exPrev, memPrev);
+                pipelineInfo.exInst = idPrev;
+                simulator->simEX(pipelineInfo.exInst);
+            }
+
+            // ID SEQUENCE
             idPrev.op1Val = forwarding(idPrev.rs1, idPrev.readsRs1, idPrev.op1Val, exPrev, memPrev);
             idPrev.op2Val = forwarding(idPrev.rs2, idPrev.readsRs2, idPrev.op2Val, exPrev, memPrev);
-            pipelineInfo.exInst = simulator->simEX(idPrev);
+
+            // ICACHE
+            bool fetchStalled = iCacheStallCycles > 0;
+            if (fetchStalled){
+                iCacheStallCycles--;
+                stats.add(STAT_IC_STALL_CYCLES);
+                if (profiler) profiler->charge(ifPrev.PC, PROFILE_ICACHE);
+                // The reference pipeline leaves ID alone while fetch stalls: what is in
+                // ID moves on unresolved, or is dropped if it waits for a hazard. The
+                // non-blocking D-cache overlaps far more with fetch stalls, with it ID
+                // works as usual and a redirect abandons the fetch.
+                if (!missHandler) {
+                    pipelineInfo.ifInst = ifPrev;
+                    pipelineInfo.idInst = nop(BUBBLE);
+                    goto ADVANCE;
+                }
+            }
+
+            nextPC = PC; //maybe redundant but safe
+            if(!idPrev.isLegal) {
+                stats.add(STAT_EXCEPTIONS);
+                if (profiler) profiler->charge(idPrev.PC, PROFILE_EXCEPTION, 2);
+                PC = EXCEPTION_HANDLER;
+                pipelineInfo.exInst = nop(SQUASHED);
+                pipelineInfo.idInst = nop(SQUASHED);
+                nextPC = PC + 4;
+                fetchStalled = false;
+                iCacheStallCycles = 0;
+            }
+            else if(bubbleEXstallID){
+               pipelineInfo.idInst = idPrev;
+            }
+            else{
+                nextPC = PC + 4;
+                if(idIsBranch){
+                    simulator->simNextPCResolution(idPrev);
+                    taken = ((idPrev.PC+4) != (idPrev.nextPC));
+                }
+
+                // without a predictor IF fetched PC + 4, so a taken transfer squashes
+                // that fetch; with one, any next PC other than the predicted does
+                bool redirect = taken;
+                uint64_t redirectPC = idPrev.nextPC;
+                if (predictor && idPrev.status == NORMAL) {
+                    redirectPC = idIsBranch ? idPrev.nextPC : idPrev.PC + 4;
+                    redirect = redirectPC != idPrev.predictedPC;
+                    if (idIsBranch) {
+                        predictor->resolve(idPrev.PC, idPrev.opcode, idPrev.rd, idPrev.rs1, taken,
+                                           idPrev.nextPC);
+                    } else if (redirect) {
+                        predictor->forget(idPrev.PC);
+                    }
+                }
+                if (idIsBranch) {
+                    stats.add(STAT_CONTROL_TRANSFERS);
+                    stats.add(STAT_MISPREDICTS, redirect);
+                }
+
+                if(redirect){
+                    stats.add(STAT_BRANCH_SQUASHES);
+                    if (profiler) profiler->charge(idPrev.PC, PROFILE_SQUASH);
+                    pipelineInfo.idInst = nop(SQUASHED);
+                    PC = redirectPC;
+                    nextPC = PC + 4;
+                    fetchStalled = false;
+                    iCacheStallCycles = 0;
+                }
+                else if (fetchStalled) {
+                    pipelineInfo.idInst = nop(BUBBLE);
+                }
+                else{
+                    pipelineInfo.idInst = ifPrev;
+                    simulator->simID(pipelineInfo.idInst);
+                    if(ifPrev.status == SPECULATIVE){
+                        pipelineInfo.idInst.status = NORMAL;
+                    }
+                }
+
+            }
+
+            // IF SEQUENCE
+            if(bubbleEXstallID || fetchStalled){
+                pipelineInfo.ifInst = ifPrev; 
+            }
+            else{
+                simulator->simIF(PC, pipelineInfo.ifInst);
+                if (predictor) {
+                    bool hit;
+                    nextPC = predictor->predict(PC, hit);
+                    pipelineInfo.ifInst.predictedPC = nextPC;
+                    stats.add(STAT_BTB_HITS, hit);
+                }
+                // the fetch behind an illegal instruction still accesses the I-cache,
+                // its miss does not stall as the exception squashes it
+                if (iCacheStallCycles == 0) fetchTiming(PC, pipelineInfo.idInst.isLegal);
+            }
+
+            // UPDATE STATUS FOR IF
+            if((pipelineInfo.idInst.opcode == OP_BRANCH) 
+            || (pipelineInfo.idInst.opcode == OP_JALR) 
+            || (pipelineInfo.idInst.opcode == OP_JAL)){
+                pipelineInfo.ifInst.status = SPECULATIVE;
+            }
+
+            if(!fetchStalled){
+               // MOVE ON
+                PC = nextPC; 
+            }
+
+        ADVANCE:
+            latch ^= 1;
         }
 
-        // ID SEQUENCE
-        // ICACHE
-        if (iCacheStallCycles > 0){
-            iCacheStallCycles--;
-            pipelineInfo.ifInst = ifPrev;
-            pipelineInfo.idInst = nop(BUBBLE);
-            //add this to exit the iteration correctly
-            if (pipelineInfo.wbInst.isHalt) {
+    DUMP_STATE:
+        const PipelineInfo& state = pipeline[latch];
+        if (pipeTrace.traces(pipeState.cycle)) {
+            pipeState.ifPC = state.ifInst.PC;
+            pipeState.ifStatus = state.ifInst.status;
+            pipeState.idInstr = state.idInst.instruction;
+            pipeState.idStatus = state.idInst.status;
+            pipeState.exInstr = state.exInst.instruction;
+            pipeState.exStatus = state.exInst.status;
+            pipeState.memInstr = state.memInst.instruction;
+            pipeState.memStatus = state.memInst.status;
+            pipeState.wbInstr = state.wbInst.instruction;
+            pipeState.wbStatus = state.wbInst.status;
+            pipeTrace.write(pipeState);
+        }
+        if (state.wbInst.isHalt) {
             status = HALT;
             break;
         }
-            goto DUMP_STATE;
+    }
+    return status;
+}
+
+// The hazard that keeps inst in ID of the dual-issue pipeline this cycle, with prev in
+// the later stages, as the counter of its stall (NUM_STAT_COUNTERS if there is none):
+// those of the single-issue pipeline, from either slot of EX and MEM
+StatCounter CycleSimulator::hazardDual(const Simulator::Instruction& inst,
+                                       const DualPipelineInfo& prev) const {
+    for (const Simulator::Instruction& ex : prev.exInst) {
+        if (!ex.writesRd || !readsRegister(inst, ex.rd)) continue;
+        if (ex.readsMem) return STAT_LOAD_USE_STALLS;
+        if (ex.doesArithLogic && isControlTransfer(inst)) return STAT_ARITH_BRANCH_STALLS;
+    }
+    if (isControlTransfer(inst)) {
+        for (const Simulator::Instruction& mem : prev.memInst) {
+            if (mem.readsMem && mem.writesRd && readsRegister(inst, mem.rd)) {
+                return STAT_LOAD_BRANCH_STALLS;
+            }
+        }
+    }
+    if (missHandler && waitsForLoad(inst)) return STAT_LOAD_USE_STALLS;
+    return NUM_STAT_COUNTERS;
+}
+
+// Issue inst from ID of the dual-issue pipeline to exInst, resolving it if it is a
+// branch or jump. Returns whether fetch went past the wrong next PC (the one IF
+// predicted), the right one in redirectPC.
+bool CycleSimulator::issueDual(Simulator::Instruction& inst, Simulator::Instruction& exInst,
+                               uint64_t& redirectPC) {
+    bool control = isControlTransfer(inst);
+    redirectPC = inst.PC + 4;
+    if (control) {
+        simulator->simNextPCResolution(inst);
+        redirectPC = inst.nextPC;
+    }
+    bool redirect = redirectPC != inst.predictedPC;
+    if (predictor) {
+        if (control) {
+            predictor->resolve(inst.PC, inst.opcode, inst.rd, inst.rs1,
+                               redirectPC != inst.PC + 4, redirectPC);
+        } else if (redirect) {
+            predictor->forget(inst.PC);
+        }
+    }
+    if (control) {
+        stats.add(STAT_CONTROL_TRANSFERS);
+        stats.add(STAT_MISPREDICTS, redirect);
+    }
+    if (redirect) {
+        stats.add(STAT_BRANCH_SQUASHES);
+        if (profiler) profiler->charge(inst.PC, PROFILE_SQUASH);
+    }
+    exInst = inst;
+    simulator->simEX(exInst);
+    return redirect;
+}
+
+// Fetch into the empty IF latch of the dual-issue pipeline with one I-cache access:
+// the instruction at PC, and the one behind it if the first is predicted to fall
+// through within the same block. PC moves on to the next PC predicted for the last.
+// stalls as for fetchTiming.
+void CycleSimulator::fetchDual(Simulator::Instruction (&ifInst)[2], bool stalls) {
+    uint64_t fetchPC = PC;
+    uint64_t block = PC / iCache->config.blockSize;
+    ifInst[1] = nop(BUBBLE);
+    for (int slot = 0; slot < 2; slot++) {
+        simulator->simIF(PC, ifInst[slot]);
+        uint64_t nextPC = PC + 4;
+        if (predictor) {
+            bool hit;
+            nextPC = predictor->predict(PC, hit);
+            stats.add(STAT_BTB_HITS, hit);
         }
+        ifInst[slot].predictedPC = nextPC;
+        bool fallsThrough = nextPC == PC + 4;
+        PC = nextPC;
+        if (!fallsThrough || nextPC / iCache->config.blockSize != block) break;
+    }
+    fetchTiming(fetchPC, stalls);
+}
+
+// runCycles of the dual-issue pipeline (CycleOptions::dualIssue). Every latch has two
+// slots, the older instruction in slot 0 and slot 1 only taken with it. IF fetches up
+// to two instructions per I-cache access (fetchDual), and ID issues the one in slot 0
+// unless it waits for a hazard, and the one in slot 1 along with it if the two pair.
+// Forwarding reaches both ID slots from both slots of EX and MEM. Unlike the blocking
+// single-issue pipeline, ID keeps working while fetch stalls, and nothing issues
+// behind a halt. The pipe trace shows slot 0 of every stage.
+Status CycleSimulator::runCyclesDual(uint64_t cycles) {
+    uint64_t count = 0;
+    auto status = SUCCESS;
+    PipeState pipeState = {
+        0,
+    };
+
+    while (cycles == 0 || count < cycles) {
+        pipeState.cycle = cycleCount;
+        count++;
+        cycleCount++;
 
-        idPrev.op1Val = forwarding(idPrev.rs1, idPrev.readsRs1, idPrev.op1Val, exPrev, memPrev);
-        idPrev.op2Val = forwarding(idPrev.rs2, idPrev.readsRs2, idPrev.op2Val, exPrev, memPrev);
+        DualPipelineInfo& prev = dualPipeline[latch];
+        DualPipelineInfo& pipelineInfo = dualPipeline[latch ^ 1];
 
-        nextPC = PC; //maybe redundant but safe
-        if(!idPrev.isLegal) {
-            PC = EXCEPTION_HANDLER;
-            pipelineInfo.exInst = nop(SQUASHED);
-            pipelineInfo.idInst = nop(SQUASHED);
-            nextPC = PC + 4;
+        // DATA CACHE STALLING, as in runCycles: the load or store of MEM missed
+        if (dCacheStallCycles > 0) {
+            uint64_t skip = stallSkip(dCacheStallCycles, pipeState.cycle, cycles, count);
+            dCacheStallCycles -= skip;
+            stats.add(STAT_DC_STALL_CYCLES, skip);
+            if (profiler) {
+                int slot = isMemoryAccess(prev.memInst[1]) ? 1 : 0;
+                profiler->charge(prev.memInst[slot].PC, PROFILE_DCACHE, skip);
+            }
+            count += skip - 1;
+            cycleCount += skip - 1;
+            pipeState.cycle += skip - 1;
+            prev.wbInst[0] = prev.wbInst[1] = nop(BUBBLE);
+            iCacheStallCycles -= std::min(iCacheStallCycles, skip);
+            goto DUMP_STATE;
         }
-        else if(bubbleEXstallID){
-           pipelineInfo.idInst = idPrev;
+
+        // INSTRUCTION CACHE STALLING ON A DRAINED PIPELINE, as in runCycles
+        if (iCacheStallCycles > 0 && allBubbles(prev.idInst) && allBubbles(prev.exInst) &&
+            allBubbles(prev.memInst)) {
+            uint64_t skip = stallSkip(iCacheStallCycles, pipeState.cycle, cycles, count);
+            iCacheStallCycles -= skip;
+            stats.add(STAT_IC_STALL_CYCLES, skip);
+            if (profiler) profiler->charge(prev.ifInst[0].PC, PROFILE_ICACHE, skip);
+            count += skip - 1;
+            cycleCount += skip - 1;
+            pipeState.cycle += skip - 1;
+
+            prev.wbInst[0] = prev.memInst[0];
+            prev.wbInst[1] = prev.memInst[1];
+            goto DUMP_STATE;
         }
-        else{
-            nextPC = PC + 4;
-            if(idIsBranch){
-                idPrev = simulator->simNextPCResolution(idPrev);
-                taken = ((idPrev.PC+4) != (idPrev.nextPC));
+
+        {
+            Simulator::Instruction(&idPrev)[2] = prev.idInst;
+
+            // WB SEQUENCE
+            for (int slot = 0; slot < 2; slot++) {
+                Simulator::Instruction& wbInst = pipelineInfo.wbInst[slot];
+                wbInst = prev.memInst[slot];
+                simulator->simWB(wbInst);
+                bool retires = wbInst.status == NORMAL && !wbInst.isNop;
+                stats.add(STAT_INSTRUCTIONS, retires);
+                if (profiler && retires) profiler->charge(wbInst.PC, PROFILE_RETIRE);
             }
-            if(taken){
-                pipelineInfo.idInst = nop(SQUASHED);
-                PC = idPrev.nextPC;
-                nextPC = PC + 4;
+
+            // MEM SEQUENCE, one of the two slots at most accesses the D-cache
+            for (int slot = 0; slot < 2; slot++) {
+                pipelineInfo.memInst[slot] = prev.exInst[slot];
+                simulator->simMEM(pipelineInfo.memInst[slot]);
+                if (isMemoryAccess(pipelineInfo.memInst[slot])) {
+                    dCacheTiming(pipelineInfo.memInst[slot]);
+                }
             }
-            else{
-                pipelineInfo.idInst = simulator->simID(ifPrev);
-                if(ifPrev.status == SPECULATIVE){
-                    pipelineInfo.idInst.status = NORMAL;
+
+            // EX SEQUENCE: ID issues in order, up to the first instruction that cannot
+            for (Simulator::Instruction& inst : idPrev) {
+                inst.op1Val = forwardingDual(inst.rs1, inst.readsRs1, inst.op1Val, prev.exInst,
+                                             prev.memInst);
+                inst.op2Val = forwardingDual(inst.rs2, inst.readsRs2, inst.op2Val, prev.exInst,
+                                             prev.memInst);
+            }
+            pipelineInfo.exInst[0] = pipelineInfo.exInst[1] = nop(BUBBLE);
+            int issued = 0;
+            bool redirect = false;
+            uint64_t redirectPC = 0;
+            if (!holdsInstruction(idPrev[0]) || anyHalt(prev.exInst) || anyHalt(prev.memInst)) {
+                // nothing to issue, or the program ends in front of it
+            } else if (!idPrev[0].isLegal) {
+                stats.add(STAT_EXCEPTIONS);
+                if (profiler) profiler->charge(idPrev[0].PC, PROFILE_EXCEPTION, 2);
+                pipelineInfo.exInst[0] = nop(SQUASHED);
+                redirect = true;
+                redirectPC = EXCEPTION_HANDLER;
+            } else {
+                StatCounter hazard = hazardDual(idPrev[0], prev);
+                if (hazard != NUM_STAT_COUNTERS) {
+                    stats.add(hazard);
+                    if (profiler) profiler->charge(idPrev[0].PC, PROFILE_LOAD_USE);
+                } else {
+                    redirect = issueDual(idPrev[0], pipelineInfo.exInst[0], redirectPC);
+                    issued = 1;
+                    if (!redirect && pairs(idPrev[0], idPrev[1]) &&
+                        hazardDual(idPrev[1], prev) == NUM_STAT_COUNTERS) {
+                        redirect = issueDual(idPrev[1], pipelineInfo.exInst[1], redirectPC);
+                        issued = 2;
+                    }
                 }
             }
+            stats.add(STAT_DUAL_ISSUE_CYCLES, issued == 2);
 
-        }
+            // ID SEQUENCE
+            bool fetchStalled = iCacheStallCycles > 0;
+            if (fetchStalled) {
+                iCacheStallCycles--;
+                stats.add(STAT_IC_STALL_CYCLES);
+                if (profiler) profiler->charge(prev.ifInst[0].PC, PROFILE_ICACHE);
+            }
+            if (redirect) {
+                // the instructions fetched past it are on the wrong path, fetch starts
+                // over at the right one
+                pipelineInfo.idInst[0] = pipelineInfo.idInst[1] = nop(SQUASHED);
+                pipelineInfo.ifInst[0] = pipelineInfo.ifInst[1] = nop(SQUASHED);
+                PC = redirectPC;
+                fetchStalled = false;
+                iCacheStallCycles = 0;
+            } else {
+                // what did not issue moves to the front, IF fills up the rest
+                int held = 0;
+                for (int slot = issued; slot < 2; slot++) {
+                    if (holdsInstruction(idPrev[slot])) pipelineInfo.idInst[held++] = idPrev[slot];
+                }
+                int moved = 0;
+                while (!fetchStalled && held < 2 && moved < 2 &&
+                       holdsInstruction(prev.ifInst[moved])) {
+                    Simulator::Instruction& idInst = pipelineInfo.idInst[held++];
+                    idInst = prev.ifInst[moved++];
+                    simulator->simID(idInst);
+                    idInst.status = NORMAL;
+                }
+                for (int slot = held; slot < 2; slot++) pipelineInfo.idInst[slot] = nop(BUBBLE);
+                for (int slot = 0; slot < 2; slot++) {
+                    pipelineInfo.ifInst[slot] =
+                        slot + moved < 2 ? prev.ifInst[slot + moved] : nop(BUBBLE);
+                }
+            }
 
-        // IF SEQUENCE
-        if(bubbleEXstallID){
-            pipelineInfo.ifInst = ifPrev; 
-        }
-        else{
-            pipelineInfo.ifInst = simulator->simIF(PC);
-            if (iCacheStallCycles == 0 && pipelineInfo.idInst.isLegal){
-                iCacheStall = !iCache->access(PC, CACHE_READ);
-                if (iCacheStall) {
-                    iCacheStallCycles = iCache->config.missLatency;
-                    iCacheStall = false;
+            // IF SEQUENCE, once ID took all of the last fetch
+            if (!fetchStalled && !holdsInstruction(pipelineInfo.ifInst[0])) {
+                // a fetch behind an illegal instruction does not stall, as in runCycles
+                fetchDual(pipelineInfo.ifInst,
+                          pipelineInfo.idInst[0].isLegal && pipelineInfo.idInst[1].isLegal);
+            }
+
+            // UPDATE STATUS FOR IF
+            if (isControlTransfer(pipelineInfo.idInst[0]) ||
+                isControlTransfer(pipelineInfo.idInst[1])) {
+                for (Simulator::Instruction& ifInst : pipelineInfo.ifInst) {
+                    if (holdsInstruction(ifInst)) ifInst.status = SPECULATIVE;
                 }
             }
-        }
 
-        // UPDATE STATUS FOR IF
-        if((pipelineInfo.idInst.opcode == OP_BRANCH) 
-        || (pipelineInfo.idInst.opcode == OP_JALR) 
-        || (pipelineInfo.idInst.opcode == OP_JAL)){
-            pipelineInfo.ifInst.status = SPECULATIVE;
+            latch ^= 1;
         }
 
-        if(!iCacheStall){
-           // MOVE ON
-            PC = nextPC; 
+    DUMP_STATE:
+        const DualPipelineInfo& state = dualPipeline[latch];
+        if (pipeTrace.traces(pipeState.cycle)) {
+            pipeState.ifPC = state.ifInst[0].PC;
+            pipeState.ifStatus = state.ifInst[0].status;
+            pipeState.idInstr = state.idInst[0].instruction;
+            pipeState.idStatus = state.idInst[0].status;
+            pipeState.exInstr = state.exInst[0].instruction;
+            pipeState.exStatus = state.exInst[0].status;
+            pipeState.memInstr = state.memInst[0].instruction;
+            pipeState.memStatus = state.memInst[0].status;
+            pipeState.wbInstr = state.wbInst[0].instruction;
+            pipeState.wbStatus = state.wbInst[0].status;
+            pipeTrace.write(pipeState);
         }
-        
-
-        if (pipelineInfo.wbInst.isHalt) {
+        if (anyHalt(state.wbInst)) {
             status = HALT;
             break;
         }
     }
-
-    DUMP_STATE:
-    pipeState.ifPC = pipelineInfo.ifInst.PC;
-    pipeState.ifStatus = pipelineInfo.ifInst.status;
-    pipeState.idInstr = pipelineInfo.idInst.instruction;
-    pipeState.idStatus = pipelineInfo.idInst.status;
-    pipeState.exInstr = pipelineInfo.exInst.instruction;
-    pipeState.exStatus = pipelineInfo.exInst.status;
-    pipeState.memInstr = pipelineInfo.memInst.instruction;
-    pipeState.memStatus = pipelineInfo.memInst.status;
-    pipeState.wbInstr = pipelineInfo.wbInst.instruction;
-    pipeState.wbStatus = pipelineInfo.wbInst.status;
-    dumpPipeState(pipeState, output);
     return status;
 }
 
-// run till halt (call runCycles() with cycles == 1 each time) until
-// status tells you to HALT or ERROR out
-Status runTillHalt() {
-    Status status;
-    while (true) {
-        status = static_cast<Status>(runCycles(1));
-        if (status == HALT) break;
+StatsRegistry CycleSimulator::getCounters() const {
+    StatsRegistry counters = stats;
+    counters.set(STAT_CYCLES, cycleCount);
+    // an ideal (zero miss latency) cache is no cache at all, it reports no accesses
+    if (iCache->config.missLatency > 0) {
+        counters.set(STAT_IC_HITS, iCache->getHits());
+        counters.set(STAT_IC_MISSES, iCache->getMisses());
     }
-    return status;
+    if (dCache->config.missLatency > 0) {
+        counters.set(STAT_DC_HITS, dCache->getHits());
+        counters.set(STAT_DC_MISSES, dCache->getMisses());
+    }
+    for (size_t i = 0; i < hierarchy->numLevels(); i++) {
+        StatCounter hits = i == 0 ? STAT_L2_HITS : STAT_L3_HITS;
+        counters.set(hits, hierarchy->level(i).getHits());
+        counters.set(static_cast<StatCounter>(hits + 1), hierarchy->level(i).getMisses());
+    }
+    counters.set(STAT_MEMORY_READS, hierarchy->getMemoryReads());
+    counters.set(STAT_MEMORY_WAIT_CYCLES, hierarchy->getMemoryWaitCycles());
+    counters.set(STAT_MEMORY_WRITES, hierarchy->getMemoryWrites());
+    counters.set(STAT_MEMORY_WRITE_BYTES, hierarchy->getMemoryWriteBytes());
+    if (dCache->config.missLatency > 0) {
+        counters.set(STAT_DC_WRITE_BACKS, dCache->getWriteBacks());
+    }
+    if (iPrefetcher) {
+        counters.set(STAT_IC_PREFETCHES, iCache->getPrefetches());
+        counters.set(STAT_IC_USEFUL_PREFETCHES, iCache->getUsefulPrefetches());
+    }
+    if (dPrefetcher) {
+        counters.set(STAT_DC_PREFETCHES, dCache->getPrefetches());
+        counters.set(STAT_DC_USEFUL_PREFETCHES, dCache->getUsefulPrefetches());
+    }
+    return counters;
 }
 
 // dump the state of the simulator
-Status finalizeSimulator() {
+Status CycleSimulator::finalize() {
+    pipeTrace.close();
+    memTrace.close();
     simulator->dumpRegMem(output);
-    SimulationStats stats{simulator->getDin(),  cycleCount, 0, 0, 0, 0, 0};  // TODO incomplete implementation
-    dumpSimStats(stats, output);
+    StatsRegistry counters = getCounters();
+    SimulationStats simStats = counters.toSimulationStats();
+    dumpSimStats(simStats, output);
+    counters.dump(statsFormat, output);
+    if (profiler) profiler->dump(simulator->getMemory(), cycleCount, output);
+    if (iSweep) dumpCacheSweep(*iSweep, *dSweep, output);
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+// the simulation driven by the C-style interface, defaultHarts if it has more than one
+static CycleSimulator defaultSimulator;
+static MultiHart defaultHarts;
+static bool multiHart = false;
+
+Status initSimulator(CacheConfig& iCacheConfig, CacheConfig& dCacheConfig, MemoryStore* mem,
+                     const std::string& output_name, const CycleOptions& options) {
+    multiHart = options.harts > 1;
+    if (multiHart) return defaultHarts.init(iCacheConfig, dCacheConfig, mem, output_name, options);
+    return defaultSimulator.init(iCacheConfig, dCacheConfig, mem, output_name, options);
+}
+
+Status runCycles(uint64_t cycles) {
+    if (multiHart) return defaultHarts.runCycles(cycles);
+    return defaultSimulator.runCycles(cycles);
+}
+
+// run till halt (a single runCycles() call with cycles == 0) until
+// status tells you to HALT or ERROR out
+Status runTillHalt() {
+    return runCycles(0);
+}
+
+// dump the state of the simulator
+Status finalizeSimulator() {
+    if (multiHart) return defaultHarts.finalize();
+    return defaultSimulator.finalize();
+}
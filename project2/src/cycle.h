@@ -1,20 +1,193 @@
 #pragma once
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "BranchPredictor.h"
+#include "CacheHierarchy.h"
+#include "Checkpoint.h"
 #include "cache.h"
+#include "MemTrace.h"
+#include "MissHandler.h"
+#include "PipeTrace.h"
+#include "Prefetcher.h"
+#include "Profiler.h"
+#include "Stats.h"
+#include "ThreadedEngine.h"
 #include "Utilities.h"
 #include "simulator.h"
+#include "sweep.h"
+
+// Optional settings of the cycle simulator, the defaults match the reference outputs
+struct CycleOptions {
+    PipeTraceConfig trace;
+    // cache geometries evaluated alongside the simulated caches on the same access
+    // streams (see CacheSweep), written to <output_name>_cache_sweep.out
+    std::vector<CacheConfig> iCacheSweep;
+    std::vector<CacheConfig> dCacheSweep;
+    // if not empty, the I- and D-cache access streams are recorded to this file
+    std::string memTrace;
+    // run the first fastForward instructions functionally, the last warmup of them
+    // accessing the caches, before the pipeline starts (see fastForward)
+    uint64_t fastForward = 0;
+    uint64_t warmup = UINT64_MAX;
+    // if not empty, the state is restored from this checkpoint before the fast-forward
+    // and saved to the other one after it (see saveCheckpoint)
+    std::string loadCheckpoint;
+    std::string saveCheckpoint;
+    // also write the counters to <output_name>_sim_stats.json or .csv
+    StatsFormat statsFormat = STATS_TEXT;
+    // charge every cycle to an instruction (see Profiler), written to
+    // <output_name>_profile.out
+    bool profile = false;
+    // next-PC prediction in IF, PREDICT_NONE keeps fetching at PC + 4
+    PredictorConfig predictor;
+    // MSHRs of a non-blocking D-cache (see MissHandler), 0 is the blocking one, and
+    // the entries of its store buffer
+    uint64_t mshrs = 0;
+    uint64_t storeBufferEntries = 8;
+    // the L2, L3 and memory behind the L1 caches, from cache_config.txt
+    HierarchyConfig hierarchy;
+    // the in-order dual-issue pipeline (see runCyclesDual) instead of the reference one
+    bool dualIssue = false;
+    // harts sharing the memory (see MultiHart), hart i starts with a0 = i and a1 = harts;
+    // more than one does not combine with a fast-forward, checkpoints or a memory trace
+    uint64_t harts = 1;
+};
+
+// A D-cache access of one hart of a MultiHart simulation that other harts need to know
+// about: every store and every load miss
+struct SharedAccess {
+    uint64_t address;
+    uint8_t bytes;
+    bool write;
+};
+
+// One cycle-accurate simulation. All of its state lives in the object, so any
+// number of them can run in the same process (one thread per object at a time).
+class CycleSimulator {
+   private:
+    struct PipelineInfo {
+        Simulator::Instruction ifInst;
+        Simulator::Instruction idInst;
+        Simulator::Instruction exInst;
+        Simulator::Instruction memInst;
+        Simulator::Instruction wbInst;
+    };
+    // a latch of the dual-issue pipeline: slot 0 holds the older instruction, and a
+    // slot 1 is only taken with slot 0
+    struct DualPipelineInfo {
+        Simulator::Instruction ifInst[2];
+        Simulator::Instruction idInst[2];
+        Simulator::Instruction exInst[2];
+        Simulator::Instruction memInst[2];
+        Simulator::Instruction wbInst[2];
+    };
+
+    std::unique_ptr<Simulator> simulator;
+    std::unique_ptr<Cache> iCache;
+    std::unique_ptr<Cache> dCache;
+    std::unique_ptr<CacheHierarchy> hierarchy;
+    std::unique_ptr<CacheSweep> iSweep;
+    std::unique_ptr<CacheSweep> dSweep;
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<BranchPredictor> predictor;
+    std::unique_ptr<MissHandler> missHandler;
+    std::unique_ptr<Prefetcher> iPrefetcher;
+    std::unique_ptr<Prefetcher> dPrefetcher;
+    std::string output;
+    PipeTrace pipeTrace;
+    MemTraceWriter memTrace;
+    StatsRegistry stats;
+    StatsFormat statsFormat;
+    uint64_t cycleCount;
+    uint64_t PC;
+    // double-buffered pipeline latches: a cycle computes pipeline[latch ^ 1] from
+    // pipeline[latch] and then flips latch, a stalled cycle updates pipeline[latch]
+    PipelineInfo pipeline[2];
+    DualPipelineInfo dualPipeline[2];
+    bool dualIssue;
+    unsigned latch;
+
+    // keep track of the number of cycles stall is applied
+    uint64_t iCacheStallCycles;
+    uint64_t dCacheStallCycles;
+    // scoreboard of the non-blocking D-cache: last cycle each register waits for the
+    // data of a load
+    uint64_t loadReady[32];
+    // cycle each entry of the write buffer of a blocking write-buffer D-cache drains
+    std::vector<uint64_t> writeBuffer;
+    // a hart of a MultiHart simulation records its SharedAccesses here, in program order
+    std::vector<SharedAccess>* sharedLog;
+
+    uint64_t stallSkip(uint64_t stall, uint64_t cycle, uint64_t cycles, uint64_t count);
+    void fastForward(uint64_t instructions, uint64_t warmup);
+    bool iCacheAccess(uint64_t address);
+    bool dCacheAccess(uint64_t address, CacheOperation type);
+    uint64_t missPenalty(const Cache& l1, uint64_t address);
+    uint64_t writePenalty(const Cache& l1, uint64_t address, uint64_t bytes);
+    uint64_t prefetchAfter(Cache& l1, Prefetcher* prefetcher, uint64_t PC, uint64_t address,
+                           bool hit, StatCounter late);
+    bool writesThrough(const Simulator::Instruction& inst) const;
+    void dCacheTiming(const Simulator::Instruction& memInst);
+    void fetchTiming(uint64_t PC, bool stalls);
+    StatCounter hazardDual(const Simulator::Instruction& inst,
+                           const DualPipelineInfo& prev) const;
+    bool issueDual(Simulator::Instruction& inst, Simulator::Instruction& exInst,
+                   uint64_t& redirectPC);
+    void fetchDual(Simulator::Instruction (&ifInst)[2], bool stalls);
+    Status runCyclesDual(uint64_t cycles);
+    bool waitsForLoad(const Simulator::Instruction& inst) const;
+
+   public:
+    CycleSimulator();
+
+    // runs its harts on their CycleSimulators
+    friend class MultiHart;
+
+    // (re)start a simulation of memory, which stays owned by the caller
+    Status init(CacheConfig& icConfig, CacheConfig& dcConfig, MemoryStore* memory,
+                const std::string& output_name, const CycleOptions& options = CycleOptions());
+
+    // run the simulator for a certain number of cycles, cycles == 0 runs until halt
+    Status runCycles(uint64_t cycles);
+
+    // a single runCycles() call with cycles == 0
+    Status runTillHalt() { return runCycles(0); }
+
+    // all counters of the run so far, including the cycles and cache hits and misses
+    StatsRegistry getCounters() const;
+
+    // statistics of the run so far, as written to <output_name>_sim_stats.out
+    SimulationStats getStats() const { return getCounters().toSimulationStats(); }
+
+    // Save the complete state between two cycles: registers, din, memory, the cache
+    // hierarchy, the predictor, outstanding misses, the prefetchers, the write buffer,
+    // the pipeline latches, PC, counters and stalls. Sweeps and traces are not part of
+    // it. Loading needs a simulation of the same program, init'ed with any cache,
+    // predictor, MSHR and prefetcher configuration: the parts configured differently
+    // start out cold (or with no misses outstanding).
+    Status saveCheckpoint(const std::string& fileName);
+    Status loadCheckpoint(const std::string& fileName);
+
+    // dump the state of the simulator
+    Status finalize();
+};
+
+// The functions below drive one process-wide CycleSimulator, or a MultiHart of
+// options.harts of them.
 
 // init the simulator and all info
 Status initSimulator(CacheConfig& icConfig, CacheConfig& dcConfig, MemoryStore* memory,
-                     const std::string& output_name);
+                     const std::string& output_name,
+                     const CycleOptions& options = CycleOptions());
 
-// run the simulator for a certain number of cycles
+// run the simulator for a certain number of cycles, cycles == 0 runs until halt
 Status runCycles(uint64_t cycles);
 
-// run till halt (call runCycles() with cycles == 1 each time) until
+// run till halt (a single runCycles() call with cycles == 0) until
 // status tells you to HALT or ERROR out
 Status runTillHalt();
 
 // dump the state of the simulator
-Status finalizeSimulator();
\ No newline at end of file
+Status finalizeSimulator();
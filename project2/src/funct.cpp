@@ -2,32 +2,48 @@
 
 #include <iostream>
 
+#include "MemTrace.h"
 #include "cache.h"
 #include "Utilities.h"
 #include "simulator.h"
 
-static Simulator* simulator = nullptr;
-static std::string output;
-static uint64_t PC = 0;
+FunctionalSimulator::FunctionalSimulator() : PC(0) {}
 
 // initialize the simulator
-Status initSimulator(MemoryStore* mem, const std::string& output_name) {
+Status FunctionalSimulator::init(MemoryStore* mem, const std::string& output_name,
+                                 const FunctOptions& options) {
     output = output_name;
-    simulator = new Simulator();
+    simulator.reset(new Simulator());
     simulator->setMemory(mem);
+    PC = mem->getEntryPoint();
+    engine.reset();
+    if (options.engine == ENGINE_THREADED && options.memTrace.empty()) {
+        engine.reset(new ThreadedEngine(*simulator));
+    }
+    memTrace.close();
+    if (!options.memTrace.empty()) return memTrace.open(options.memTrace);
     return SUCCESS;
 }
 
 // run the simulator for a certain number of intructions
 // return SUCCESS if count of executed instructions == desired intructions.
 // return HALT if the simulator halts on 0xfeedfeed
-Status runInstructions(uint64_t instructions) {
+Status FunctionalSimulator::runInstructions(uint64_t instructions) {
+    if (engine) return engine->run(PC, instructions);
+
     uint64_t numInstructions = 0;
     auto status = SUCCESS;
+    Simulator::Instruction inst;
 
     while (instructions == 0 || numInstructions < instructions) {
 
-        Simulator::Instruction inst = simulator->simInstruction(PC);
+        simulator->simInstruction(PC, inst);
+
+        if (memTrace.isOpen()) {
+            memTrace.write(PC, MEM_IFETCH);
+            if (inst.isLegal && inst.readsMem) memTrace.write(inst.memAddress, MEM_READ);
+            if (inst.isLegal && inst.writesMem) memTrace.write(inst.memAddress, MEM_WRITE);
+        }
 
         numInstructions += 1;
         PC = inst.nextPC;
@@ -45,21 +61,34 @@ Status runInstructions(uint64_t instructions) {
     return status;
 }
 
-// run till halt (call runInstructions() with instructions == 1 each time) until
+// dump the stats of the simulator
+Status FunctionalSimulator::finalize() {
+    memTrace.close();
+    simulator->dumpRegMem(output);
+    SimulationStats stats{simulator->getDin(), 0,};
+    dumpSimStats(stats, output);
+    return SUCCESS;
+}
+
+// the simulation driven by the C-style interface
+static FunctionalSimulator defaultSimulator;
+
+Status initSimulator(MemoryStore* mem, const std::string& output_name,
+                     const FunctOptions& options) {
+    return defaultSimulator.init(mem, output_name, options);
+}
+
+Status runInstructions(uint64_t instructions) {
+    return defaultSimulator.runInstructions(instructions);
+}
+
+// run till halt (a single runInstructions() call with instructions == 0) until
 // status tells you to HALT or ERROR out
 Status runTillHalt() {
-    Status status;
-    while (true) {
-        status = static_cast<Status>(runInstructions(1));
-        if (status == HALT || status == ERROR) break;
-    }
-    return status;
+    return defaultSimulator.runTillHalt();
 }
 
 // dump the stats of the simulator
 Status finalizeSimulator() {
-    simulator->dumpRegMem(output);
-    SimulationStats stats{simulator->getDin(), 0,};
-    dumpSimStats(stats, output);
-    return SUCCESS;
+    return defaultSimulator.finalize();
 }
@@ -1,16 +1,63 @@
 #pragma once
+#include <memory>
 #include <string>
 
+#include "MemTrace.h"
+#include "ThreadedEngine.h"
 #include "Utilities.h"
 #include "simulator.h"
 
+// How the functional simulator executes instructions
+enum FunctEngine {
+    ENGINE_INTERPRETER,  // Simulator::simInstruction, one instruction at a time
+    ENGINE_THREADED,     // ThreadedEngine, translated basic blocks
+};
+
+// Optional settings of the functional simulator
+struct FunctOptions {
+    FunctEngine engine = ENGINE_THREADED;
+    // if not empty, every instruction fetch, load and store address is recorded to
+    // this file (see MemTrace.h); the memory trace is written by the interpreter
+    std::string memTrace;
+};
+
+// One functional simulation. All of its state lives in the object, so any number
+// of them can run in the same process (one thread per object at a time).
+class FunctionalSimulator {
+   private:
+    std::unique_ptr<Simulator> simulator;
+    std::unique_ptr<ThreadedEngine> engine;  // null when running on the interpreter
+    std::string output;
+    MemTraceWriter memTrace;
+    uint64_t PC;
+
+   public:
+    FunctionalSimulator();
+
+    // (re)start a simulation of memory, which stays owned by the caller
+    Status init(MemoryStore* memory, const std::string& output_name,
+                const FunctOptions& options = FunctOptions());
+
+    // run the simulator for a certain number of instructions, 0 runs until halt or error
+    Status runInstructions(uint64_t instructions);
+
+    // a single runInstructions() call with instructions == 0
+    Status runTillHalt() { return runInstructions(0); }
+
+    // dump the state of the simulator
+    Status finalize();
+};
+
+// The functions below drive one process-wide FunctionalSimulator.
+
 // init the simulator and all info
-Status initSimulator(MemoryStore* memory, const std::string& output_name);
+Status initSimulator(MemoryStore* memory, const std::string& output_name,
+                     const FunctOptions& options = FunctOptions());
 
-// run the simulator for a certain number of instructions
+// run the simulator for a certain number of instructions, 0 runs until halt or error
 Status runInstructions(uint64_t instructions);
 
-// run till halt (call runInstructions() with instructions == 1 each time) until
+// run till halt (a single runInstructions() call with instructions == 0) until
 // status tells you to HALT or ERROR out
 Status runTillHalt();
 
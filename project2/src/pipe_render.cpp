@@ -0,0 +1,35 @@
+/** NOTE pipe trace renderer
+ * Turns a binary pipe state trace (<name>_pipe_state.trc, written by
+ * sim_cycle --trace-format=binary|binary-rle) back into the text format of
+ * <name>_pipe_state.out.
+ */
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PipeTrace.h"
+#include "Utilities.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        cerr << LOG_ERROR << "Usage: " << argv[0] << " <trace.trc> [output.out]" << endl;
+        return ERROR;
+    }
+
+    string traceFile = argv[1];
+    string outFile = argc == 3 ? argv[2] : getBaseFilename(argv[1]) + ".out";
+
+    vector<char> buffer(PIPE_TRACE_BUFFER_SIZE);
+    ofstream pipe_out;
+    pipe_out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    pipe_out.open(outFile);
+    if (!pipe_out) {
+        cerr << LOG_ERROR << "Could not open " << outFile << endl;
+        return ERROR;
+    }
+
+    return renderPipeTrace(traceFile, pipe_out);
+}
@@ -0,0 +1,198 @@
+/** Batch driver for the cycle-accurate simulator.
+ * Runs every program of a manifest against every cache configuration of it, in one
+ * process, on a work-stealing thread pool. Each program is loaded once; every run
+ * starts from a copy of that image, which shares its pages until they are written.
+ *
+ * Manifest lines ('#' starts a comment):
+ *     program <file.bin|file.elf>
+ *     config <cache_config.txt>
+ *
+ * The outputs of a run are named as those of sim_cycle, <program>_cycle_*, or with
+ * several configs <program>_cycle_config<i>_* for the i-th config (from 0).
+ */
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "MemoryStore.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include "cache.h"
+#include "cycle.h"
+
+using namespace std;
+
+struct BatchConfig {
+    std::string file;
+    CacheConfig iCache;
+    CacheConfig dCache;
+    HierarchyConfig hierarchy;
+};
+
+struct BatchRun {
+    size_t program;
+    size_t config;
+    Status status;
+    SimulationStats stats;
+};
+
+static void printUsage(const char* prog) {
+    cerr << LOG_ERROR << "Usage: " << prog << " <manifest.txt> [options]" << endl
+         << "Options:" << endl
+         << "  --jobs=N  number of worker threads (one per hardware thread)" << endl
+         << "  --csv=<file.csv>  write the statistics of all runs to one CSV file instead "
+            "of the per-run output files"
+         << endl;
+}
+
+static const char* statusName(Status status) {
+    switch (status) {
+        case SUCCESS:
+            return "success";
+        case HALT:
+            return "halt";
+        default:
+            return "error";
+    }
+}
+
+static Status parseManifest(const std::string& manifest, std::vector<std::string>& programs,
+                            std::vector<BatchConfig>& configs) {
+    std::ifstream in(manifest);
+    if (!in.is_open()) {
+        cerr << LOG_ERROR << "Failed to open manifest: " << manifest << endl;
+        return ERROR;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::stringstream ss(line.substr(0, line.find('#')));
+        std::string kind, path;
+        if (!(ss >> kind)) continue;
+        if (!(ss >> path) || (kind != "program" && kind != "config")) {
+            cerr << LOG_ERROR << manifest << ":" << lineNumber
+                 << ": expected \"program <file.bin>\" or \"config <cache_config.txt>\"" << endl;
+            return ERROR;
+        }
+        if (kind == "program") {
+            programs.push_back(path);
+            continue;
+        }
+
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            cerr << LOG_ERROR << "Failed to open cache config file: " << path << endl;
+            return ERROR;
+        }
+        BatchConfig config;
+        config.file = path;
+        try {
+            parseCacheConfig(file, config.iCache, config.dCache, config.hierarchy);
+        } catch (const std::exception& e) {
+            cerr << LOG_ERROR << path << ": " << e.what() << endl;
+            return ERROR;
+        }
+        configs.push_back(config);
+    }
+    return SUCCESS;
+}
+
+static Status writeCsv(const std::string& csvFile, const std::vector<BatchRun>& runs,
+                       const std::vector<std::string>& programs,
+                       const std::vector<BatchConfig>& configs) {
+    std::ofstream csv(csvFile);
+    if (!csv) {
+        cerr << LOG_ERROR << "Could not create " << csvFile << endl;
+        return ERROR;
+    }
+    csv << "program,config,status,dynamic_instructions,total_cycles,icache_hits,"
+           "icache_misses,dcache_hits,dcache_misses,load_use_stalls"
+        << endl;
+    for (const BatchRun& run : runs) {
+        const SimulationStats& stats = run.stats;
+        csv << programs[run.program] << "," << configs[run.config].file << ","
+            << statusName(run.status) << "," << stats.dynamicInstructions << ","
+            << stats.totalCycles << "," << stats.icHits << "," << stats.icMisses << ","
+            << stats.dcHits << "," << stats.dcMisses << "," << stats.loadUseStalls << endl;
+    }
+    return SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return ERROR;
+    }
+
+    size_t jobs = 0;
+    std::string csvFile;
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.compare(0, 7, "--jobs=") == 0) {
+                jobs = std::stoul(arg.substr(7));
+            } else if (arg.compare(0, 6, "--csv=") == 0) {
+                csvFile = arg.substr(6);
+            } else {
+                printUsage(argv[0]);
+                return ERROR;
+            }
+        }
+    } catch (const std::exception& e) {
+        cerr << LOG_ERROR << "Invalid option value" << endl;
+        return ERROR;
+    }
+
+    std::vector<std::string> programs;
+    std::vector<BatchConfig> configs;
+    if (parseManifest(argv[1], programs, configs) != SUCCESS) return ERROR;
+
+    // load every program once; the runs copy these images but never touch them
+    std::vector<std::unique_ptr<const MemoryStore>> images;
+    for (const std::string& program : programs) {
+        images.emplace_back(createMemoryStore(program.c_str()));
+        if (!images.back()) return ERROR;
+    }
+
+    std::vector<BatchRun> runs;
+    for (size_t p = 0; p < programs.size(); p++) {
+        for (size_t c = 0; c < configs.size(); c++) runs.push_back({p, c, ERROR, {}});
+    }
+
+    WorkStealingPool pool(jobs);
+    cout << "[Simulator] Running " << runs.size() << " simulations on " << pool.size()
+         << " threads" << endl;
+
+    pool.run(runs.size(), [&](size_t i) {
+        BatchRun& run = runs[i];
+        BatchConfig config = configs[run.config];
+        // named as sim_cycle names them, the configs told apart by their manifest order
+        std::string output = getBaseFilename(programs[run.program].c_str()) + "_cycle";
+        if (configs.size() > 1) output += "_config" + std::to_string(run.config);
+
+        // the pipe state trace of thousands of runs is not wanted here
+        CycleOptions options;
+        options.trace.mode = TRACE_OFF;
+        options.hierarchy = config.hierarchy;
+
+        MemoryStore memory(*images[run.program]);
+        CycleSimulator simulator;
+        run.status = simulator.init(config.iCache, config.dCache, &memory, output, options);
+        if (run.status != SUCCESS) return;
+        run.status = simulator.runTillHalt();
+        run.stats = simulator.getStats();
+        if (csvFile.empty()) simulator.finalize();
+    });
+
+    if (!csvFile.empty() && writeCsv(csvFile, runs, programs, configs) != SUCCESS) return ERROR;
+
+    size_t failed = 0;
+    for (const BatchRun& run : runs) failed += run.status == ERROR;
+    cout << "[Simulator] Finished " << runs.size() << " simulations, " << failed << " with errors"
+         << endl;
+    return failed ? ERROR : SUCCESS;
+}
@@ -5,25 +5,199 @@
  */
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include "cache.h"
 #include "MemoryStore.h"
 #include "Utilities.h"
 #include "cycle.h"
+#include "sweep.h"
 
 using namespace std;
 
-inline std::tuple<std::string, CacheConfig, CacheConfig> parseArgs(int argc, char** argv) {
-    if (argc != 3) {
-        std::cerr << LOG_ERROR << "Usage: " << argv[0] << " <file.bin> <cache_config.txt>"
-                  << std::endl
-                  << "Note:" << std::endl
-                  << "The sim_cycle binary should take two command-line arguments indicating the "
-                     "name of the binary file to be read and the cache configuration file to be "
-                     "used. [See detail in project description document]."
-                  << std::endl;
+static void printUsage(const char* prog) {
+    std::cerr << LOG_ERROR << "Usage: " << prog
+              << " <file.bin|file.elf> <cache_config.txt> [options]" << std::endl
+              << "Note:" << std::endl
+              << "The sim_cycle binary should take two command-line arguments indicating the "
+                 "name of the binary file to be read and the cache configuration file to be "
+                 "used. [See detail in project description document]."
+              << std::endl
+              << "Options:" << std::endl
+              << "  --trace-format=text|binary|binary-rle  pipe state trace format (text)"
+              << std::endl
+              << "  --trace=off|all|every:N|window:START:END  cycles to trace (all)"
+              << std::endl
+              << "  --sweep=<sweep.txt>  also count hits/misses of the LRU cache geometries "
+                 "listed in sweep.txt"
+              << std::endl
+              << "  --mem-trace=<file.mtr>  record the I- and D-cache accesses for cache_replay"
+              << std::endl
+              << "  --fast-forward=N  execute the first N instructions functionally before "
+                 "the pipeline starts"
+              << std::endl
+              << "  --warmup=W  warm the caches during the last W fast-forwarded "
+                 "instructions (all of them)"
+              << std::endl
+              << "  --load-checkpoint=<file.ckpt>  start from a checkpoint of the same program"
+              << std::endl
+              << "  --save-checkpoint=<file.ckpt>  save a checkpoint once the fast-forward is "
+                 "done"
+              << std::endl
+              << "  --stats=text|json|csv  also write all counters to _sim_stats.json/.csv (text)"
+              << std::endl
+              << "  --profile  charge every cycle to an instruction, written to _profile.out"
+              << std::endl
+              << "  --predictor=none|bimodal|gshare  next-PC prediction in IF (none)" << std::endl
+              << "  --btb-entries=N --predictor-entries=N --history-bits=N --ras-entries=N  "
+                 "predictor sizes (512, 4096, 12, 8)"
+              << std::endl
+              << "  --mshrs=N  non-blocking D-cache with N MSHRs (0: blocking)" << std::endl
+              << "  --store-buffer=N  store buffer entries of the non-blocking D-cache (8)"
+              << std::endl
+              << "  --dual-issue  in-order pipeline issuing up to two instructions per cycle"
+              << std::endl
+              << "  --harts=N  run N harts on one memory, hart i with a0 = i, a1 = N (1); "
+                 "they run in lock-step, a load sees the stores of earlier cycles and of "
+                 "lower harts in the same cycle, the D-caches are kept coherent (MSI)"
+              << std::endl;
+}
+
+// parse an unsigned integer option value, hex values need a 0x prefix
+static uint64_t parseNumber(const std::string& value) {
+    size_t used = 0;
+    uint64_t number = std::stoull(value, &used, 0);
+    if (used != value.size()) throw std::invalid_argument("Invalid number: " + value);
+    return number;
+}
+
+// --trace=off|all|every:N|window:START:END
+static PipeTraceConfig parseTraceMode(const std::string& value, PipeTraceConfig trace) {
+    std::vector<std::string> fields;
+    std::stringstream ss(value);
+    std::string field;
+    while (std::getline(ss, field, ':')) fields.push_back(field);
+
+    if (fields.size() == 1 && fields[0] == "off") {
+        trace.mode = TRACE_OFF;
+    } else if (fields.size() == 1 && fields[0] == "all") {
+        trace.mode = TRACE_ALL;
+    } else if (fields.size() == 2 && fields[0] == "every") {
+        trace.mode = TRACE_EVERY;
+        trace.interval = parseNumber(fields[1]);
+        if (trace.interval == 0) throw std::invalid_argument("Trace interval must be > 0");
+    } else if (fields.size() == 3 && fields[0] == "window") {
+        trace.mode = TRACE_WINDOW;
+        trace.windowStart = parseNumber(fields[1]);
+        trace.windowEnd = parseNumber(fields[2]);
+    } else {
+        throw std::invalid_argument("Unknown trace mode: " + value);
+    }
+    return trace;
+}
+
+// parse the optional --name=value arguments following the two positional ones
+static CycleOptions parseOptions(int argc, char** argv) {
+    CycleOptions options;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (name == "--trace-format") {
+            if (value == "text") {
+                options.trace.format = TRACE_TEXT;
+            } else if (value == "binary") {
+                options.trace.format = TRACE_BINARY;
+            } else if (value == "binary-rle") {
+                options.trace.format = TRACE_BINARY_RLE;
+            } else {
+                throw std::invalid_argument("Unknown trace format: " + value);
+            }
+        } else if (name == "--trace") {
+            options.trace = parseTraceMode(value, options.trace);
+        } else if (name == "--sweep") {
+            std::ifstream sweepFile(value);
+            if (!sweepFile.is_open()) {
+                throw std::invalid_argument("Failed to open sweep file: " + value);
+            }
+            parseSweepSpec(sweepFile, options.iCacheSweep, options.dCacheSweep);
+        } else if (name == "--mem-trace") {
+            options.memTrace = value;
+        } else if (name == "--fast-forward") {
+            options.fastForward = parseNumber(value);
+        } else if (name == "--warmup") {
+            options.warmup = parseNumber(value);
+        } else if (name == "--load-checkpoint") {
+            options.loadCheckpoint = value;
+        } else if (name == "--save-checkpoint") {
+            options.saveCheckpoint = value;
+        } else if (name == "--predictor") {
+            if (value == "none") {
+                options.predictor.kind = PREDICT_NONE;
+            } else if (value == "bimodal") {
+                options.predictor.kind = PREDICT_BIMODAL;
+            } else if (value == "gshare") {
+                options.predictor.kind = PREDICT_GSHARE;
+            } else {
+                throw std::invalid_argument("Unknown predictor: " + value);
+            }
+        } else if (name == "--btb-entries") {
+            options.predictor.btbEntries = parseNumber(value);
+        } else if (name == "--predictor-entries") {
+            options.predictor.tableEntries = parseNumber(value);
+        } else if (name == "--history-bits") {
+            options.predictor.historyBits = parseNumber(value);
+        } else if (name == "--ras-entries") {
+            options.predictor.rasEntries = parseNumber(value);
+        } else if (name == "--mshrs") {
+            options.mshrs = parseNumber(value);
+        } else if (name == "--store-buffer") {
+            options.storeBufferEntries = parseNumber(value);
+            if (options.storeBufferEntries == 0) {
+                throw std::invalid_argument("The store buffer needs at least 1 entry");
+            }
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--dual-issue") {
+            options.dualIssue = true;
+        } else if (name == "--harts") {
+            options.harts = parseNumber(value);
+            if (options.harts == 0 || options.harts > 64) {
+                throw std::invalid_argument("The number of harts must be 1 to 64");
+            }
+        } else if (name == "--stats") {
+            if (value == "text") {
+                options.statsFormat = STATS_TEXT;
+            } else if (value == "json") {
+                options.statsFormat = STATS_JSON;
+            } else if (value == "csv") {
+                options.statsFormat = STATS_CSV;
+            } else {
+                throw std::invalid_argument("Unknown stats format: " + value);
+            }
+        } else {
+            printUsage(argv[0]);
+            throw std::invalid_argument("Unknown option: " + arg);
+        }
+    }
+    checkPredictorConfig(options.predictor);
+    if (options.harts > 1 && (options.fastForward > 0 || !options.loadCheckpoint.empty() ||
+                              !options.saveCheckpoint.empty() || !options.memTrace.empty())) {
+        throw std::invalid_argument(
+            "--harts does not combine with --fast-forward, checkpoints or --mem-trace");
+    }
+    return options;
+}
+
+inline std::tuple<std::string, CacheConfig, CacheConfig, CycleOptions> parseArgs(int argc,
+                                                                               char** argv) {
+    if (argc < 3) {
+        printUsage(argv[0]);
         exit(ERROR);
     }
 
@@ -38,31 +212,21 @@ inline std::tuple<std::string, CacheConfig, CacheConfig> parseArgs(int argc, cha
             exit(ERROR);
         }
 
-        int line = 0;
-        auto parseNextLine = [&](const char* name) -> uint32_t {
-            line++;
-            uint32_t value;
-            if (!(file >> value)) {
-                std::stringstream errorMessage;
-                errorMessage << "Failed to parse property at line " << line << " for property "
-                             << name;
-                throw std::invalid_argument(errorMessage.str());
-            }
-            std::string discard;
-            std::getline(file, discard);  // discard rest of the line
-            return value;
-        };
-
-        CacheConfig icConfig{parseNextLine("ICache cache size"), parseNextLine("ICache block size"),
-                             parseNextLine("ICache ways"), parseNextLine("ICache miss latency")};
-
-        CacheConfig dcConfig{parseNextLine("DCache cache size"), parseNextLine("DCache block size"),
-                             parseNextLine("DCache ways"), parseNextLine("DCache miss latency")};
+        CacheConfig icConfig, dcConfig;
+        HierarchyConfig hierarchy;
+        parseCacheConfig(file, icConfig, dcConfig, hierarchy);
 
         std::cout << LOG_INFO << LOG_VAR(icConfig) << std::endl;
         std::cout << LOG_INFO << LOG_VAR(dcConfig) << std::endl;
+        for (size_t i = 0; i < hierarchy.levels.size(); i++) {
+            std::cout << LOG_INFO << "l" << i + 2 << "Config: " << hierarchy.levels[i]
+                      << std::endl;
+        }
+
+        CycleOptions options = parseOptions(argc, argv);
+        options.hierarchy = hierarchy;
 
-        return std::make_tuple(inputFile, icConfig, dcConfig);
+        return std::make_tuple(inputFile, icConfig, dcConfig, options);
 
     } catch (const std::invalid_argument& e) {
         std::cerr << LOG_ERROR << e.what() << std::endl;
@@ -78,11 +242,15 @@ int main(int argc, char** argv) {
     auto inputFile = std::get<0>(simArgs);
     auto iCacheConfig = std::get<1>(simArgs);
     auto dCacheConfig = std::get<2>(simArgs);
+    auto options = std::get<3>(simArgs);
 
     cout << "[Simulator] Loading memory from " << LOG_VAR(inputFile) << endl;
     auto baseFilename = getBaseFilename(argv[1]) + "_cycle";
-    initSimulator(iCacheConfig, dCacheConfig, new MemoryStore(0, MEMORY_SIZE, argv[1]),
-                  baseFilename);
+    MemoryStore* memory = createMemoryStore(argv[1]);
+    if (!memory || initSimulator(iCacheConfig, dCacheConfig, memory, baseFilename, options) !=
+                       SUCCESS) {
+        return ERROR;
+    }
 
     cout << "[Simulator] Start simulator" << endl;
     auto status = runTillHalt();
@@ -5,6 +5,7 @@
  */
 
 #include <iostream>
+#include <string>
 
 #include "MemoryStore.h"
 #include "Utilities.h"
@@ -14,13 +15,37 @@ using namespace std;
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        cerr << LOG_ERROR << "Usage: " << argv[0] << " <input_file>" << endl;
+        cerr << LOG_ERROR << "Usage: " << argv[0] << " <input_file> [options]" << endl
+             << "Options:" << endl
+             << "  --engine=threaded|interp  translated basic blocks (default) or one "
+                "simInstruction call per instruction"
+             << endl
+             << "  --mem-trace=<file.mtr>  record every fetch, load and store address (runs "
+                "on the interpreter)"
+             << endl;
         return ERROR;
     }
 
+    FunctOptions options;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 12, "--mem-trace=") == 0) {
+            options.memTrace = arg.substr(12);
+        } else if (arg == "--engine=threaded") {
+            options.engine = ENGINE_THREADED;
+        } else if (arg == "--engine=interp") {
+            options.engine = ENGINE_INTERPRETER;
+        } else {
+            cerr << LOG_ERROR << "Unknown option: " << arg << endl;
+            return ERROR;
+        }
+    }
+
     cout << "[Simulator] Loading memory from " << LOG_VAR(argv[1]) << endl;
     auto baseFilename = getBaseFilename(argv[1]) + "_funct";
-    initSimulator(new MemoryStore(0, MEMORY_SIZE, argv[1]), baseFilename);
+    MemoryStore* memory = createMemoryStore(argv[1]);
+    if (!memory) return ERROR;
+    initSimulator(memory, baseFilename, options);
 
     cout << "[Simulator] Start simulation" << endl;
     auto status = runTillHalt();
@@ -1,17 +1,20 @@
 #include "simulator.h"
 
 #include <stdio.h>
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 using namespace std;
 
 #define EXCEPTION_HANDLER 0x8000
 
-Simulator::Simulator() {
+Simulator::Simulator() : decodeCache(DECODE_CACHE_SIZE) {
     // Initialize member variables
     memory = nullptr;
     regData.reg = {};
     din = 0;
+    decodedLow = UINT64_MAX;
+    decodedHigh = 0;
 }
 
 Simulator::~Simulator() {
@@ -26,21 +29,95 @@ void Simulator::dumpRegMem(const std::string& output_name) {
 }
 
 
-// Get raw instruction bits from memory
-Simulator::Instruction Simulator::simFetch(uint64_t PC, MemoryStore *myMem) {
+void Simulator::saveState(CheckpointWriter& out) const {
+    for (int i = 0; i < NUM_REGS; i++) out.put(regData.registers[i]);
+    out.put(din);
+}
+
+void Simulator::restoreState(CheckpointReader& in) {
+    for (int i = 0; i < NUM_REGS; i++) regData.registers[i] = in.get();
+    din = in.get();
+    for (DecodedSlot& slot : decodeCache) slot.valid = false;
+    decodedLow = UINT64_MAX;
+    decodedHigh = 0;
+}
+
+// Remember a freshly decoded instruction; only its static (fetch and decode) fields
+// are kept so a cached copy looks exactly like a new fetch + decode
+void Simulator::cacheDecoded(const Instruction& decoded) {
+    DecodedSlot& slot = decodeSlot(decoded.PC);
+    Instruction& inst = slot.inst;
+    inst = Instruction();
+    inst.PC = decoded.PC;
+    inst.instruction = decoded.instruction;
+    inst.isHalt = decoded.isHalt;
+    inst.isLegal = decoded.isLegal;
+    inst.isNop = decoded.isNop;
+    inst.readsMem = decoded.readsMem;
+    inst.writesMem = decoded.writesMem;
+    inst.doesArithLogic = decoded.doesArithLogic;
+    inst.writesRd = decoded.writesRd;
+    inst.readsRs1 = decoded.readsRs1;
+    inst.readsRs2 = decoded.readsRs2;
+    inst.opcode = decoded.opcode;
+    inst.funct3 = decoded.funct3;
+    inst.funct7 = decoded.funct7;
+    inst.rd = decoded.rd;
+    inst.rs1 = decoded.rs1;
+    inst.rs2 = decoded.rs2;
+    inst.imm = decoded.imm;
+    inst.target = decoded.target;
+    inst.isDecoded = true;
+    slot.valid = true;
+
+    decodedLow = std::min(decodedLow, decoded.PC);
+    decodedHigh = std::max(decodedHigh, decoded.PC + 4);
+}
+
+// Drop cached instructions overlapping a store to [address, address + size)
+void Simulator::invalidateDecoded(uint64_t address, uint64_t size) {
+    if (address >= decodedHigh || address + size <= decodedLow) return;
+
+    // an instruction starting up to 3 bytes below the store overlaps it as well
+    uint64_t first = address >= 3 ? address - 3 : 0;
+    for (uint64_t pc = first; pc < address + size; pc++) {
+        DecodedSlot& slot = decodeSlot(pc);
+        if (slot.valid && slot.inst.PC == pc) slot.valid = false;
+    }
+}
+
+// Get raw instruction bits from memory, already decoded when fetched from our
+// own memory (through the pre-decoded instruction cache)
+void Simulator::simFetch(uint64_t PC, MemoryStore *myMem, Instruction &inst) {
+    bool cached = (myMem == memory);
+    if (cached) {
+        DecodedSlot& slot = decodeSlot(PC);
+        if (slot.valid && slot.inst.PC == PC) {
+            inst = slot.inst;
+            return;
+        }
+    }
+
     // fetch current instruction
     uint64_t instruction;
-    myMem->getMemValue(PC, instruction, WORD_SIZE);
-    instruction = (uint32_t)instruction;
+    int ret = myMem->getMemValue<WORD_SIZE>(PC, instruction);
 
-    Instruction inst;
+    inst = Instruction();
     inst.PC = PC;
-    inst.instruction = instruction;
-    return inst;
+    inst.instruction = (uint32_t)instruction;
+
+    // a failed fetch is not cached so that it keeps reporting the violation
+    if (cached && ret == 0) {
+        simDecode(inst);
+        cacheDecoded(inst);
+    }
 }
 
 // Determine instruction opcode, funct, reg names (but not calculate all imms)
-Simulator::Instruction Simulator::simDecode(Instruction inst) {
+void Simulator::simDecode(Instruction &inst) {
+    if (inst.isDecoded) return; // came from the pre-decoded instruction cache
+    inst.isDecoded = true;
+
     inst.opcode = extractBits(inst.instruction, 6, 0);
     inst.rd     = extractBits(inst.instruction, 11, 7);
     inst.funct3 = extractBits(inst.instruction, 14, 12);
@@ -48,15 +125,52 @@ Simulator::Instruction Simulator::simDecode(Instruction inst) {
     inst.rs2    = extractBits(inst.instruction, 24, 20);
     inst.funct7 = extractBits(inst.instruction, 31, 25);
 
+    // immediates and PC-relative targets, computed once per decoded instruction
+    uint64_t imm5   = inst.rd;
+    uint64_t imm7   = inst.funct7;
+    uint64_t imm12  = extractBits(inst.instruction, 31, 20);
+    uint64_t imm20  = extractBits(inst.instruction, 31, 12);
+    switch (inst.opcode) {
+        case OP_INTIMM:
+        case OP_INTIMMW:
+        case OP_LOAD:
+        case OP_JALR:
+            inst.imm = sext64(imm12, 11); // I-type immediate
+            break;
+        case OP_STORE:
+            inst.imm = sext64((imm7 << 5) | imm5, 11); // S-type immediate
+            break;
+        case OP_AUIPC:
+        case OP_LUI:
+            inst.imm = sext64(imm20 << 12, 31); // U-type immediate
+            break;
+        case OP_BRANCH:
+            inst.target = inst.PC + sext64(
+                extractBits(imm7, 6, 6) << 12 |
+                extractBits(imm7, 5, 0) << 5 |
+                extractBits(imm5, 4, 1) << 1 |
+                extractBits(imm5, 0, 0) << 11,
+                12); // B-type immediate
+            break;
+        case OP_JAL:
+            inst.target = inst.PC + sext64(
+                extractBits(imm20, 19, 19) << 20 |
+                extractBits(imm20, 18, 9) << 1 |
+                extractBits(imm20, 8, 8) << 11 |
+                extractBits(imm20, 7, 0) << 12,
+                20); // J-type immediate
+            break;
+    }
+
     inst.isLegal = true; // assume legal unless proven otherwise
 
     if (inst.instruction == 0xfeedfeed) {
         inst.isHalt = true;
-        return inst; // halt instruction
+        return; // halt instruction
     }
     if (inst.instruction == 0x00000013) {
         inst.isNop = true;
-        return inst; // NOP instruction
+        return; // NOP instruction
     }
 
     switch (inst.opcode) {
@@ -156,95 +270,72 @@ Simulator::Instruction Simulator::simDecode(Instruction inst) {
         default:
             inst.isLegal = false;
     }
-    return inst;
 }
 
 // Collect operands whether reg or imm for arith or addr gen
-Simulator::Instruction Simulator::simOperandCollection(Instruction inst, REGS regData) {
-    regData.registers[0] = 0;
+// (x0 reads as 0: simCommit never writes it)
+void Simulator::simOperandCollection(Instruction &inst, const REGS &regData) {
     if (inst.readsRs1) {
         inst.op1Val = regData.registers[inst.rs1];
     }
     if (inst.readsRs2) {
         inst.op2Val = regData.registers[inst.rs2];
     }
-    return inst;
 }
 
 // Resolve next PC whether +4 or branch/jump target taken/not taken
-Simulator::Instruction Simulator::simNextPCResolution(Instruction inst) {
-
-    uint64_t imm5   = inst.rd;
-    uint64_t imm7   = inst.funct7;
-    uint64_t imm12  = extractBits(inst.instruction, 31, 20);
-    uint64_t imm20  = extractBits(inst.instruction, 31, 12);
-    uint64_t branchTarget = inst.PC + sext64(
-        extractBits(imm7, 6, 6) << 12 |
-        extractBits(imm7, 5, 0) << 5 |
-        extractBits(imm5, 4, 1) << 1 |
-        extractBits(imm5, 0, 0) << 11,
-        12); // B-type immediate 
-    uint64_t jalTarget = inst.PC + sext64(
-        extractBits(imm20, 19, 19) << 20 |
-        extractBits(imm20, 18, 9) << 1 |
-        extractBits(imm20, 8, 8) << 11 |
-        extractBits(imm20, 7, 0) << 12,
-        20); // J-type immediate
-
+void Simulator::simNextPCResolution(Instruction &inst) {
     switch (inst.opcode) {
         case OP_JALR:
-            inst.nextPC = (inst.op1Val + sext64(imm12, 11)) & ~1ULL;
+            inst.nextPC = (inst.op1Val + inst.imm) & ~1ULL;
             break;
         case OP_BRANCH:
             inst.nextPC = inst.PC + 4;
             switch (inst.funct3) {
                 case FUNCT3_BEQ:
                     if (inst.op1Val == inst.op2Val) {
-                        inst.nextPC = branchTarget;
+                        inst.nextPC = inst.target;
                     }
                     break;
                 case FUNCT3_BNE:
                     if (inst.op1Val != inst.op2Val) {
-                        inst.nextPC = branchTarget;
+                        inst.nextPC = inst.target;
                     }
                     break;
                 case FUNCT3_BLT:
                     if ((int64_t)inst.op1Val < (int64_t)inst.op2Val) {
-                        inst.nextPC = branchTarget;
+                        inst.nextPC = inst.target;
                     }
                     break;
                 case FUNCT3_BGE:
                     if ((int64_t)inst.op1Val >= (int64_t)inst.op2Val) {
-                        inst.nextPC = branchTarget;
+                        inst.nextPC = inst.target;
                     }
                     break;
                 case FUNCT3_BLTU:
                     if (inst.op1Val < inst.op2Val) {
-                        inst.nextPC = branchTarget;
+                        inst.nextPC = inst.target;
                     }
                     break;
                 case FUNCT3_BGEU:
                     if (inst.op1Val >= inst.op2Val) {
-                        inst.nextPC = branchTarget;
+                        inst.nextPC = inst.target;
                     }
                     break;
             }
             break;
         case OP_JAL:
-            inst.nextPC = jalTarget;
+            inst.nextPC = inst.target;
             break;
         default:
             inst.nextPC = inst.PC + 4;
     }
-
-    return inst;
 }
 
 // Perform arithmetic operations
-Simulator::Instruction Simulator::simArithLogic(Instruction inst) {
-    uint64_t imm12  = extractBits(inst.instruction, 31, 20);
-    uint64_t upperImm12 = extractBits(inst.instruction, 31, 26);
-    uint64_t imm20  = extractBits(inst.instruction, 31, 12);
+void Simulator::simArithLogic(Instruction &inst) {
+    uint64_t imm12  = inst.imm;          // sign-extended, only ever used as such or masked
+    uint64_t upperImm12 = inst.funct7 >> 1;
     
     if (inst.opcode == OP_INT && (
         inst.funct3 == FUNCT3_SLL || inst.funct3 == FUNCT3_SR)) {
@@ -321,19 +412,19 @@ Simulator::Instruction Simulator::simArithLogic(Instruction inst) {
         case OP_INTIMM:
             switch (inst.funct3) {
                 case FUNCT3_ADD:
-                    inst.arithResult = inst.op1Val + sext64(imm12, 11);
+                    inst.arithResult = inst.op1Val + imm12;
                     break;
                 case FUNCT3_SLL:
                     inst.arithResult = inst.op1Val << (imm12 & 0x3F);
                     break;
                 case FUNCT3_SLT:
-                    inst.arithResult = (int64_t)inst.op1Val < (int64_t)sext64(imm12, 11);
+                    inst.arithResult = (int64_t)inst.op1Val < (int64_t)imm12;
                     break;
                 case FUNCT3_SLTU:
-                    inst.arithResult = inst.op1Val < sext64(imm12, 11);
+                    inst.arithResult = inst.op1Val < imm12;
                     break;
                 case FUNCT3_XOR:
-                    inst.arithResult = inst.op1Val ^ sext64(imm12, 11);
+                    inst.arithResult = inst.op1Val ^ imm12;
                     break;
                 case FUNCT3_SR:
                     if (upperImm12 == UPPERIMM_LOGICAL) {
@@ -343,17 +434,17 @@ Simulator::Instruction Simulator::simArithLogic(Instruction inst) {
                     }
                     break;
                 case FUNCT3_OR:
-                    inst.arithResult = inst.op1Val | sext64(imm12, 11);
+                    inst.arithResult = inst.op1Val | imm12;
                     break;
                 case FUNCT3_AND:
-                    inst.arithResult = inst.op1Val & sext64(imm12, 11);
+                    inst.arithResult = inst.op1Val & imm12;
                     break;
             }
             break;
         case OP_INTIMMW:
             switch (inst.funct3) {
                 case FUNCT3_ADD:
-                    inst.arithResult = sext64((uint32_t)inst.op1Val + (uint32_t)sext32(imm12, 11), 31);
+                    inst.arithResult = sext64((uint32_t)inst.op1Val + (uint32_t)imm12, 31);
                     break;
                 case FUNCT3_SLL:
                     inst.arithResult = sext64((uint32_t)inst.op1Val << (uint32_t)(imm12 & 0x1F), 31);
@@ -371,37 +462,26 @@ Simulator::Instruction Simulator::simArithLogic(Instruction inst) {
             inst.arithResult = inst.PC + 4;
             break;
         case OP_AUIPC:
-            inst.arithResult = inst.PC + sext64(imm20 << 12, 31);
+            inst.arithResult = inst.PC + inst.imm;
             break;
         case OP_LUI:
-            inst.arithResult = sext64(imm20 << 12, 31);
+            inst.arithResult = inst.imm;
             break;
         case OP_JAL:
             inst.arithResult = inst.PC + 4;
             break;
     }
-
-    return inst;
 }
 
 // Generate memory address for load/store instructions
-Simulator::Instruction Simulator::simAddrGen(Instruction inst) {
-    uint64_t imm5   = inst.rd;
-    uint64_t imm7   = inst.funct7;
-    uint64_t imm12  = extractBits(inst.instruction, 31, 20);
-    int64_t storeImm = sext64((imm7 << 5) | imm5, 11); // S-type immediate
-    
-    if (inst.readsMem) {
-        inst.memAddress = inst.op1Val + sext64(imm12, 11);
-    } else if (inst.writesMem) {
-        inst.memAddress = inst.op1Val + storeImm;
+void Simulator::simAddrGen(Instruction &inst) {
+    if (inst.readsMem || inst.writesMem) {
+        inst.memAddress = inst.op1Val + inst.imm;
     }
-
-    return inst;
 }
 
 // Perform memory access for load/store instructions
-Simulator::Instruction Simulator::simMemAccess(Instruction inst, MemoryStore *myMem) {
+void Simulator::simMemAccess(Instruction &inst, MemoryStore *myMem) {
     MemEntrySize size = (inst.funct3 == FUNCT3_B || inst.funct3 == FUNCT3_BU) ? BYTE_SIZE :
                     (inst.funct3 == FUNCT3_H || inst.funct3 == FUNCT3_HU) ? HALF_SIZE :
                     (inst.funct3 == FUNCT3_W || inst.funct3 == FUNCT3_WU) ? WORD_SIZE : DOUBLE_SIZE;
@@ -417,20 +497,19 @@ Simulator::Instruction Simulator::simMemAccess(Instruction inst, MemoryStore *my
         }
     } else if (inst.writesMem) {
         myMem->setMemValue(inst.memAddress, inst.op2Val, size);
+        if (myMem == memory) invalidateDecoded(inst.memAddress, size);
     }
-
-    return inst;
 }
 
 // Write back results to registers
-Simulator::Instruction Simulator::simCommit(Instruction inst, REGS &regData) {
+void Simulator::simCommit(Instruction &inst, REGS &regData) {
     // x0 must always be 0
     regData.registers[0] = 0;
 
     // only instructions that actually write a register should update the regfile
     // and never write to x0
     if (!inst.writesRd || inst.rd == 0) {
-        return inst;
+        return;
     }
 
     if (inst.readsMem) {
@@ -438,61 +517,53 @@ Simulator::Instruction Simulator::simCommit(Instruction inst, REGS &regData) {
     } else {
         regData.registers[inst.rd] = inst.arithResult;
     }
-    return inst;
 }
 
 // TODO complete the following pipeline stage simulation functions
 // You may find it useful to call functional simulation functions above
 
-Simulator::Instruction Simulator::simIF(uint64_t PC) {
-    Instruction inst = simFetch(PC, memory);
-    return inst;
+void Simulator::simIF(uint64_t PC, Instruction &inst) {
+    simFetch(PC, memory, inst);
     // throw std::runtime_error("simIF not implemented yet"); // TODO implement IF 
 }
 
-Simulator::Instruction Simulator::simID(Simulator::Instruction inst) {
-    inst = simDecode(inst);
-    inst = simOperandCollection(inst, regData);
-    inst = simNextPCResolution(inst);
-    return inst;
+void Simulator::simID(Instruction &inst) {
+    simDecode(inst);
+    simOperandCollection(inst, regData);
+    simNextPCResolution(inst);
     // throw std::runtime_error("simID not implemented yet"); // TODO implement ID
 }
 
-Simulator::Instruction Simulator::simEX(Simulator::Instruction inst) {
-    inst = simArithLogic(inst);
-    inst = simAddrGen(inst);
-    return inst;
+void Simulator::simEX(Instruction &inst) {
+    simArithLogic(inst);
+    simAddrGen(inst);
     // throw std::runtime_error("simEX not implemented yet"); // TODO implement EX
 }
 
-Simulator::Instruction Simulator::simMEM(Simulator::Instruction inst) {
-    inst = simMemAccess(inst, memory);
-    return inst;
+void Simulator::simMEM(Instruction &inst) {
+    simMemAccess(inst, memory);
     // throw std::runtime_error("simMEM not implemented yet"); // TODO implement MEM
 }
 
-Simulator::Instruction Simulator::simWB(Simulator::Instruction inst) {
-    inst = simCommit(inst, regData);
-    return inst;
+void Simulator::simWB(Instruction &inst) {
+    simCommit(inst, regData);
     // throw std::runtime_error("simWB not implemented yet"); // TODO implement WB
 }
 
 
 // Simulate the whole instruction using functions above
-Simulator::Instruction Simulator::simInstruction(uint64_t PC) {
+void Simulator::simInstruction(uint64_t PC, Instruction &inst) {
     // Implementation moved from .cpp to .h for illustration
-    Instruction inst = simFetch(PC, memory);
-    inst = simDecode(inst);
+    simFetch(PC, memory, inst);
+    simDecode(inst);
     inst.instructionID = din++;
-    if (!inst.isLegal || inst.isHalt) return inst;
-    inst = simOperandCollection(inst, regData);
-    inst = simNextPCResolution(inst);
-    if (inst.doesArithLogic) inst = simArithLogic(inst);
+    if (!inst.isLegal || inst.isHalt) return;
+    simOperandCollection(inst, regData);
+    simNextPCResolution(inst);
+    if (inst.doesArithLogic) simArithLogic(inst);
     if (inst.readsMem || inst.writesMem) {
-        inst = simAddrGen(inst);
-        inst = simMemAccess(inst, memory);
+        simAddrGen(inst);
+        simMemAccess(inst, memory);
     }
-    if (inst.writesRd) inst = simCommit(inst, regData);
-    PC = inst.nextPC;
-    return inst;
+    if (inst.writesRd) simCommit(inst, regData);
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
+#include "Checkpoint.h"
 #include "Utilities.h"
 #include "MemoryStore.h"
 #include "RegisterInfo.h"
 
+// Number of entries of the pre-decoded instruction cache (a power of 2)
+#define DECODE_CACHE_SIZE 4096
+
 class Simulator {
    private:
     union REGS {
@@ -25,78 +30,122 @@ class Simulator {
     Simulator();
     ~Simulator();
 
+    // runs on the registers and memory of a Simulator
+    friend class ThreadedEngine;
+
+    // One pipeline latch. Register numbers and opcode fields are kept in their
+    // encoded widths and the decode flags are packed, so that moving an
+    // instruction from one stage to the next copies as few bytes as possible.
     struct Instruction {
         // known by IF
         uint64_t PC = 0;
-        uint64_t instruction = 0;    // raw instruction encoding
+        uint32_t instruction = 0;    // raw instruction encoding
+        uint64_t predictedPC = 0;    // next fetch PC, set if a BranchPredictor is used
+                                     // (always by the dual-issue pipeline)
 
         // known by ID
-        bool     isHalt = false;
-        bool     isLegal = false;
-        bool     isNop = false;
-
-        bool     readsMem = false;
-        bool     writesMem = false;
-        bool     doesArithLogic = false;
-        bool     writesRd = false;
-        bool     readsRs1 = false;
-        bool     readsRs2 = false;
-
-        uint64_t opcode = 0;
-        uint64_t funct3 = 0;
-        uint64_t funct7 = 0;
-        uint64_t rd = 0;
-        uint64_t rs1 = 0;
-        uint64_t rs2 = 0;
+        uint8_t  opcode = 0;
+        uint8_t  funct3 = 0;
+        uint8_t  funct7 = 0;
+        uint8_t  rd = 0;
+        uint8_t  rs1 = 0;
+        uint8_t  rs2 = 0;
+
+        bool     isHalt : 1;
+        bool     isLegal : 1;
+        bool     isNop : 1;
+
+        bool     readsMem : 1;
+        bool     writesMem : 1;
+        bool     doesArithLogic : 1;
+        bool     writesRd : 1;
+        bool     readsRs1 : 1;
+        bool     readsRs2 : 1;
+        bool     isDecoded : 1;     // fields above are valid (from simDecode)
+
+        // Used for stage status tracking in cycle
+        StageStatus status : 4;
+
+        uint64_t imm = 0;           // sign-extended I/S/U-type immediate
+        uint64_t target = 0;        // PC-relative branch/JAL target
 
         uint64_t nextPC = 0;
 
         uint64_t op1Val = 0;
         uint64_t op2Val = 0;
 
-
         // known by EX
         uint64_t arithResult = 0;
         uint64_t memAddress = 0;
 
         // known by MEM
-        bool     memException = false;
         uint64_t memResult = 0;
-        uint64_t valToWrite = 0;
 
         // known by WB
         uint64_t instructionID = 0;  // din of the instruction
 
-        // Used for stage status tracking in cycle
-        StageStatus status = NORMAL;
+        // bit-fields have no default member initializers before C++20
+        Instruction()
+            : isHalt(false), isLegal(false), isNop(false), readsMem(false), writesMem(false),
+              doesArithLogic(false), writesRd(false), readsRs1(false), readsRs2(false),
+              isDecoded(false), status(NORMAL) {}
     };
 
+   private:
+    // Pre-decoded instruction cache: simFetch returns the decoded instruction of a
+    // PC it has seen before without touching memory. Stores to a cached address
+    // invalidate the entry (self-modifying code).
+    struct DecodedSlot {
+        bool valid = false;
+        Instruction inst;
+    };
+    std::vector<DecodedSlot> decodeCache;
+    uint64_t decodedLow;   // [decodedLow, decodedHigh) covers all cached instructions
+    uint64_t decodedHigh;
+
+    DecodedSlot& decodeSlot(uint64_t PC) { return decodeCache[(PC >> 2) & (DECODE_CACHE_SIZE - 1)]; }
+    void cacheDecoded(const Instruction& inst);
+    void invalidateDecoded(uint64_t address, uint64_t size);
+
+   public:
     // getters and setters
     auto getDin() { return din; }
     auto getMemory() { return memory; }
 
     void setMemory(MemoryStore* mem) { memory = mem; }
-
-    // Simulate by functionality (project 1)
-    Instruction simFetch(uint64_t PC, MemoryStore *myMem);
-    Instruction simDecode(Instruction inst);
-    Instruction simOperandCollection(Instruction inst, REGS regData);
-    Instruction simNextPCResolution(Instruction inst);
-    Instruction simArithLogic(Instruction inst);
-    Instruction simAddrGen(Instruction inst);
-    Instruction simMemAccess(Instruction inst, MemoryStore *myMem);
-    Instruction simCommit(Instruction inst, REGS &regData);
+    void setRegister(uint64_t reg, uint64_t value) {
+        if (reg != 0) regData.registers[reg] = value;
+    }
+
+    // another hart stored bytes at address of the memory this one shares: forget the
+    // pre-decoded instructions it overwrote
+    void forgetStore(uint64_t address, uint64_t bytes) { invalidateDecoded(address, bytes); }
+
+    // Simulate by functionality (project 1). Every stage updates inst in place.
+    void simFetch(uint64_t PC, MemoryStore *myMem, Instruction &inst);
+    void simDecode(Instruction &inst);
+    void simOperandCollection(Instruction &inst, const REGS &regData);
+    void simNextPCResolution(Instruction &inst);
+    void simArithLogic(Instruction &inst);
+    void simAddrGen(Instruction &inst);
+    void simMemAccess(Instruction &inst, MemoryStore *myMem);
+    void simCommit(Instruction &inst, REGS &regData);
 
     // Simulate an instruction functionally in a single step
-    Instruction simInstruction(uint64_t PC);
+    void simInstruction(uint64_t PC, Instruction &inst);
 
     // Simulate pipeline stages (project 2 TODO)
-    Instruction simIF(uint64_t PC);
-    Instruction simID(Instruction inst);
-    Instruction simEX(Instruction inst);
-    Instruction simMEM(Instruction inst);
-    Instruction simWB(Instruction inst);
+    void simIF(uint64_t PC, Instruction &inst);
+    void simID(Instruction &inst);
+    void simEX(Instruction &inst);
+    void simMEM(Instruction &inst);
+    void simWB(Instruction &inst);
 
     // Helper function to dump registers and memory
     void dumpRegMem(const std::string& output_name);
+
+    // Checkpoint section: the registers and din. The memory is saved on its own;
+    // restoring forgets the pre-decoded instructions, as the memory is replaced too.
+    void saveState(CheckpointWriter& out) const;
+    void restoreState(CheckpointReader& in);
 };
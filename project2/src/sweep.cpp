@@ -0,0 +1,144 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+CacheSweep::CacheSweep(const std::vector<CacheConfig>& sweepConfigs)
+    : configs(sweepConfigs), accesses(0) {
+    for (const CacheConfig& config : configs) {
+        uint64_t numSets = config.cacheSize / config.blockSize / config.ways;
+        uint64_t blockOffsetBits = log2Int(config.blockSize);
+        uint64_t indexMask = (1ULL << log2Int(numSets)) - 1;
+
+        size_t g = 0;
+        while (g < groups.size() && (groups[g].blockOffsetBits != blockOffsetBits ||
+                                     groups[g].indexMask != indexMask)) {
+            g++;
+        }
+        if (g == groups.size()) {
+            groups.push_back(Group{blockOffsetBits, indexMask, 0, {}, {}, {}});
+        }
+        groups[g].maxWays = std::max(groups[g].maxWays, config.ways);
+        configGroup.push_back(g);
+    }
+
+    for (Group& group : groups) {
+        uint64_t numSets = group.indexMask + 1;
+        group.stacks.assign(numSets * group.maxWays, 0);
+        group.depth.assign(numSets, 0);
+        group.distances.assign(group.maxWays + 1, 0);
+    }
+}
+
+void CacheSweep::access(Group& group, uint64_t address) {
+    uint64_t block = address >> group.blockOffsetBits;
+    uint64_t set = block & group.indexMask;
+    uint64_t* stack = &group.stacks[set * group.maxWays];
+    uint64_t& depth = group.depth[set];
+
+    uint64_t distance = 0;
+    while (distance < depth && stack[distance] != block) distance++;
+
+    if (distance < depth) {
+        group.distances[distance]++;
+    } else {
+        // a miss for every config of the group; the LRU block falls off a full stack
+        group.distances[group.maxWays]++;
+        if (depth < group.maxWays) depth++;
+        distance = depth - 1;
+    }
+    // move to the MRU position
+    for (uint64_t i = distance; i > 0; i--) stack[i] = stack[i - 1];
+    stack[0] = block;
+}
+
+void CacheSweep::resetStats() {
+    accesses = 0;
+    for (Group& group : groups) std::fill(group.distances.begin(), group.distances.end(), 0);
+}
+
+uint64_t CacheSweep::getHits(size_t i) const {
+    const Group& group = groups[configGroup[i]];
+    uint64_t hits = 0;
+    for (uint64_t d = 0; d < configs[i].ways; d++) hits += group.distances[d];
+    return hits;
+}
+
+void CacheSweep::print(const std::string& name, std::ostream& out) const {
+    for (size_t i = 0; i < configs.size(); i++) {
+        uint64_t misses = getMisses(i);
+        double missRate = accesses ? static_cast<double>(misses) / accesses : 0.0;
+        out << std::left << std::setw(8) << name << std::right << std::setw(10)
+            << configs[i].cacheSize << std::setw(8) << configs[i].blockSize << std::setw(8)
+            << configs[i].ways << std::setw(12) << accesses << std::setw(12) << getHits(i)
+            << std::setw(12) << misses << std::setw(10) << std::fixed << std::setprecision(4)
+            << missRate << std::endl;
+    }
+}
+
+// a number or a power-of-2 range lo:hi
+static std::vector<uint64_t> parseSweepRange(const std::string& field) {
+    size_t colon = field.find(':');
+    uint64_t lo = std::stoull(field.substr(0, colon), nullptr, 0);
+    uint64_t hi = lo;
+    if (colon != std::string::npos) hi = std::stoull(field.substr(colon + 1), nullptr, 0);
+    if (lo == 0 || (lo & (lo - 1)) != 0 || hi < lo) {
+        throw std::invalid_argument("Sweep values must be powers of 2 with lo <= hi: " + field);
+    }
+    std::vector<uint64_t> values;
+    for (uint64_t value = lo; value <= hi && value != 0; value <<= 1) values.push_back(value);
+    return values;
+}
+
+void parseSweepSpec(std::istream& in, std::vector<CacheConfig>& icConfigs,
+                    std::vector<CacheConfig>& dcConfigs) {
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::stringstream ss(line);
+        std::string cache, size, block, ways, extra;
+        if (!(ss >> cache)) continue;  // empty or comment line
+        if (!(ss >> size >> block >> ways) || (ss >> extra) ||
+            (cache != "icache" && cache != "dcache")) {
+            std::stringstream errorMessage;
+            errorMessage << "Sweep line " << lineNumber
+                         << " is not \"icache|dcache <size> <block size> <ways>\"";
+            throw std::invalid_argument(errorMessage.str());
+        }
+
+        std::vector<CacheConfig>& list = cache == "icache" ? icConfigs : dcConfigs;
+        for (uint64_t s : parseSweepRange(size)) {
+            for (uint64_t b : parseSweepRange(block)) {
+                for (uint64_t w : parseSweepRange(ways)) {
+                    if (b * w > s) continue;  // not even one set
+                    CacheConfig config;
+                    config.cacheSize = s;
+                    config.blockSize = b;
+                    config.ways = w;
+                    config.missLatency = 0;
+                    list.push_back(config);
+                }
+            }
+        }
+    }
+}
+
+Status dumpCacheSweep(const CacheSweep& iSweep, const CacheSweep& dSweep,
+                      const std::string& base_output_name) {
+    std::ofstream sweep_out(base_output_name + "_cache_sweep.out");
+    if (!sweep_out) {
+        std::cerr << LOG_ERROR << "Could not create cache sweep file" << std::endl;
+        return ERROR;
+    }
+    sweep_out << std::left << std::setw(8) << "cache" << std::right << std::setw(10) << "size"
+              << std::setw(8) << "block" << std::setw(8) << "ways" << std::setw(12) << "accesses"
+              << std::setw(12) << "hits" << std::setw(12) << "misses" << std::setw(10)
+              << "missRate" << std::endl;
+    iSweep.print("icache", sweep_out);
+    dSweep.print("dcache", sweep_out);
+    return SUCCESS;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <inttypes.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "cache.h"
+
+// Hit/miss counts of many LRU cache geometries from a single pass over an access
+// stream (Mattson stack distances). Configurations with the same block size and
+// number of sets share one LRU stack per set: an access at stack depth d hits in
+// every such cache with more than d ways. Only the geometry of the configs is
+// used; the counts are those of a Cache with REPL_LRU seeing the same accesses.
+class CacheSweep {
+   private:
+    // configurations with the same block size and number of sets
+    struct Group {
+        uint64_t blockOffsetBits;
+        uint64_t indexMask;
+        uint64_t maxWays;               // deepest stack any config of the group needs
+        std::vector<uint64_t> stacks;   // numSets * maxWays block addresses, MRU first
+        std::vector<uint64_t> depth;    // valid entries of each set stack
+        std::vector<uint64_t> distances;  // accesses per stack depth, [maxWays] = miss
+    };
+
+    std::vector<CacheConfig> configs;
+    std::vector<size_t> configGroup;  // group of each config
+    std::vector<Group> groups;
+    uint64_t accesses;
+
+    static void access(Group& group, uint64_t address);
+
+   public:
+    explicit CacheSweep(const std::vector<CacheConfig>& sweepConfigs);
+
+    void access(uint64_t address) {
+        accesses++;
+        for (Group& group : groups) access(group, address);
+    }
+
+    size_t size() const { return configs.size(); }
+    const CacheConfig& getConfig(size_t i) const { return configs[i]; }
+    uint64_t getAccesses() const { return accesses; }
+    uint64_t getHits(size_t i) const;
+    uint64_t getMisses(size_t i) const { return accesses - getHits(i); }
+    // restart the counts, the LRU stacks stay (after a warmup)
+    void resetStats();
+
+    // one table row per configuration, each prefixed with name
+    void print(const std::string& name, std::ostream& out) const;
+};
+
+// Parse a sweep specification. Every non-comment line is
+//     icache|dcache <size> <block size> <ways>
+// and each number may be a power-of-2 range "lo:hi" (lo, 2*lo, ... hi); all
+// combinations that form a valid geometry are added to the list of that cache.
+// '#' starts a comment. Throws std::invalid_argument on malformed input.
+void parseSweepSpec(std::istream& in, std::vector<CacheConfig>& icConfigs,
+                    std::vector<CacheConfig>& dcConfigs);
+
+// Write the tables of the I- and D-cache sweeps to <base_output_name>_cache_sweep.out
+Status dumpCacheSweep(const CacheSweep& iSweep, const CacheSweep& dSweep,
+                      const std::string& base_output_name);
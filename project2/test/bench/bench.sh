@@ -0,0 +1,85 @@
+#!/bin/bash
+# Host-throughput benchmark of the simulators: make bench, or from the project root
+#     test/bench/bench.sh [repeats]
+# Every test/bench/*.bin runs on sim_funct and, with each test/bench/cache_*.txt and
+# test/cache_config.txt, on sim_cycle (pipe trace off), repeats times (3) each. For
+# every run it reports the median host time, simulated MIPS (instructions per host
+# microsecond), simulated Mcycles per host second and the spread of the repeats,
+# (max - min) / median. BENCH_FLAGS adds options to every sim_cycle run.
+#
+# Every sim_cycle run has to end with the registers and memory of sim_funct, or the
+# bench fails. The reference pipeline loses the instruction in ID (a taken branch or
+# one waiting for a hazard) while fetch stalls for an I-cache miss behind it, so the
+# workloads keep branches and hazards off the last word of every 16-byte block, where
+# their first pass would hit such a stall.
+set -u
+
+REPEATS=${1:-3}
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CONFIGS="$ROOT/test/cache_config.txt $(ls "$ROOT"/test/bench/cache_*.txt)"
+
+# median and spread (in percent) of the host times on stdin, one per line
+summarize() {
+    sort -n | awk '{ t[NR] = $1 } END {
+        median = (NR % 2) ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+        printf "%.6f %.1f\n", median, (median > 0 ? 100 * (t[NR] - t[1]) / median : 0) }'
+}
+
+# the value of a line of a _sim_stats.out file
+stat() {
+    grep "^$2:" "$1" | awk '{ print $NF }'
+}
+
+# check <name> <config label>: the state sim_cycle ended with is the one of sim_funct
+failures=0
+check() {
+    local state
+    for state in reg_state mem_state; do
+        if ! cmp -s "${1}_funct_$state.out" "${1}_cycle_$state.out"; then
+            echo "MISMATCH: sim_cycle/$1 with $2 ends with another ${state/_/ } than sim_funct" >&2
+            failures=$((failures + 1))
+        fi
+    done
+}
+
+# run <label> <config label> <stats file> <command...>
+run() {
+    local label=$1 config=$2 stats=$3
+    shift 3
+    local times=""
+    for ((i = 0; i < REPEATS; i++)); do
+        local start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        local end=$(date +%s%N)
+        times="$times $(((end - start) / 1000))"
+    done
+    local instructions=$(stat "$stats" "Dynamic instructions")
+    local cycles=$(stat "$stats" "Total cycles")
+    read median spread <<< "$(echo $times | tr ' ' '\n' | summarize)"
+    awk -v l="$label" -v c="$config" -v n="$instructions" -v k="$cycles" -v t="$median" \
+        -v s="$spread" 'BEGIN {
+        printf "%-22s %-18s %12d %12d %10.3f %9.2f %10.2f %7.1f%%\n", l, c, n, k,
+            t / 1e6, (t > 0 ? n / t : 0), (t > 0 ? k / t : 0), s }'
+}
+
+printf "%-22s %-18s %12s %12s %10s %9s %10s %8s\n" binary/program config instructions \
+    cycles "median s" MIPS Mcycles/s spread
+for bin in "$ROOT"/test/bench/*.bin; do
+    name=$(basename "$bin" .bin)
+    cp "$bin" "$WORK/"
+    cd "$WORK"
+    run "sim_funct/$name" - "${name}_funct_sim_stats.out" "$ROOT/sim_funct" "$name.bin"
+    for config in $CONFIGS; do
+        run "sim_cycle/$name" "$(basename "$config" .txt)" "${name}_cycle_sim_stats.out" \
+            "$ROOT/sim_cycle" "$name.bin" "$config" --trace=off ${BENCH_FLAGS:-}
+        check "$name" "$(basename "$config" .txt)"
+    done
+    cd "$ROOT"
+done
+if ((failures > 0)); then
+    echo "$failures mismatched final states, the numbers above are of wrong executions" >&2
+    exit 1
+fi
@@ -0,0 +1,38 @@
+# Branch-heavy loop: a xorshift generator drives data-dependent branches, so about
+# half of them are taken in no predictable pattern. Exercises branch squashes and
+# the arithmetic-branch hazard.
+_start:
+	li   s0, 0x2545F491 # s0 = generator state
+	li   s1, 1000000    # s1 = iterations left
+	li   a0, 0          # a0..a3: how often each path ran
+	li   a1, 0
+	li   a2, 0
+	li   a3, 0
+
+loop:
+	addi s1, s1, -1     # counted first, the branch back reads it long after
+	slli t0, s0, 13     # xorshift64: x ^= x << 13; x ^= x >> 7; x ^= x << 17
+	xor  s0, s0, t0
+	srli t0, s0, 7
+	xor  s0, s0, t0
+	slli t0, s0, 17
+	xor  s0, s0, t0
+
+	# the bits are tested up front, which keeps the branches off the last word of
+	# the 16-byte blocks (see bench.sh)
+	andi t1, s0, 1
+	andi t2, s0, 2
+	andi t3, s0, 4
+	beqz t1, even
+	addi a0, a0, 1
+	bnez t2, next
+	addi a1, a1, 1
+	j    next
+even:
+	addi a2, a2, 1
+	beqz t3, next
+	addi a3, a3, 1
+next:
+	bnez s1, loop
+
+.word 0xfeedfeed
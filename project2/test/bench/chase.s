@@ -0,0 +1,30 @@
+# Pointer chasing: a ring of 256 nodes, 64 bytes apart, linked in a scrambled order
+# (node i points to node (i + 167) mod 256), followed 4M times. Every load depends
+# on the one before, so this is load-use and D-cache miss latency bound.
+_start:
+	li   s0, 0x2000     # s0 = &node[0]
+	li   s1, 255        # s1 = index mask
+	li   t0, 0          # t0 = i
+
+link:
+	addi t1, t0, 167
+	and  t1, t1, s1     # t1 = (i + 167) mod 256
+	slli t2, t0, 6
+	add  t2, t2, s0     # t2 = &node[i]
+	slli t3, t1, 6
+	add  t3, t3, s0     # t3 = &node[next]
+	sd   t3, 0(t2)      # node[i].next = &node[next]
+	addi t0, t0, 1
+	ble  t0, s1, link
+
+	mv   t0, s0         # t0 = current node
+	li   s2, 4000000    # s2 = steps left
+chase:
+	ld   t0, 0(t0)      # t0 = t0->next
+	ld   t0, 0(t0)
+	ld   t0, 0(t0)
+	ld   t0, 0(t0)
+	addi s2, s2, -4
+	bgtz s2, chase
+
+.word 0xfeedfeed
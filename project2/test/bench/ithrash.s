@@ -0,0 +1,17 @@
+# I-cache thrashing: a 16KB straight-line loop body, far larger than the I-caches
+# benchmarked, so every pass misses on each of its blocks.
+_start:
+	li   s1, 2000       # s1 = passes left (fits one addi, see below)
+	li   a0, 0
+
+loop:
+	addi s1, s1, -1     # counted first, the branch reads it long after
+	.rept 4093
+	addi a0, a0, 1
+	.endr
+	# The far branch assembles to blez + j, at 0x4000 with the halt behind them in
+	# the same 16-byte block: sim_cycle only resolves a branch in ID if the fetch
+	# behind it hits.
+	bgtz s1, loop
+
+.word 0xfeedfeed
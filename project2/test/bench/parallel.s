@@ -0,0 +1,58 @@
+# Shared memory: with sim_cycle --harts=N, hart a0 of a1 writes, then reads back and
+# sums, every N-th doubleword of a 16KB array, 200 times, storing its running sum to
+# partial[hart] after every element; the partials share a D-cache block. Hart 0 waits
+# for the done flags of the others and leaves the sum of all partials in a0, the same
+# for any N. Run on one hart (a1 = 0) otherwise.
+_start:
+	mv   s0, a0         # s0 = hart
+	mv   s1, a1         # s1 = harts
+	bnez s1, harts
+	li   s1, 1
+harts:
+	li   s2, 0x2000
+	slli t0, s0, 3
+	add  s2, s2, t0     # s2 = &array[hart]
+	li   s3, 0x6000     # s3 = &array[2048], one past the end
+	slli s4, s1, 3      # s4 = stride
+	li   s5, 0x7000
+	add  s5, s5, t0     # s5 = &partial[hart]
+	li   s6, 200        # s6 = passes left
+	li   a0, 0          # a0 = running sum
+
+pass:
+	mv   t1, s2         # t1 = element pointer
+element:
+	sd   s6, 0(t1)      # array[i] = pass
+	ld   t2, 0(t1)
+	add  a0, a0, t2     # sum += array[i]
+	sd   a0, 0(s5)      # partial[hart] = sum
+	add  t1, t1, s4
+	bltu t1, s3, element
+
+	addi s6, s6, -1
+	bnez s6, pass
+
+	li   t0, 0x7800
+	slli t1, s0, 3
+	add  t1, t0, t1
+	li   t2, 1
+	sd   t2, 0(t1)      # done[hart] = 1
+	bnez s0, halt
+
+	li   t1, 1          # t1 = other hart
+join:
+	bgeu t1, s1, halt
+	slli t2, t1, 3
+	add  t3, t0, t2
+wait:
+	ld   t4, 0(t3)      # wait for done[other]
+	beqz t4, wait
+	li   t3, 0x7000
+	add  t3, t3, t2
+	ld   t4, 0(t3)
+	add  a0, a0, t4     # sum += partial[other]
+	addi t1, t1, 1
+	j    join
+
+halt:
+.word 0xfeedfeed
@@ -0,0 +1,30 @@
+# Memory streaming: write, then read back and sum, a 16KB array of doublewords,
+# 1000 times. Exercises sequential D-cache misses and store/load throughput.
+_start:
+	li   s0, 0x2000     # s0 = &array[0]
+	li   s1, 0x6000     # s1 = &array[2048], one past the end
+	li   s2, 1000       # s2 = passes left
+	li   a0, 0          # a0 = running sum
+
+pass:
+	mv   t0, s0         # t0 = write pointer
+write:
+	sd   s2, 0(t0)      # array[i] = pass
+	sd   s2, 8(t0)      # array[i+1] = pass
+	addi t0, t0, 16
+	bltu t0, s1, write
+
+	mv   t0, s0         # t0 = read pointer
+	addi s2, s2, -1     # counted here, so that the branch at the end of read is not the
+	                    # last instruction of a 16-byte block (see bench.sh)
+read:
+	ld   t1, 0(t0)
+	ld   t2, 8(t0)
+	add  a0, a0, t1     # sum += array[i] + array[i+1]
+	add  a0, a0, t2
+	addi t0, t0, 16
+	bltu t0, s1, read
+
+	bnez s2, pass
+
+.word 0xfeedfeed
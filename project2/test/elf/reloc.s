@@ -0,0 +1,33 @@
+# Relocations across sections, for test/unit_tests.cpp. Only assembled to reloc.elf:
+# the objcopy'd .text alone would lack the data. Stores its results at 0x800.
+	.text
+_start:
+	lla  t0, values         # PCREL_HI20/PCREL_LO12_I into .data
+	ld   a0, 0(t0)
+	ld   a1, 8(t0)
+	call add                # CALL_PLT into .text.add
+	li   t3, 0x800
+	sd   a0, 0(t3)          # 0x800 = values[0] + values[1]
+	ld   t4, 16(t0)         # self = &values, an R_RISCV_64
+	sub  t4, t4, t0
+	sd   t4, 8(t3)          # 0x808 = 0
+	lui  t5, %hi(values)    # HI20/LO12_I/LO12_S
+	ld   t6, %lo(values)(t5)
+	sd   t6, %lo(copy)(t5)
+	ld   t6, %lo(copy)(t5)
+	sd   t6, 16(t3)         # 0x810 = values[0]
+	beqz t6, done           # BRANCH
+	j    done               # JAL
+done:
+	.word 0xfeedfeed
+
+	.section .text.add, "ax"
+add:
+	add  a0, a0, a1
+	ret
+
+	.data
+	.balign 8
+values:	.dword 1234, 4321
+self:	.dword values
+copy:	.dword 0
@@ -0,0 +1,5 @@
+# Calls a function no section defines, for test/unit_tests.cpp: loading has to fail.
+	.text
+_start:
+	call missing
+	.word 0xfeedfeed
@@ -0,0 +1,311 @@
+// Checks of simulator internals the reference outputs do not cover: make check, or
+// from the project root ./unit_tests. Prints every failed check and exits with the
+// number of them.
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BranchPredictor.h"
+#include "CacheHierarchy.h"
+#include "MemoryStore.h"
+#include "MultiHart.h"
+#include "cache.h"
+#include "cycle.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " #condition << std::endl; \
+            failures++;                                                                  \
+        }                                                                                \
+    } while (0)
+
+// runCycles(N) stops after exactly N cycles, also when they end within a stall the
+// pipeline pays in one step, and a run in pieces takes as many cycles as one in one go
+static void checkCycleBudget(bool dualIssue) {
+    CacheConfig iConfig{2048, 16, 2, 100};
+    CacheConfig dConfig{4096, 16, 4, 150};
+    CycleOptions options;
+    options.trace.mode = TRACE_OFF;
+    options.dualIssue = dualIssue;
+
+    std::unique_ptr<MemoryStore> wholeMemory(createMemoryStore("test/fib.bin"));
+    CycleSimulator whole;
+    CHECK(whole.init(iConfig, dConfig, wholeMemory.get(), "unit_budget", options) == SUCCESS);
+    CHECK(whole.runTillHalt() == HALT);
+    uint64_t total = whole.getCounters().get(STAT_CYCLES);
+
+    std::unique_ptr<MemoryStore> memory(createMemoryStore("test/fib.bin"));
+    CycleSimulator pieces;
+    CHECK(pieces.init(iConfig, dConfig, memory.get(), "unit_budget", options) == SUCCESS);
+    uint64_t cycles = 0;
+    Status status = SUCCESS;
+    // odd budgets, so that most of them end in the middle of a miss
+    for (uint64_t budget = 1; status == SUCCESS; budget = budget % 37 + 3) {
+        status = pieces.runCycles(budget);
+        uint64_t now = pieces.getCounters().get(STAT_CYCLES);
+        if (status == SUCCESS) CHECK(now == cycles + budget);
+        CHECK(now <= cycles + budget);
+        cycles = now;
+    }
+    CHECK(status == HALT);
+    CHECK(cycles == total);
+    CHECK(pieces.getCounters().get(STAT_DC_STALL_CYCLES) ==
+          whole.getCounters().get(STAT_DC_STALL_CYCLES));
+}
+
+// A relocatable ELF file runs with its relocations applied: references to .data,
+// a call into another text section, absolute addresses, branches and jumps. One with
+// a reference it cannot resolve does not load.
+static void checkElfRelocations() {
+    std::unique_ptr<MemoryStore> memory(createMemoryStore("test/elf/reloc.elf"));
+    CHECK(memory != nullptr);
+    if (!memory) return;
+    CacheConfig ideal{2048, 16, 2, 0};
+    CycleOptions options;
+    options.trace.mode = TRACE_OFF;
+    CycleSimulator simulator;
+    CHECK(simulator.init(ideal, ideal, memory.get(), "unit_reloc", options) == SUCCESS);
+    CHECK(simulator.runTillHalt() == HALT);
+    uint64_t sum = 0, difference = 1, copy = 0;
+    memory->getMemValue(0x800, sum, DOUBLE_SIZE);
+    memory->getMemValue(0x808, difference, DOUBLE_SIZE);
+    memory->getMemValue(0x810, copy, DOUBLE_SIZE);
+    CHECK(sum == 1234 + 4321);
+    CHECK(difference == 0);
+    CHECK(copy == 1234);
+
+    std::unique_ptr<MemoryStore> undefined(createMemoryStore("test/elf/undefined.elf"));
+    CHECK(undefined == nullptr);
+}
+
+// The return-address stack follows the link register hints: a JALR from one link
+// register into the other (a coroutine switch) pops the address it returns to and
+// pushes its own, and a return after it finds the stack empty again.
+static void checkReturnStack() {
+    PredictorConfig config;
+    config.kind = PREDICT_BIMODAL;
+    BranchPredictor predictor(config);
+    bool hit = false;
+
+    // teach the BTB a return at 0x500 (jalr x0, 0(ra)), the stack is still empty
+    predictor.resolve(0x500, OP_JALR, 0, 1, true, 0x900);
+
+    predictor.resolve(0x100, OP_JAL, 1, 0, true, 0x400);   // jal ra: push 0x104
+    predictor.resolve(0x400, OP_JALR, 5, 1, true, 0x104);  // jalr t0, 0(ra): swap
+    CHECK(predictor.predict(0x500, hit) == 0x404);
+    CHECK(hit);
+    predictor.resolve(0x500, OP_JALR, 0, 1, true, 0x900);  // pops 0x404
+    // with the stack empty the return goes where the BTB saw it go
+    CHECK(predictor.predict(0x500, hit) == 0x900);
+
+    // the switch is predicted from the stack as well
+    predictor.resolve(0x100, OP_JAL, 1, 0, true, 0x400);
+    CHECK(predictor.predict(0x400, hit) == 0x104);
+    CHECK(hit);
+
+    // with rd == rs1 it is a call only: jalr ra, 0(ra) leaves 0x104 below its push
+    predictor.resolve(0x600, OP_JALR, 1, 1, true, 0x800);
+    predictor.resolve(0x500, OP_JALR, 0, 1, true, 0x604);
+    CHECK(predictor.predict(0x500, hit) == 0x104);
+}
+
+// A predictor checkpoint whose return stack pointer is past the stack does not load.
+static void checkPredictorRestore() {
+    PredictorConfig config;
+    config.kind = PREDICT_GSHARE;
+    BranchPredictor predictor(config);
+    predictor.resolve(0x100, OP_JAL, 1, 0, true, 0x400);
+    CheckpointWriter out;
+    CHECK(out.open("unit_predictor.ckpt") == SUCCESS);
+    predictor.saveState(out);
+    CHECK(out.close() == SUCCESS);
+
+    CheckpointReader in;
+    CHECK(in.open("unit_predictor.ckpt") == SUCCESS);
+    BranchPredictor restored(config);
+    CHECK(restored.restoreState(in));
+
+    // the section ends with the top and the size of the stack
+    std::ifstream file("unit_predictor.ckpt", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+    bytes[bytes.size() - 16] = static_cast<char>(config.rasEntries);
+    std::ofstream("unit_predictor.ckpt", std::ios::binary | std::ios::trunc)
+        .write(bytes.data(), bytes.size());
+    CheckpointReader corrupt;
+    CHECK(corrupt.open("unit_predictor.ckpt") == SUCCESS);
+    CHECK(!restored.restoreState(corrupt));
+    std::remove("unit_predictor.ckpt");
+}
+
+// A checkpoint taken mid-run, with stores waiting in the write buffer, resumes to the
+// same end as the run it was taken of; a truncated one does not load.
+static void checkCheckpoint() {
+    CacheConfig iConfig{2048, 16, 2, 20};
+    CacheConfig dConfig{4096, 16, 4, 30};
+    dConfig.writePolicy = WRITE_BUFFER;
+    dConfig.writeBufferEntries = 2;
+    CycleOptions options;
+    options.trace.mode = TRACE_OFF;
+
+    std::unique_ptr<MemoryStore> memory(createMemoryStore("test/fib.bin"));
+    CycleSimulator original;
+    CHECK(original.init(iConfig, dConfig, memory.get(), "unit_checkpoint", options) == SUCCESS);
+    CHECK(original.runCycles(60) == SUCCESS);
+    CHECK(original.saveCheckpoint("unit_checkpoint.ckpt") == SUCCESS);
+    CHECK(original.runTillHalt() == HALT);
+
+    std::unique_ptr<MemoryStore> resumedMemory(createMemoryStore("test/fib.bin"));
+    CycleSimulator resumed;
+    options.loadCheckpoint = "unit_checkpoint.ckpt";
+    CHECK(resumed.init(iConfig, dConfig, resumedMemory.get(), "unit_checkpoint", options) ==
+          SUCCESS);
+    CHECK(resumed.runTillHalt() == HALT);
+    CHECK(resumed.getCounters().get(STAT_CYCLES) == original.getCounters().get(STAT_CYCLES));
+    CHECK(resumed.getCounters().get(STAT_WRITE_BUFFER_FULL_CYCLES) ==
+          original.getCounters().get(STAT_WRITE_BUFFER_FULL_CYCLES));
+
+    std::ifstream in("unit_checkpoint.ckpt", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream("unit_checkpoint.ckpt", std::ios::binary | std::ios::trunc)
+        .write(bytes.data(), bytes.size() - 12);
+    CycleSimulator truncated;
+    CHECK(truncated.init(iConfig, dConfig, resumedMemory.get(), "unit_checkpoint", options) ==
+          ERROR);
+    std::remove("unit_checkpoint.ckpt");
+}
+
+// The writes of a write-back D-cache reach the memory through an L2 given no write
+// policy of its own, and a write-allocate miss of part of an L2 block reads the block.
+static void checkWriteTraffic() {
+    std::istringstream file("2048\n16\n2\n5\n4096\n16\n4\n8\n"
+                            "dcache.write_policy write-back\n"
+                            "l2.size 8192\nl2.block 16\nl2.ways 4\nl2.latency 10\n"
+                            "memory.latency 50\n");
+    CacheConfig iConfig, dConfig;
+    CycleOptions options;
+    options.trace.mode = TRACE_OFF;
+    parseCacheConfig(file, iConfig, dConfig, options.hierarchy);
+    CHECK(options.hierarchy.levels.size() == 1);
+    if (options.hierarchy.levels.size() != 1) return;
+    CHECK(options.hierarchy.levels[0].writePolicy == WRITE_BACK);
+
+    // everything the D-cache wrote back went on to the memory, but for what still
+    // fits into the L2
+    std::unique_ptr<MemoryStore> memory(createMemoryStore("test/bench/stream.bin"));
+    CycleSimulator simulator;
+    CHECK(simulator.init(iConfig, dConfig, memory.get(), "unit_writes", options) == SUCCESS);
+    CHECK(simulator.runTillHalt() == HALT);
+    StatsRegistry counters = simulator.getCounters();
+    uint64_t written = counters.get(STAT_DC_WRITE_BYTES);
+    uint64_t reached = counters.get(STAT_MEMORY_WRITE_BYTES);
+    CHECK(written == counters.get(STAT_DC_WRITE_BACKS) * dConfig.blockSize);
+    CHECK(written > 0);
+    CHECK(reached <= written);
+    CHECK(reached + options.hierarchy.levels[0].cacheSize >= written);
+
+    // 16 bytes into each of twice as many 32-byte blocks as the L2 holds: every one is
+    // read first, the second half evicts the first
+    options.hierarchy.levels[0].blockSize = 32;
+    CacheHierarchy hierarchy(options.hierarchy);
+    for (uint64_t block = 0; block < 512; block++) hierarchy.writeLatency(block * 32, 16, 0);
+    CHECK(hierarchy.getMemoryReads() == 512);
+    CHECK(hierarchy.getMemoryWrites() == 256);
+    CHECK(hierarchy.getMemoryWriteBytes() == 256 * 32);
+}
+
+// A hierarchy checkpoint whose last level does not match this hierarchy changes
+// none of its levels, not even the ones before it that match.
+static void checkHierarchyRestore() {
+    HierarchyConfig saved;
+    saved.levels = {CacheConfig{16384, 32, 4, 10}, CacheConfig{65536, 64, 8, 30}};
+    saved.memoryLatency = 100;
+    CacheHierarchy original(saved);
+    for (uint64_t address = 0; address < 4096; address += 64) original.warm(address);
+    CheckpointWriter out;
+    CHECK(out.open("unit_hierarchy.ckpt") == SUCCESS);
+    original.saveState(out);
+    CHECK(out.close() == SUCCESS);
+
+    HierarchyConfig other = saved;
+    other.levels[1].ways = 4;
+    CacheHierarchy hierarchy(other);
+    hierarchy.warm(0x10000);
+    CheckpointReader in;
+    CHECK(in.open("unit_hierarchy.ckpt") == SUCCESS);
+    CHECK(!hierarchy.restoreState(in));
+    CHECK(hierarchy.level(0).getMisses() == 1);
+    CHECK(hierarchy.level(1).getMisses() == 1);
+    std::remove("unit_hierarchy.ckpt");
+}
+
+// Harts share one memory: test/bench/parallel.bin leaves partial sums that add up to
+// the one of a single hart, and a run in pieces takes the cycles of one in one go.
+static void checkMultiHart() {
+    CacheConfig iConfig{2048, 16, 2, 5};
+    CacheConfig dConfig{4096, 16, 4, 8};
+    CycleOptions options;
+    options.trace.mode = TRACE_OFF;
+
+    std::unique_ptr<MemoryStore> single(createMemoryStore("test/bench/parallel.bin"));
+    CycleSimulator one;
+    CHECK(one.init(iConfig, dConfig, single.get(), "unit_harts", options) == SUCCESS);
+    CHECK(one.runTillHalt() == HALT);
+    uint64_t expected = 0;
+    single->getMemValue(0x7000, expected, DOUBLE_SIZE);
+
+    options.harts = 4;
+    std::unique_ptr<MemoryStore> wholeMemory(createMemoryStore("test/bench/parallel.bin"));
+    MultiHart whole;
+    CHECK(whole.init(iConfig, dConfig, wholeMemory.get(), "unit_harts", options) == SUCCESS);
+    CHECK(whole.runTillHalt() == HALT);
+    uint64_t sum = 0;
+    for (uint64_t hart = 0; hart < 4; hart++) {
+        uint64_t partial = 0, done = 0;
+        wholeMemory->getMemValue(0x7000 + 8 * hart, partial, DOUBLE_SIZE);
+        wholeMemory->getMemValue(0x7800 + 8 * hart, done, DOUBLE_SIZE);
+        sum += partial;
+        CHECK(done == 1);
+    }
+    CHECK(sum == expected);
+    CHECK(whole.hart(1).getCounters().get(STAT_COHERENCE_INVALIDATIONS) > 0);
+
+    std::unique_ptr<MemoryStore> memory(createMemoryStore("test/bench/parallel.bin"));
+    MultiHart pieces;
+    CHECK(pieces.init(iConfig, dConfig, memory.get(), "unit_harts", options) == SUCCESS);
+    Status status = SUCCESS;
+    for (uint64_t budget = 1; status == SUCCESS; budget = budget % 997 + 3) {
+        status = pieces.runCycles(budget);
+    }
+    CHECK(status == HALT);
+    for (uint64_t hart = 0; hart < 4; hart++) {
+        CHECK(pieces.hart(hart).getCounters().get(STAT_CYCLES) ==
+              whole.hart(hart).getCounters().get(STAT_CYCLES));
+    }
+}
+
+int main() {
+    checkCycleBudget(false);
+    checkCycleBudget(true);
+    checkElfRelocations();
+    checkReturnStack();
+    checkPredictorRestore();
+    checkCheckpoint();
+    checkHierarchyRestore();
+    checkWriteTraffic();
+    checkMultiHart();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+    } else {
+        std::cout << "All checks passed" << std::endl;
+    }
+    return failures;
+}